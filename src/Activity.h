@@ -72,7 +72,7 @@ public:
 
     virtual void activityDel(const string &name) = 0;
 
-    virtual void lastActivityIs(Activity::Ptr) = 0;
+    virtual void lastActivityIs(const Activity::Ptr &) = 0;
 
     virtual Time now() const = 0;
     virtual void nowIs(Time) = 0;
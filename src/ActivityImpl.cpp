@@ -1,5 +1,6 @@
 #include <iostream>
 #include <time.h>
+#include <algorithm>
 
 #include "ActivityImpl.h"
 #include "Engine.h"
@@ -61,9 +62,30 @@ namespace ActivityImpl {
 		activities_.erase(name);
     }
     
-    void ManagerImpl::lastActivityIs(Activity::Ptr activity) {
-		scheduledActivities_.push(activity);
+    void ManagerImpl::lastActivityIs(const Activity::Ptr &activity) {
+		scheduledActivities_.push_back(ScheduledActivity(activity, activitiesScheduled_++));
+		push_heap(scheduledActivities_.begin(), scheduledActivities_.end(), ActivityComp());
     }
+
+	std::vector<Activity::Ptr> ManagerImpl::scheduledActivities() const {
+		std::vector<ScheduledActivity> heap(scheduledActivities_);
+		sort_heap(heap.begin(), heap.end(), ActivityComp());
+		// sort_heap leaves the last to run first
+		std::vector<Activity::Ptr> inOrder;
+		for (size_t i = heap.size(); i-- > 0; ) inOrder.push_back(heap[i].activity);
+		return inOrder;
+	}
+
+	// scheduled is in the order it is to run in, which is kept for equal times
+	void ManagerImpl::scheduleIs(Shipping::Network *network, Time now, U64 activitiesExecuted,
+		const std::vector<Activity::Ptr> &scheduled) {
+		scheduledActivities_.clear();
+		for (size_t i = 0; i < scheduled.size(); i++) lastActivityIs(scheduled[i]);
+		network_ = network;
+		now_ = now;
+		clock_.valueIs(now.value());
+		activitiesExecuted_.valueIs(activitiesExecuted);
+	}
 	
 	void ManagerImpl::nowIs(Time t) {
 		static bool beenHere = false;
@@ -86,7 +108,7 @@ namespace ActivityImpl {
 		while (!scheduledActivities_.empty()) {
 			
 			//figure out the next activity to run
-			Activity::Ptr nextToRun = scheduledActivities_.top();
+			Activity::Ptr nextToRun = scheduledActivities_.front().activity;
 
 			//if the next time is greater than the specified time, break
 			//the loop
@@ -104,17 +126,21 @@ namespace ActivityImpl {
 			}
 			
 			now_ = nextToRun->nextTime();
+			clock_.valueIs(now_.value());
 
 			//run the minimum time activity and remove it from the queue
-			scheduledActivities_.pop();
+			pop_heap(scheduledActivities_.begin(), scheduledActivities_.end(), ActivityComp());
+			scheduledActivities_.pop_back();
 
 			nextToRun->statusIs(Activity::executing);
 			nextToRun->statusIs(Activity::free);
+			activitiesExecuted_.valueInc();
 
 		}
 		
 		//syncrhonize the time
 		now_ = t;
+		clock_.valueIs(now_.value());
 	}
 
 } //end namespace ActivityImpl
@@ -2,6 +2,7 @@
 #define __ACTIVITY_IMPL_H__
 
 #include "Activity.h"
+#include "fwk/Atomic.h"
 #include <map>
 #include <string>
 #include <queue>
@@ -15,13 +16,24 @@ Fwk::Ptr<Activity::Manager> realTimeManagerInstance(Shipping::Network *network);
 
 namespace ActivityImpl {
 
+// an activity in the scheduler's heap, numbered in the order it was
+// scheduled so that activities due at the same time run first come, first
+// served whatever else is in the heap
+struct ScheduledActivity {
+	ScheduledActivity(const Activity::Ptr &a, U64 s): activity(a), sequence(s) {}
+	Activity::Ptr activity;
+	U64 sequence;
+};
+
 //Comparison class for activities   
 class ActivityComp {
 public:
 	ActivityComp() {}
 
-	bool operator()(Activity::Ptr a, Activity::Ptr b) const {
-		return (a->nextTime() > b->nextTime());
+	bool operator()(const ScheduledActivity &a, const ScheduledActivity &b) const {
+		if (a.activity->nextTime() > b.activity->nextTime()) return true;
+		if (b.activity->nextTime() > a.activity->nextTime()) return false;
+		return a.sequence > b.sequence;
 	}
 };
     
@@ -91,24 +103,42 @@ public:
 	virtual Time now() const { return now_; }
 	virtual void nowIs(Time time);
 
+	// copies of the clock and a count of the activities run so far that
+	// other threads (the metrics exporter) may read while nowIs runs
+	double clock() const { return clock_.value(); }
+	U64 activitiesExecuted() const { return activitiesExecuted_.value(); }
+
 	static Fwk::Ptr<Activity::Manager> singletonActivityManagerInstance(ManagerType t, Shipping::Network *network);
 
-	virtual void lastActivityIs(Activity::Ptr activity);
+	virtual void lastActivityIs(const Activity::Ptr &activity);
+
+	// the scheduled activities in the order they will run, and a saved
+	// schedule put back in place of this one along with the clock and count
+	// it was saved at (see Checkpoint.h)
+	std::vector<Activity::Ptr> scheduledActivities() const;
+	void scheduleIs(Shipping::Network *network, Time now, U64 activitiesExecuted,
+		const std::vector<Activity::Ptr> &scheduled);
 
 protected:
     ManagerImpl(ManagerType t, Shipping::Network *network):
     	Manager(),
     	network_(network),
     	managerType_(t),
-    	now_(0)
+    	now_(0),
+    	activitiesScheduled_(0)
     	{}
 
     Shipping::Network *network_;
     ManagerType managerType_;
 	//Data members
-	std::priority_queue<Activity::Ptr, std::vector<Activity::Ptr>, ActivityComp> scheduledActivities_;
+	// a binary heap kept with push_heap and pop_heap, as a priority_queue
+	// would, but with the array in reach of checkpoints
+	std::vector<ScheduledActivity> scheduledActivities_;
+	U64 activitiesScheduled_;
 	std::map<string, Activity::Ptr> activities_; //pool of all activities
 	Time now_;
+	Fwk::Atomic<double> clock_;
+	Fwk::Atomic<U64> activitiesExecuted_;
 
 	//singleton instance
 	static Fwk::Ptr<Activity::Manager> activityInstance_;
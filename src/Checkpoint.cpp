@@ -0,0 +1,622 @@
+#include "Checkpoint.h"
+#include "ActivityImpl.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace Shipping {
+
+static const U32 noIndex = ~0u;
+
+// activity kinds in the state section
+enum ActivityKind {
+	fleetActivity = 0,
+	injectActivity,
+	forwardActivity,
+	tripActivity,
+	waitExpiryActivity,
+	tripTimeoutActivity,
+	retryActivity,
+	activityKinds
+};
+
+static const char *activityName[activityKinds] = {
+	"FleetActivity", "InjectActivity", "ForwardingActivity",
+	"TripActivity", "WaitExpiryActivity", "TripTimeoutActivity", "RetryActivity"
+};
+
+class Checkpoint::Writer {
+public:
+	template<class T>
+	void valueIs(T v) { bytes_.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+	void bytesIs(const string &bytes) { bytes_ += bytes; }
+	const string &bytes() const { return bytes_; }
+
+private:
+	string bytes_;
+};
+
+class Checkpoint::Reader {
+public:
+	Reader(const string &bytes): next_(bytes.data()), end_(bytes.data() + bytes.size()) {}
+
+	template<class T>
+	T value() {
+		if (sizeof(T) > (size_t) (end_ - next_)) throw Fwk::StorageException("checkpoint truncated");
+		T v;
+		memcpy(&v, next_, sizeof(T));
+		next_ += sizeof(T);
+		return v;
+	}
+
+private:
+	const char *next_;
+	const char *end_;
+};
+
+// positions of entities in the checkpoint; shipments are numbered as
+// they are come across
+struct Checkpoint::Indexes {
+	map<const Location *, U32> location;
+	map<const Segment *, U32> segment;
+	map<const Shipment *, U32> shipment;
+	vector<const Shipment *> shipments;
+
+	U32 locationIndex(const Location *l) const {
+		map<const Location *, U32>::const_iterator found = location.find(l);
+		return found == location.end() ? noIndex : found->second;
+	}
+	U32 segmentIndex(const Segment *s) const {
+		map<const Segment *, U32>::const_iterator found = segment.find(s);
+		return found == segment.end() ? noIndex : found->second;
+	}
+	U32 shipmentIndex(const Shipment *s) {
+		if (!s) return noIndex;
+		map<const Shipment *, U32>::iterator found = shipment.find(s);
+		if (found != shipment.end()) return found->second;
+		U32 index = shipments.size();
+		shipment[s] = index;
+		shipments.push_back(s);
+		shipmentIndex(s->parent().ptr());
+		return index;
+	}
+};
+
+Checkpoint::Ptr
+Checkpoint::CheckpointNew(Network *network)
+{
+	Ptr m = new Checkpoint(network);
+	m->referencesDec(1);
+	// decr. refer count to compensate for initial val of 1
+	return m;
+}
+
+Checkpoint::Checkpoint(Network *network):
+	network_(network),
+	status_(none()),
+	child_(0)
+	{}
+
+Checkpoint::~Checkpoint()
+{
+	checkpointWait();
+}
+
+Checkpoint::Status
+Checkpoint::status()
+{
+	if (status_ != writing()) return status_;
+	int result;
+	pid_t done = waitpid(child_, &result, WNOHANG);
+	if (done == child_) status_ = WIFEXITED(result) && WEXITSTATUS(result) == 0 ? written() : failed();
+	else if (done < 0) status_ = failed();
+	return status_;
+}
+
+Checkpoint::Status
+Checkpoint::checkpointWait()
+{
+	if (status_ != writing()) return status_;
+	int result;
+	pid_t done;
+	do done = waitpid(child_, &result, 0); while (done < 0 && errno == EINTR);
+	if (done == child_) status_ = WIFEXITED(result) && WEXITSTATUS(result) == 0 ? written() : failed();
+	else status_ = failed();
+	return status_;
+}
+
+void
+Checkpoint::checkpointIs(const string &path)
+{
+	checkpointWait();
+	pid_t child = fork();
+	if (child < 0) throw Fwk::ErrnoException(errno, path);
+	if (child == 0) {
+		// _exit, so the child neither flushes the parent's buffered output
+		// nor runs its exit handlers
+		int result = 0;
+		try { checkpointWrite(path); }
+		catch (...) { result = 1; }
+		_exit(result);
+	}
+	child_ = child;
+	status_ = writing();
+}
+
+void
+Checkpoint::checkpointWrite(const string &path)
+{
+	string state = stateWrite();
+	string temporary = path + ".tmp";
+	Loader::LoaderNew(network_)->snapshotWrite(temporary, state);
+	if (rename(temporary.c_str(), path.c_str()) < 0) throw Fwk::ErrnoException(errno, path);
+}
+
+void
+Checkpoint::restoreIs(const string &path)
+{
+	if (network_->segmentCount() || network_->locationCount()) {
+		throw Fwk::PermissionException("checkpoints are restored into an empty network");
+	}
+	Loader::Ptr loader = Loader::LoaderNew(network_);
+	loader->snapshotIs(path);
+	if (loader->snapshotState().empty()) throw Fwk::StorageException("not a checkpoint");
+	if (loader->errors()) throw Fwk::StorageException("checkpoint network did not load cleanly");
+	stateIs(loader->snapshotState(), loader);
+}
+
+void
+Checkpoint::histogramWrite(Writer &out, const Histogram &histogram) const
+{
+	out.valueIs<U64>(histogram.count());
+	out.valueIs(histogram.sum());
+	out.valueIs(histogram.max());
+	U32 used = 0;
+	for (unsigned i = 0; i < Histogram::buckets; i++) used += histogram.bucket(i) != 0;
+	out.valueIs(used);
+	for (unsigned i = 0; i < Histogram::buckets; i++) {
+		if (!histogram.bucket(i)) continue;
+		out.valueIs<U32>(i);
+		out.valueIs<U32>(histogram.bucket(i));
+	}
+}
+
+Histogram
+Checkpoint::histogramRead(Reader &in) const
+{
+	Histogram histogram;
+	U64 count = in.value<U64>();
+	double sum = in.value<double>();
+	double max = in.value<double>();
+	histogram.totalsIs(count, sum, max);
+	U32 used = in.value<U32>();
+	for (U32 i = 0; i < used; i++) {
+		U32 bucket = in.value<U32>();
+		U32 count = in.value<U32>();
+		if (bucket >= Histogram::buckets) throw Fwk::StorageException("checkpoint histogram corrupt");
+		histogram.bucketIs(bucket, count);
+	}
+	return histogram;
+}
+
+void
+Checkpoint::waitingWrite(Writer &out, Indexes &indexes, const Segment::Waiting &waiting) const
+{
+	out.valueIs(indexes.shipmentIndex(waiting.shipment.ptr()));
+	out.valueIs(waiting.since);
+}
+
+Segment::Waiting
+Checkpoint::waitingRead(Reader &in, const vector<Shipment::Ptr> &shipments) const
+{
+	U32 shipment = in.value<U32>();
+	double since = in.value<double>();
+	if (shipment >= shipments.size()) throw Fwk::StorageException("checkpoint refers to an unknown shipment");
+	return Segment::Waiting(shipments[shipment], since);
+}
+
+// false, with nothing written, for an activity that is not this network's
+bool
+Checkpoint::activityWrite(Writer &out, Indexes &indexes, const Activity::Ptr &activity) const
+{
+	Activity::Notifiee *reactor = activity->notifiee().ptr();
+	if (FleetActivityReactor *r = dynamic_cast<FleetActivityReactor *>(reactor)) {
+		if (r->fleet() != network_->fleet().ptr()) return false;
+		out.valueIs<U8>(fleetActivity);
+		out.valueIs(activity->nextTime().value());
+		return true;
+	}
+	if (InjectActivityReactor *r = dynamic_cast<InjectActivityReactor *>(reactor)) {
+		U32 customer = indexes.locationIndex(r->customer().ptr());
+		if (customer == noIndex) return false;
+		out.valueIs<U8>(injectActivity);
+		out.valueIs(activity->nextTime().value());
+		out.valueIs(customer);
+		out.valueIs(r->rate());
+		return true;
+	}
+	if (ForwardActivityReactor *r = dynamic_cast<ForwardActivityReactor *>(reactor)) {
+		U32 segment = indexes.segmentIndex(r->segment().ptr());
+		if (segment == noIndex) return false;
+		out.valueIs<U8>(forwardActivity);
+		out.valueIs(activity->nextTime().value());
+		out.valueIs(segment);
+		out.valueIs(indexes.shipmentIndex(r->shipment().ptr()));
+		out.valueIs(r->departure());
+		return true;
+	}
+	if (TripActivityReactor *r = dynamic_cast<TripActivityReactor *>(reactor)) {
+		U32 segment = indexes.segmentIndex(r->segment().ptr());
+		if (segment == noIndex) return false;
+		out.valueIs<U8>(tripActivity);
+		out.valueIs(activity->nextTime().value());
+		out.valueIs(segment);
+		out.valueIs<U32>(r->vehicles().value());
+		out.valueIs<U32>(r->load().value());
+		out.valueIs(r->departure());
+		const Segment::BoardingList &shipments = r->shipments();
+		out.valueIs<U32>(shipments.size());
+		for (size_t i = 0; i < shipments.size(); i++) waitingWrite(out, indexes, shipments[i]);
+		return true;
+	}
+	if (WaitExpiryActivityReactor *r = dynamic_cast<WaitExpiryActivityReactor *>(reactor)) {
+		U32 segment = indexes.segmentIndex(r->segment().ptr());
+		if (segment == noIndex) return false;
+		out.valueIs<U8>(waitExpiryActivity);
+		out.valueIs(activity->nextTime().value());
+		out.valueIs(segment);
+		return true;
+	}
+	if (TripTimeoutActivityReactor *r = dynamic_cast<TripTimeoutActivityReactor *>(reactor)) {
+		U32 segment = indexes.segmentIndex(r->segment().ptr());
+		if (segment == noIndex) return false;
+		out.valueIs<U8>(tripTimeoutActivity);
+		out.valueIs(activity->nextTime().value());
+		out.valueIs(segment);
+		out.valueIs(r->trip());
+		return true;
+	}
+	if (RetryActivityReactor *r = dynamic_cast<RetryActivityReactor *>(reactor)) {
+		if (indexes.locationIndex(r->shipment()->source().ptr()) == noIndex) return false;
+		out.valueIs<U8>(retryActivity);
+		out.valueIs(activity->nextTime().value());
+		out.valueIs(indexes.shipmentIndex(r->shipment().ptr()));
+		out.valueIs(indexes.segmentIndex(r->segment().ptr()));
+		out.valueIs(indexes.locationIndex(r->location().ptr()));
+		out.valueIs<U8>(r->successfullyForwardedShipment());
+		out.valueIs(r->totalTimeWaiting());
+		out.valueIs(r->since());
+		out.valueIs(r->wait());
+		return true;
+	}
+	return false;
+}
+
+Activity::Ptr
+Checkpoint::activityRead(Reader &in, const Loader::Ptr &loader, const vector<Shipment::Ptr> &shipments)
+{
+	U8 kind = in.value<U8>();
+	double nextTime = in.value<double>();
+	if (kind >= activityKinds) throw Fwk::StorageException("checkpoint activity of unknown kind");
+	Activity::Manager::Ptr manager = activityManagerInstance(network_);
+	Activity::Ptr activity = manager->activityNew(activityName[kind]);
+	Activity::Notifiee *reactor = 0;
+	Segment::Ptr segment;
+	if (kind == forwardActivity || kind == tripActivity || kind == waitExpiryActivity || kind == tripTimeoutActivity) {
+		segment = loader->imageSegment(in.value<U32>());
+		if (!segment) throw Fwk::StorageException("checkpoint activity on an unknown segment");
+	}
+	switch (kind) {
+		case fleetActivity:
+			reactor = new FleetActivityReactor(manager, activity.ptr(), const_cast<Fleet *>(network_->fleet().ptr()));
+			break;
+		case injectActivity:
+		{
+			Customer::Ptr customer = dynamic_cast<Customer *>(loader->imageLocation(in.value<U32>()).ptr());
+			double rate = in.value<double>();
+			if (!customer) throw Fwk::StorageException("checkpoint activity for an unknown customer");
+			reactor = new InjectActivityReactor(manager, activity.ptr(), customer.ptr(), rate, network_);
+			break;
+		}
+		case forwardActivity:
+		{
+			U32 shipment = in.value<U32>();
+			if (shipment >= shipments.size()) throw Fwk::StorageException("checkpoint refers to an unknown shipment");
+			ForwardActivityReactor *r = new ForwardActivityReactor(manager, activity.ptr(), segment.ptr(), shipments[shipment].ptr());
+			r->departureIs(in.value<double>());
+			reactor = r;
+			break;
+		}
+		case tripActivity:
+		{
+			VehicleCount vehicles(in.value<U32>());
+			PackageCount load(in.value<U32>());
+			TripActivityReactor *r = new TripActivityReactor(manager, activity.ptr(), segment.ptr(), vehicles, load);
+			reactor = r;
+			r->departureIs(in.value<double>());
+			U32 n = in.value<U32>();
+			for (U32 i = 0; i < n; i++) r->shipments().push_back(waitingRead(in, shipments));
+			break;
+		}
+		case waitExpiryActivity:
+			reactor = new WaitExpiryActivityReactor(manager, activity.ptr(), segment.ptr());
+			break;
+		case tripTimeoutActivity:
+			reactor = new TripTimeoutActivityReactor(manager, activity.ptr(), segment.ptr(), in.value<U32>());
+			break;
+		case retryActivity:
+		{
+			U32 shipment = in.value<U32>();
+			U32 on = in.value<U32>();
+			if (shipment >= shipments.size()) throw Fwk::StorageException("checkpoint refers to an unknown shipment");
+			RetryActivityReactor *r = new RetryActivityReactor(manager, activity.ptr(),
+				shipments[shipment].ptr(), loader->imageSegment(on).ptr(), network_);
+			U32 at = in.value<U32>();
+			if (at != noIndex) r->locationIs(loader->imageLocation(at));
+			bool forwarded = in.value<U8>();
+			double totalTimeWaiting = in.value<double>();
+			double since = in.value<double>();
+			r->retriesIs(forwarded, totalTimeWaiting, since, in.value<double>());
+			reactor = r;
+			break;
+		}
+	}
+	activity->lastNotifieeIs(reactor);
+	activity->nextTimeIs(Time(nextTime));
+	return activity;
+}
+
+string
+Checkpoint::stateWrite() const
+{
+	Indexes indexes;
+	vector<Location::PtrConst> locations = network_->locations();
+	for (size_t i = 0; i < locations.size(); i++) indexes.location[locations[i].ptr()] = i;
+	vector<Segment::PtrConst> segments = network_->segments();
+	for (size_t i = 0; i < segments.size(); i++) indexes.segment[segments[i].ptr()] = i;
+	ActivityImpl::ManagerImpl *manager =
+		dynamic_cast<ActivityImpl::ManagerImpl *>(activityManagerInstance(network_).ptr());
+	Connectivity::PtrConst conn = network_->connectivity();
+	Fleet::PtrConst fleet = network_->fleet();
+
+	// shipments are found while writing what holds them, so they are
+	// written last and moved up front
+	Writer out;
+	out.valueIs<U32>(segments.size());
+	for (size_t i = 0; i < segments.size(); i++) {
+		const Segment *s = segments[i].ptr();
+		out.valueIs<U32>(s->segmentLoad().value());
+		out.valueIs<U32>(s->vehiclesBusy().value());
+		out.valueIs<U32>(s->tripVehicles().value());
+		out.valueIs<U32>(s->tripLoad().value());
+		out.valueIs(s->trip());
+		out.valueIs<U8>(s->admissionPolicy());
+		for (size_t c = 0; c < Priority::classes; c++) out.valueIs(s->waitCredit((Priority::Class) c));
+		out.valueIs<U8>(s->waitExpiryScheduled());
+		out.valueIs<U64>(s->numShipmentsReceived().value());
+		out.valueIs<U64>(s->numShipmentsRefused().value());
+		out.valueIs<U64>(s->numShipmentsToldToWait().value());
+		histogramWrite(out, s->waitHistogram());
+		const Segment::BoardingList &boarding = s->boarding();
+		out.valueIs<U32>(boarding.size());
+		for (size_t b = 0; b < boarding.size(); b++) waitingWrite(out, indexes, boarding[b]);
+		for (size_t c = 0; c < Priority::classes; c++) {
+			const Segment::WaitQueue &waiting = s->waiting((Priority::Class) c);
+			out.valueIs<U32>(waiting.size());
+			for (size_t w = 0; w < waiting.size(); w++) waitingWrite(out, indexes, waiting[w]);
+		}
+	}
+
+	vector<const Customer *> customers;
+	for (size_t i = 0; i < locations.size(); i++) {
+		const Customer *c = dynamic_cast<const Customer *>(locations[i].ptr());
+		if (c) customers.push_back(c);
+	}
+	out.valueIs<U32>(customers.size());
+	for (size_t i = 0; i < customers.size(); i++) {
+		const Customer *c = customers[i];
+		out.valueIs(indexes.locationIndex(c));
+		out.valueIs<U64>(c->shipmentsReceived().value());
+		out.valueIs(c->totalLatency().value());
+		out.valueIs(c->totalCost().value());
+		histogramWrite(out, c->latencyHistogram());
+	}
+
+	const Statistics *stats = network_->statistics().ptr();
+	for (size_t status = 0; status < 3; status++) {
+		out.valueIs<U64>(stats ? stats->numShipments((Statistics::ShipmentStatus) status) : 0);
+	}
+	Writer records;
+	U32 recordCount = 0;
+	for (size_t src = 0; stats && src < customers.size(); src++) {
+		for (size_t dest = 0; dest < customers.size(); dest++) {
+			Statistics::ShippingRecord r = stats->shippingRecord(customers[src], customers[dest]);
+			if (!r.record[0] && !r.record[1] && !r.record[2]) continue;
+			records.valueIs(indexes.locationIndex(customers[src]));
+			records.valueIs(indexes.locationIndex(customers[dest]));
+			for (size_t k = 0; k < 3; k++) records.valueIs(r.record[k]);
+			++recordCount;
+		}
+	}
+	out.valueIs(recordCount);
+	out.bytesIs(records.bytes());
+	Histogram empty;
+	histogramWrite(out, stats ? stats->latency() : empty);
+	for (size_t c = 0; c < Priority::classes; c++) histogramWrite(out, stats ? stats->latency((Priority::Class) c) : empty);
+	histogramWrite(out, stats ? stats->wait() : empty);
+
+	vector<Activity::Ptr> scheduled = manager->scheduledActivities();
+	Writer activities;
+	U32 activityCount = 0;
+	for (size_t i = 0; i < scheduled.size(); i++) activityCount += activityWrite(activities, indexes, scheduled[i]);
+	out.valueIs(activityCount);
+	out.bytesIs(activities.bytes());
+
+	Writer state;
+	state.valueIs(manager->now().value());
+	state.valueIs<U64>(manager->activitiesExecuted());
+	state.valueIs<U64>(network_->shipmentIds());
+	state.valueIs<U64>(network_->randomSeed());
+	state.valueIs<U64>(network_->randomState());
+	state.valueIs<U8>(fleet ? fleet->timeOfDay() : Fleet::night());
+	state.valueIs<U8>(conn ? conn->routingMethod() : Connectivity::dijkstra());
+	state.valueIs<U8>(conn ? conn->waitPolicy() : Connectivity::waitRetry());
+	state.valueIs<U8>(conn ? conn->shipmentSplitting() : Connectivity::splittingDisabled());
+	state.valueIs<U8>(conn ? conn->simulationStatus() : Connectivity::off());
+
+	state.valueIs<U32>(indexes.shipments.size());
+	for (size_t i = 0; i < indexes.shipments.size(); i++) {
+		const Shipment *s = indexes.shipments[i];
+		state.valueIs<U64>(s->id());
+		state.valueIs(indexes.locationIndex(s->source().ptr()));
+		state.valueIs(indexes.locationIndex(s->dest().ptr()));
+		bool bfs = false;
+		if (conn) {
+			const Connectivity::RouteMap &routes = conn->precomputedRoutes(Connectivity::bfs());
+			Connectivity::RouteMap::const_iterator found = routes.find(Connectivity::RouteKey(s->source()->id(), s->dest()->id()));
+			bfs = found != routes.end() && found->second.ptr() == s->path().ptr();
+		}
+		state.valueIs<U8>(bfs);
+		state.valueIs(indexes.shipmentIndex(s->parent().ptr()));
+		state.valueIs(s->latency().value());
+		state.valueIs(s->wait().value());
+		state.valueIs(s->cost().value());
+		state.valueIs<U32>(s->load().value());
+		state.valueIs<U32>(s->packagesOutstanding().value());
+		state.valueIs<U8>(s->priority());
+		state.valueIs<U8>(s->dropped());
+	}
+	state.bytesIs(out.bytes());
+	return state.bytes();
+}
+
+void
+Checkpoint::stateIs(const string &state, const Loader::Ptr &loader)
+{
+	Reader in(state);
+	Connectivity::Ptr conn = network_->connectivity();
+	Fleet::Ptr fleet = const_cast<Fleet *>(network_->fleet().ptr());
+	Statistics *stats = const_cast<Statistics *>(network_->statistics().ptr());
+	if (!conn || !fleet) throw Fwk::StorageException("checkpoints need a network with a connectivity and a fleet");
+
+	double now = in.value<double>();
+	U64 activitiesExecuted = in.value<U64>();
+	U64 shipmentIds = in.value<U64>();
+	U64 randomSeed = in.value<U64>();
+	U64 randomState = in.value<U64>();
+	fleet->timeOfDayIs((Fleet::TimeOfDay) in.value<U8>());
+	conn->routingMethodIs((Connectivity::RoutingMethod) in.value<U8>());
+	conn->waitPolicyIs((Connectivity::WaitPolicy) in.value<U8>());
+	conn->shipmentSplittingIs((Connectivity::ShipmentSplitting) in.value<U8>());
+	Connectivity::SimulationStatus simulationStatus = (Connectivity::SimulationStatus) in.value<U8>();
+
+	vector<Shipment::Ptr> shipments(in.value<U32>());
+	vector<U32> parents(shipments.size());
+	for (size_t i = 0; i < shipments.size(); i++) {
+		ShipmentId id = in.value<U64>();
+		Customer::Ptr src = dynamic_cast<Customer *>(loader->imageLocation(in.value<U32>()).ptr());
+		Customer::Ptr dest = dynamic_cast<Customer *>(loader->imageLocation(in.value<U32>()).ptr());
+		bool bfs = in.value<U8>();
+		if (!src || !dest) throw Fwk::StorageException("checkpoint shipment between unknown customers");
+		const Connectivity::RouteMap &routes = conn->precomputedRoutes(bfs ? Connectivity::bfs() : Connectivity::dijkstra());
+		Connectivity::RouteMap::const_iterator route = routes.find(Connectivity::RouteKey(src->id(), dest->id()));
+		if (route == routes.end()) throw Fwk::StorageException("checkpoint shipment has no route");
+		Shipment::Ptr s;
+		try { s = Shipment::ShipmentNew(src, dest, PackageCount(0), network_); }
+		catch (Fwk::Exception &) { throw Fwk::StorageException("checkpoint shipment has no route"); }
+		s->idIs(id);
+		s->pathIs(route->second);
+		parents[i] = in.value<U32>();
+		s->latencyIs(Hours(in.value<float>()));
+		s->waitIs(Hours(in.value<float>()));
+		s->costIs(Dollars(in.value<float>()));
+		s->loadIs(PackageCount(in.value<U32>()));
+		s->packagesOutstandingIs(PackageCount(in.value<U32>()));
+		s->priorityIs((Priority::Class) in.value<U8>());
+		s->droppedIs(in.value<U8>());
+		shipments[i] = s;
+	}
+	for (size_t i = 0; i < shipments.size(); i++) {
+		if (parents[i] == noIndex) continue;
+		if (parents[i] >= shipments.size()) throw Fwk::StorageException("checkpoint refers to an unknown shipment");
+		shipments[i]->parentIs(shipments[parents[i]]);
+	}
+	network_->shipmentIdsIs(shipmentIds);
+
+	U32 segments = in.value<U32>();
+	for (U32 i = 0; i < segments; i++) {
+		Segment::Ptr s = loader->imageSegment(i);
+		if (!s) throw Fwk::StorageException("checkpoint refers to an unknown segment");
+		s->segmentLoadIs(PackageCount(in.value<U32>()));
+		s->vehiclesBusyIs(VehicleCount(in.value<U32>()));
+		VehicleCount tripVehicles(in.value<U32>());
+		PackageCount tripLoad(in.value<U32>());
+		U32 trip = in.value<U32>();
+		s->admissionPolicyIs((Segment::AdmissionPolicy) in.value<U8>());
+		for (size_t c = 0; c < Priority::classes; c++) s->waitCreditIs((Priority::Class) c, in.value<int>());
+		s->waitExpiryScheduledIs(in.value<U8>());
+		// through the setters, so the statistics' totals follow
+		s->numShipmentsReceivedIs(ShipmentCount(in.value<U64>()));
+		s->numShipmentsRefusedIs(ShipmentCount(in.value<U64>()));
+		s->numShipmentsToldToWaitIs(ShipmentCount(in.value<U64>()));
+		s->waitHistogramIs(histogramRead(in));
+		Segment::BoardingList boarding;
+		U32 n = in.value<U32>();
+		for (U32 b = 0; b < n; b++) boarding.push_back(waitingRead(in, shipments));
+		s->tripIs(trip, tripVehicles, tripLoad, boarding);
+		for (size_t c = 0; c < Priority::classes; c++) {
+			Segment::WaitQueue waiting;
+			n = in.value<U32>();
+			for (U32 w = 0; w < n; w++) waiting.push_back(waitingRead(in, shipments));
+			s->waitingIs((Priority::Class) c, waiting);
+		}
+	}
+
+	U32 customers = in.value<U32>();
+	for (U32 i = 0; i < customers; i++) {
+		Customer::Ptr c = dynamic_cast<Customer *>(loader->imageLocation(in.value<U32>()).ptr());
+		if (!c) throw Fwk::StorageException("checkpoint refers to an unknown customer");
+		ShipmentCount received(in.value<U64>());
+		Hours latency(in.value<float>());
+		Dollars cost(in.value<float>());
+		c->deliveriesIs(received, latency, cost, histogramRead(in));
+	}
+
+	for (size_t status = 0; status < 3; status++) {
+		U64 n = in.value<U64>();
+		if (stats) stats->numShipmentsIs((Statistics::ShipmentStatus) status, n);
+	}
+	U32 records = in.value<U32>();
+	for (U32 i = 0; i < records; i++) {
+		Customer::Ptr src = dynamic_cast<Customer *>(loader->imageLocation(in.value<U32>()).ptr());
+		Customer::Ptr dest = dynamic_cast<Customer *>(loader->imageLocation(in.value<U32>()).ptr());
+		Statistics::ShippingRecord record;
+		for (size_t k = 0; k < 3; k++) record.record[k] = in.value<int>();
+		if (!src || !dest) throw Fwk::StorageException("checkpoint refers to an unknown customer");
+		if (stats) stats->shippingRecordIs(src, dest, record);
+	}
+	Histogram latency = histogramRead(in);
+	if (stats) stats->latencyHistogramIs(latency);
+	for (size_t c = 0; c < Priority::classes; c++) {
+		latency = histogramRead(in);
+		if (stats) stats->latencyHistogramIs((Priority::Class) c, latency);
+	}
+	Histogram wait = histogramRead(in);
+	if (stats) stats->waitHistogramIs(wait);
+
+	// the restored schedule replaces whatever loading the network set up
+	vector<Activity::Ptr> scheduled(in.value<U32>());
+	for (size_t i = 0; i < scheduled.size(); i++) scheduled[i] = activityRead(in, loader, shipments);
+
+	ActivityImpl::ManagerImpl *manager =
+		dynamic_cast<ActivityImpl::ManagerImpl *>(activityManagerInstance(network_).ptr());
+	manager->scheduleIs(network_, Time(now), activitiesExecuted, scheduled);
+	// set last, as creating retry activities draws random numbers
+	network_->randomSeedIs(randomSeed);
+	network_->randomStateIs(randomState);
+	if (simulationStatus == Connectivity::running()) conn->simulationStatusIs(Connectivity::running());
+}
+
+} /* end namespace */
@@ -0,0 +1,114 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Engine.h"
+#include "Loader.h"
+#include <sys/types.h>
+
+namespace Shipping {
+
+// Saves a running simulation to a file and brings it back, in this or a
+// later process, so that long runs can be stopped and resumed. A
+// checkpoint is a snapshot (Loader.h) of the network and its routes with
+// one more section holding the simulation's state, all in host byte order:
+//
+//   now (double); activities run, next shipment id, random seed, random
+//       state (U64); fleet time of day, routing method, wait policy,
+//       shipment splitting, simulation status (U8)
+//   U32 shipments; for each: id (U64), source and destination (U32
+//       location index), route (U8: 0 dijkstra, 1 BFS), parent (U32
+//       shipment index, ~0 for none), latency, wait, cost (float), load,
+//       packages outstanding (U32), priority, dropped (U8)
+//   U32 segments; for each, in snapshot order: load, vehicles busy, trip
+//       vehicles, trip load, trip number (U32), admission policy (U8), wait
+//       credits (3 int), wait expiry scheduled (U8), shipments received,
+//       refused and told to wait (U64), wait histogram, the boarding list
+//       and the wait queue of each priority class
+//   U32 customers; for each: location index (U32), shipments received
+//       (U64), total latency, total cost (float), latency histogram
+//   statistics: shipments enroute, delivered and dropped (U64); U32
+//       records; for each: source and destination (U32 location index) and
+//       the record's three counts (int); latency, latency of each priority
+//       class and wait histograms
+//   U32 activities, in the order they are to run; for each: kind (U8),
+//       next time (double), then the kind's own fields
+//
+// where a histogram is count (U64), sum and max (double), U32 buckets in
+// use and for each its index and count (U32), and a list of waiting
+// shipments is U32 entries, each a shipment index (U32) and since when it
+// has waited (double).
+//
+// checkpointIs forks, and the child writes the checkpoint from its
+// copy-on-write view of memory while the simulation carries on in the
+// parent, which only pays for the fork and for copying the pages it
+// writes to before the child is done. The file appears under its name
+// once complete. Activities due at the same time run in the order they
+// were scheduled (ActivityImpl::ScheduledActivity), and are saved and
+// scheduled again in the order they are to run, so a restored run executes
+// them in exactly the order the original would have. Activities the
+// checkpoint cannot save (a sampler's, or ones belonging to another
+// network) are left out; samplers, tracers and exporters have to be started
+// again after a restore.
+class Checkpoint : public Fwk::PtrInterface<Checkpoint> {
+public:
+	typedef Fwk::Ptr<Checkpoint> Ptr;
+	typedef Fwk::Ptr<Checkpoint const> PtrConst;
+
+	enum Status {
+		none_ = 0,
+		writing_,
+		written_,
+		failed_
+	};
+	static inline Status none() { return none_; }
+	static inline Status writing() { return writing_; }
+	static inline Status written() { return written_; }
+	static inline Status failed() { return failed_; }
+
+	// of the last checkpointIs, checking on its child without waiting
+	Status status();
+	// waits for the child of the last checkpointIs to finish
+	Status checkpointWait();
+
+	// starts writing a checkpoint of the simulation as it stands to path,
+	// after waiting for any earlier one; throws Fwk::ErrnoException if it
+	// cannot fork
+	void checkpointIs(const string &path);
+	// writes a checkpoint to path in this process
+	void checkpointWrite(const string &path);
+
+	// Restores the checkpoint at path into this network, which must not
+	// have any locations or segments yet, and makes it the one the
+	// activity manager runs. Throws Fwk::ErrnoException if the file cannot
+	// be mapped and Fwk::StorageException if it is not a checkpoint.
+	void restoreIs(const string &path);
+
+	static Checkpoint::Ptr CheckpointNew(Network *network);
+
+	~Checkpoint();
+
+protected:
+	Checkpoint(Network *network);
+
+	class Writer;
+	class Reader;
+	struct Indexes;
+
+	string stateWrite() const;
+	void stateIs(const string &state, const Loader::Ptr &loader);
+
+	void histogramWrite(Writer &out, const Histogram &histogram) const;
+	Histogram histogramRead(Reader &in) const;
+	void waitingWrite(Writer &out, Indexes &indexes, const Segment::Waiting &waiting) const;
+	Segment::Waiting waitingRead(Reader &in, const vector<Shipment::Ptr> &shipments) const;
+	bool activityWrite(Writer &out, Indexes &indexes, const Activity::Ptr &activity) const;
+	Activity::Ptr activityRead(Reader &in, const Loader::Ptr &loader, const vector<Shipment::Ptr> &shipments);
+
+	Network *network_;
+	Status status_;
+	pid_t child_;
+};
+
+} /* end namespace */
+
+#endif
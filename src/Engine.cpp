@@ -1,17 +1,80 @@
 #include "Engine.h"
+#include "Instrument.h"
+#include "Trace.h"
 
 namespace Shipping {
 
+SegmentTable::Row
+SegmentTable::rowNew()
+{
+	Row r;
+	if (!free_.empty()) {
+		r = free_.back();
+		free_.pop_back();
+	} else {
+		r = mode_.size();
+		mode_.push_back(0);
+		vehicles_.push_back(0);
+		load_.push_back(0);
+		vehiclesBusy_.push_back(0);
+		received_.push_back(0);
+		refused_.push_back(0);
+		toldToWait_.push_back(0);
+	}
+	mode_[r] = 0;
+	vehicles_[r] = VehicleCount().value();
+	load_[r] = 0;
+	vehiclesBusy_[r] = 0;
+	received_[r] = 0;
+	refused_[r] = 0;
+	toldToWait_[r] = 0;
+	++rowsUsed_;
+	return r;
+}
+
+void
+SegmentTable::rowDel(Row r)
+{
+	// zeroed so that sums over a whole column need not skip free rows
+	load_[r] = 0;
+	vehiclesBusy_[r] = 0;
+	received_[r] = 0;
+	refused_[r] = 0;
+	toldToWait_[r] = 0;
+	free_.push_back(r);
+	--rowsUsed_;
+}
+
 Segment::Segment(Fwk::String name, Mode mode, Network *network):
 	Fwk::NamedInterface(name),
 	network_(network),
-	mode_(mode),
-	exp_support_(Segment::expediteNotSupported())
+	table_(network ? network->segmentTable() : SegmentTable::SegmentTableNew()),
+	row_(table_->rowNew()),
+	exp_support_(Segment::expediteNotSupported()),
+	trip_vehicles_(0),
+	trip_(0),
+	admission_policy_(Segment::weightedFair()),
+	waiting_(0),
+	wait_expiry_scheduled_(false),
+	wait_histogram_(0)
 	{
+		for (size_t i = 0; i < Priority::classes; i++) wait_credit_[i] = 0;
+
+		table_->modeIs(row_, mode);
 		SegmentReactor::Ptr reactor = SegmentReactor::SegmentReactorNew(this, network_);
 		segmentReactorIs(reactor);
 	}
 
+Segment::~Segment()
+{
+	table_->rowDel(row_);
+	delete [] waiting_;
+	delete wait_histogram_;
+}
+
+const Segment::WaitQueue Segment::noneWaiting_;
+const Histogram Segment::noWaits_;
+
 string
 Segment::modeName(Mode m)
 {
@@ -25,7 +88,7 @@ Segment::modeName(Mode m)
 
 void
 Segment::sourceIs(Fwk::Ptr<Location> location) {
-	if(location && source_ && location->name() == source_->name()) return;
+	if(location && source_ && location->symbol() == source_->symbol()) return;
 
 	if (!location ||
 		(location->locationType() != Location::terminal()) ||
@@ -42,12 +105,161 @@ Segment::sourceIs(Fwk::Ptr<Location> location) {
 		if (location) {
 			location->segmentIs(this);
 		}
+		if (network_) network_->topologyVersionInc();
 	}	
 }
 
+void
+Segment::lengthIs(Mile l) {
+	length_ = l;
+	if (network_) network_->topologyVersionInc();
+}
+
+PackageCount
+Segment::capacity() const {
+	if (!network_ || !network_->fleet()) return PackageCount(0);
+	PackageCount packagesPerVehicle = network_->fleet()->capacity(mode());
+	return PackageCount(numVehicles().value() * packagesPerVehicle.value());
+}
+
+bool
+Segment::vehicleModel() const {
+	if (!network_ || !network_->fleet()) return false;
+	return network_->fleet()->departureTimeout(mode()).value() > 0;
+}
+
+VehicleCount
+Segment::vehiclesFor(PackageCount load) const {
+	size_t perVehicle = network_->fleet()->capacity(mode()).value();
+	if (perVehicle == 0) return VehicleCount(numVehicles().value() + 1);
+	size_t vehicles = (load.value() + perVehicle - 1) / perVehicle;
+	return VehicleCount(vehicles ? vehicles : 1);
+}
+
+bool
+Segment::admits(const Fwk::Ptr<Shipment> &shipment) const {
+	if (!vehicleModel()) {
+		PackageCount spaceAvailable = PackageCount(capacity().value() - segmentLoad().value());
+		return shipment->load() <= spaceAvailable;
+	}
+
+	// join the loading trip if there is room on it...
+	if (trip_vehicles_.value() > 0) {
+		size_t room = trip_vehicles_.value() * network_->fleet()->capacity(mode()).value();
+		if (trip_load_.value() + shipment->load().value() <= room) return true;
+	}
+	// ...or start a new one with idle vehicles, sending the loading one off
+	size_t idle = numVehicles() > vehiclesBusy() ? numVehicles().value() - vehiclesBusy().value() : 0;
+	return vehiclesFor(shipment->load()).value() <= idle;
+}
+
+void
+Segment::tripNew(VehicleCount vehicles) {
+	++trip_;
+	trip_vehicles_ = vehicles;
+	trip_load_ = PackageCount(0);
+	vehiclesBusyIs(VehicleCount(vehiclesBusy().value() + vehicles.value()));
+}
+
+void
+Segment::boardingShipmentIs(const Fwk::Ptr<Shipment> &shipment, double now) {
+	boarding_.push_back(Waiting(shipment, now));
+	trip_load_ = PackageCount(trip_load_.value() + shipment->load().value());
+}
+
+void
+Segment::tripDel(BoardingList &departing) {
+	// the vehicles stay busy until the trip comes back
+	departing.swap(boarding_);
+	boarding_.clear();
+	trip_vehicles_ = VehicleCount(0);
+	trip_load_ = PackageCount(0);
+}
+
+void
+Segment::tripIs(U32 trip, VehicleCount vehicles, PackageCount load, const BoardingList &boarding) {
+	trip_ = trip;
+	trip_vehicles_ = vehicles;
+	trip_load_ = load;
+	boarding_ = boarding;
+}
+
+size_t
+Segment::waitingShipments() const {
+	size_t n = 0;
+	if (!waiting_) return n;
+	for (size_t c = 0; c < Priority::classes; c++) n += waiting_[c].size();
+	return n;
+}
+
+void
+Segment::waitingShipmentIs(const Fwk::Ptr<Shipment> &shipment, double now) {
+	if (!waiting_) waiting_ = new WaitQueue[Priority::classes];
+	waiting_[shipment->priority()].push_back(Waiting(shipment, now));
+}
+
+bool
+Segment::waitingClass(Priority::Class &c) const {
+	bool found = false;
+	int best = 0;
+	if (!waiting_) return found;
+	for (size_t i = Priority::classes; i-- > 0; ) {
+		if (waiting_[i].empty()) continue;
+		Priority::Class pc = (Priority::Class) i;
+		if (admission_policy_ == strictPriority()) {
+			c = pc;
+			return true;
+		}
+		// smooth weighted round robin: the class with the most credit
+		// once this round's weights are added goes next
+		int credit = wait_credit_[i] + (int) Priority::weight(pc);
+		if (!found || credit > best) {
+			found = true;
+			best = credit;
+			c = pc;
+		}
+	}
+	return found;
+}
+
+Segment::Waiting
+Segment::waitingShipmentDel(Priority::Class c) {
+	if (admission_policy_ == weightedFair()) {
+		int total = 0;
+		for (size_t i = 0; i < Priority::classes; i++) {
+			if (waiting_[i].empty()) continue;
+			wait_credit_[i] += Priority::weight((Priority::Class) i);
+			total += Priority::weight((Priority::Class) i);
+		}
+		wait_credit_[c] -= total;
+	}
+	Waiting w = waiting_[c].front();
+	waiting_[c].pop_front();
+	if (waiting_[c].empty()) wait_credit_[c] = 0;
+	return w;
+}
+
+void
+Segment::waitingIs(Priority::Class c, const WaitQueue &waiting) {
+	if (!waiting_) {
+		if (waiting.empty()) return;
+		waiting_ = new WaitQueue[Priority::classes];
+	}
+	waiting_[c] = waiting;
+}
+
+void
+Segment::waitHistogramIs(const Histogram &h) {
+	if (!wait_histogram_) {
+		if (!h.count()) return;
+		wait_histogram_ = new Histogram();
+	}
+	*wait_histogram_ = h;
+}
+
 void
 Segment::returnSegmentIs(Ptr &r) {
-	if (return_segment_ && r && return_segment_->name() == r->name())
+	if (return_segment_ && r && return_segment_->symbol() == r->symbol())
 		return;
 	if (r && r->mode() != mode())
 		return;
@@ -60,6 +272,7 @@ Segment::returnSegmentIs(Ptr &r) {
 	}
 	return_segment_ = r;
 	if(r) r->return_segment_ = this;
+	if (network_) network_->topologyVersionInc();
 }
 
 void
@@ -89,29 +302,13 @@ Segment::NotifieeConst::~NotifieeConst() {
 void
 Segment::arrivingShipmentIs(Fwk::Ptr<Shipment> &shipment)
 {
-	//TODO
-	PackageCount packagesPerVehicle = network_->fleet()->capacity(mode());
-	VehicleCount numVehiclesOnSegment = numVehicles();
-
-	PackageCount totalPossiblePackages =
-		PackageCount(numVehiclesOnSegment.value() * packagesPerVehicle.value());
-
-	PackageCount spaceAvailable = PackageCount(totalPossiblePackages.value() - segmentLoad().value());
-
-	if (shipment->load() <= spaceAvailable) {
-		segmentLoadIs( PackageCount(segmentLoad().value() + shipment->load().value()) );
-		numShipmentsReceivedIs( ShipmentCount(numShipmentsReceived().value() + 1) );
-
-		// tell all the notifiees
-		if(notifiees()) {
-			for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
-				try { n->onShipmentArrival(shipment); }
-				catch(...) {
-					cerr << "Segment::onShipmentArrival() notification for "
-					<< shipment->name() << " unsuccessful" << endl;
-				}
-			}
-		}
+	// nobody overtakes a waiting shipment of the same or a higher class
+	bool queuedAhead = false;
+	for (size_t c = shipment->priority(); waiting_ && c < Priority::classes; c++) {
+		if (!waiting_[c].empty()) queuedAhead = true;
+	}
+	if (!queuedAhead && admits(shipment)) {
+		admit(shipment);
 	}
 	else {
 		numShipmentsToldToWaitIs( ShipmentCount(numShipmentsToldToWait().value() + 1) );
@@ -120,26 +317,247 @@ Segment::arrivingShipmentIs(Fwk::Ptr<Shipment> &shipment)
 	}
 }
 
+void
+Segment::admit(Fwk::Ptr<Shipment> &shipment)
+{
+	segmentLoadIs( PackageCount(segmentLoad().value() + shipment->load().value()) );
+	numShipmentsReceivedIs( ShipmentCount(numShipmentsReceived().value() + 1) );
+
+	// tell our own reactor, then all the notifiees
+	try { if (segmentReactor_) segmentReactor_->SegmentReactor::onShipmentArrival(shipment); }
+	catch(...) {
+		cerr << "Segment::onShipmentArrival() notification for "
+		<< shipment->name() << " unsuccessful" << endl;
+	}
+	if(notifiees()) {
+		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
+			try { n->onShipmentArrival(shipment); }
+			catch(...) {
+				cerr << "Segment::onShipmentArrival() notification for "
+				<< shipment->name() << " unsuccessful" << endl;
+			}
+		}
+	}
+}
+
+
+Statistics *
+Segment::statistics() const
+{
+	return network_ ? const_cast<Statistics *>(network_->statistics().ptr()) : 0;
+}
+
+Tracer *
+Segment::tracer() const
+{
+	return network_ ? network_->tracer() : 0;
+}
+
+void
+Segment::numShipmentsToldToWaitIs(ShipmentCount c)
+{
+	Statistics *stats = statistics();
+	if (stats) stats->segmentShipmentsToldToWaitInc(c.value() - table_->toldToWait(row_));
+	table_->toldToWaitIs(row_, c.value());
+}
+
+void
+Segment::numShipmentsReceivedIs(ShipmentCount c)
+{
+	Statistics *stats = statistics();
+	if (stats) stats->segmentShipmentsReceivedInc(c.value() - table_->received(row_));
+	table_->receivedIs(row_, c.value());
+}
+
+void
+Segment::numShipmentsRefusedIs(ShipmentCount c)
+{
+	Statistics *stats = statistics();
+	if (stats) stats->segmentShipmentsRefusedInc(c.value() - table_->refused(row_));
+	table_->refusedIs(row_, c.value());
+}
+
+// what crossing seg adds to the shipment's cost: Path::calculateCost for
+// shipments on an expedited path, so the 50% surcharge is kept even when
+// congestion routing takes them off it onto another expedited segment
+static Dollars
+segmentCost(const Segment::PtrConst &seg, const Shipment::Ptr &shipment, const Fleet::PtrConst &fleet)
+{
+	Path::PtrConst path = shipment->path();
+	if (path && path->expedited() == Segment::expediteSupported()
+		&& seg->expediteSupport() == Segment::expediteSupported()) {
+		return path->calculateCost(seg);
+	}
+	return Dollars(fleet->costPerMile(seg->mode()).value()
+		* seg->length().value() * seg->difficulty().value());
+}
 
 void
 Segment::SegmentReactor::onShipmentArrival(Fwk::Ptr<Shipment> &shipment)
 {
+	INSTRUMENT_SCOPE(segmentArrival);
 	//TODO
+	if (notifier()->vehicleModel()) {
+		Segment::Ptr seg = notifier();
+		Fleet::PtrConst fleet = network_->fleet();
+		size_t room = seg->tripVehicles().value() * fleet->capacity(seg->mode()).value();
+		if (seg->tripVehicles().value() == 0 || seg->tripLoad().value() + shipment->load().value() > room) {
+			if (seg->tripVehicles().value() > 0) tripDepartureIs();
+			seg->tripNew(seg->vehiclesFor(shipment->load()));
+			room = seg->tripVehicles().value() * fleet->capacity(seg->mode()).value();
+
+			Activity::Ptr timeout = activityManager_->activityNew("TripTimeoutActivity");
+			timeout->lastNotifieeIs( new TripTimeoutActivityReactor(activityManager_, timeout.ptr(), seg.ptr(), seg->trip()) );
+			timeout->nextTimeIs(activityManager_->now().value() + fleet->departureTimeout(seg->mode()).value());
+			timeout->statusIs(Activity::nextTimeScheduled);
+		}
+		shipment->costInc(segmentCost(seg, shipment, fleet));
+		seg->boardingShipmentIs(shipment, activityManager_->now().value());
+		if (seg->tripLoad().value() == room) tripDepartureIs();
+		return;
+	}
+
 	Activity::Ptr activity = activityManager_->activityNew("ForwardingActivity");
 	activity->lastNotifieeIs( new ForwardActivityReactor(activityManager_, activity.ptr(), notifier().ptr(), shipment.ptr()) );
 	Segment::Ptr seg = notifier();
 	Fleet::PtrConst fleet = network_->fleet();
 	Time timeToTraverse = Time(seg->length().value() / fleet->speed(seg->mode()).value());
 	shipment->latencyInc(Hours(seg->length().value() / fleet->speed(seg->mode()).value()));
+	shipment->costInc(segmentCost(seg, shipment, fleet));
 	activity->nextTimeIs(activityManager_->now().value() + timeToTraverse.value());
 	activity->statusIs(Activity::nextTimeScheduled);
 }
 
+void
+Segment::SegmentReactor::onTripTimeout(U32 trip)
+{
+	Segment::Ptr seg = notifier();
+	if (seg->trip() == trip && seg->tripVehicles().value() > 0) tripDepartureIs();
+}
+
+void
+Segment::SegmentReactor::tripDepartureIs()
+{
+	Segment::Ptr seg = notifier();
+	Fleet::PtrConst fleet = network_->fleet();
+	double now = activityManager_->now().value();
+	double timeToTraverse = seg->length().value() / fleet->speed(seg->mode()).value();
+
+	Activity::Ptr activity = activityManager_->activityNew("TripActivity");
+	TripActivityReactor *trip = new TripActivityReactor(activityManager_, activity.ptr(),
+		seg.ptr(), seg->tripVehicles(), seg->tripLoad());
+	activity->lastNotifieeIs(trip);
+	seg->tripDel(trip->shipments());
+
+	// latency covers the time spent waiting for the vehicle to leave
+	for (size_t i = 0; i < trip->shipments().size(); ++i) {
+		Segment::Waiting &b = trip->shipments()[i];
+		Hours waited = Hours((float) (now - b.since));
+		b.shipment->latencyInc(Hours((float) (waited.value() + timeToTraverse)));
+		b.shipment->waitInc(waited);
+		seg->shipmentWaitIs(waited);
+	}
+	activity->nextTimeIs(now + timeToTraverse);
+	activity->statusIs(Activity::nextTimeScheduled);
+}
+
+void
+Segment::SegmentReactor::onWaitingShipment(Fwk::Ptr<Shipment> &shipment)
+{
+	Segment::Ptr seg = notifier();
+	double now = activityManager_->now().value();
+	seg->waitingShipmentIs(shipment, now);
+	if (network_->tracer()) network_->tracer()->waitIs(seg.ptr(), shipment.ptr(), now);
+	if (!seg->waitExpiryScheduled()) waitExpiryIs(now + RetryActivityReactor::MAX_WAIT);
+}
+
+void
+Segment::SegmentReactor::onCapacityFreed()
+{
+	INSTRUMENT_SCOPE(capacityFreed);
+	// first come, first served: a head that still does not fit blocks the
+	// shipments behind it
+	Segment::Ptr seg = notifier();
+	double now = activityManager_->now().value();
+	Priority::Class c;
+	while (seg->waitingClass(c) && seg->admits(seg->waiting(c).front().shipment)) {
+		Segment::Waiting w = seg->waitingShipmentDel(c);
+		Hours waited = Hours((float) (now - w.since));
+		w.shipment->latencyInc(waited);
+		w.shipment->waitInc(waited);
+		seg->shipmentWaitIs(waited);
+		seg->admit(w.shipment);
+	}
+
+	// Under congestion routing a shipment waits on the hop it was refused
+	// by but leaves on whichever one frees up first, so the heads of the
+	// other queues at this location may take the room left here.
+	Connectivity::PtrConst conn = network_->connectivity();
+	Location::PtrConst at = seg->source();
+	if (!conn || conn->routingMethod() != Connectivity::congestion() || !at || seg->waitingShipments()) return;
+	for (Location::SegmentIteratorConst i = at->segmentsIteratorConstBegin(); i != at->segmentsIteratorConstEnd(); ++i) {
+		Segment *other = const_cast<Segment *>(i->ptr());
+		if (other == seg.ptr()) continue;
+		while (other->waitingClass(c)) {
+			Shipment::Ptr head = other->waiting(c).front().shipment;
+			if (conn->nextHop(at, head).ptr() != seg.ptr() || !seg->admits(head)) break;
+			Segment::Waiting w = other->waitingShipmentDel(c);
+			Hours waited = Hours((float) (now - w.since));
+			w.shipment->latencyInc(waited);
+			w.shipment->waitInc(waited);
+			seg->shipmentWaitIs(waited);
+			seg->admit(w.shipment);
+		}
+	}
+}
+
+void
+Segment::SegmentReactor::onWaitExpiry()
+{
+	Segment::Ptr seg = notifier();
+	Statistics::Ptr stats = const_cast<Statistics*>(network_->statistics().ptr());
+	double now = activityManager_->now().value();
+	seg->waitExpiryScheduledIs(false);
+
+	// capacity can also change without a departure (fleet day/night switch)
+	onCapacityFreed();
+	double earliest = -1.0;
+	for (size_t i = 0; i < Priority::classes; i++) {
+		Priority::Class c = (Priority::Class) i;
+		while (!seg->waiting(c).empty() && seg->waiting(c).front().since + RetryActivityReactor::MAX_WAIT <= now) {
+			Segment::Waiting w = seg->waitingShipmentDel(c);
+			seg->numShipmentsRefusedIs( ShipmentCount(seg->numShipmentsRefused().value() + 1) );
+			stats->droppedShipmentIs(w.shipment);
+		}
+	}
+	onCapacityFreed();
+	for (size_t i = 0; i < Priority::classes; i++) {
+		Priority::Class c = (Priority::Class) i;
+		if (seg->waiting(c).empty()) continue;
+		if (earliest < 0.0 || seg->waiting(c).front().since < earliest) earliest = seg->waiting(c).front().since;
+	}
+	if (earliest >= 0.0) waitExpiryIs(earliest + RetryActivityReactor::MAX_WAIT);
+}
+
+void
+Segment::SegmentReactor::waitExpiryIs(double at)
+{
+	Activity::Ptr activity = activityManager_->activityNew("WaitExpiryActivity");
+	activity->lastNotifieeIs( new WaitExpiryActivityReactor(activityManager_, activity.ptr(), notifier().ptr()) );
+	activity->nextTimeIs(at);
+	activity->statusIs(Activity::nextTimeScheduled);
+	notifier()->waitExpiryScheduledIs(true);
+}
+
 void
 Location::arrivingShipmentIs(Fwk::Ptr<Shipment> &shipment)
 {
-	//TODO
-	// tell all the notifiees
+	// tell our own reactor, then all the notifiees
+	try { if (locationReactor_) locationReactor_->LocationReactor::onShipmentArrival(shipment); }
+	catch(...) {
+		cerr << "Location::onShipmentArrival() notification for "
+		<< shipment->name() << " unsuccessful" << endl;
+	}
 	if(notifiees()) {
 		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
 			try { n->onShipmentArrival(shipment); }
@@ -179,20 +597,28 @@ Location::NotifieeConst::~NotifieeConst() {
 void
 Location::LocationReactor::onShipmentArrival(Fwk::Ptr<Shipment> &shipment)
 {
+	INSTRUMENT_SCOPE(locationArrival);
 	//TODO
 	LocationType locationType = notifier()->locationType();
-	string destinationName = shipment->dest()->name();
-	string sourceName = shipment->source()->name();
+	Fwk::Symbol destination = shipment->dest()->symbol();
+	Fwk::Symbol source = shipment->source()->symbol();
 	Statistics::Ptr stats = const_cast<Statistics*>(network_->statistics().ptr());
 
-	if (locationType == Location::customer() && sourceName != notifier()->name()) {		
-		if (destinationName == notifier()->name()) {
+	if (locationType == Location::customer() && source != notifier()->symbol()) {		
+		if (destination == notifier()->symbol()) {
 			//at destination
+			Shipment::Ptr whole = shipment;
+			if (shipment->parent()) {
+				// reassemble: only the last batch delivers the parent
+				whole = shipment->parent();
+				whole->batchArrivalIs(shipment);
+				if (whole->packagesOutstanding().value() > 0 || whole->dropped()) return;
+			}
 			Customer *customer = dynamic_cast<Customer*>(notifier().ptr());
 			customer->shipmentsReceivedIs(ShipmentCount(customer->shipmentsReceived().value() + 1));
-			customer->totalLatencyInc(shipment->latency());
-			customer->totalCostInc(shipment->path()->cost());
-			stats->deliveredShipmentIs(shipment);
+			customer->totalLatencyInc(whole->latency());
+			customer->totalCostInc(whole->cost());
+			stats->deliveredShipmentIs(whole);
 		}
 		else {
 			// DROP SHIPMENT
@@ -201,11 +627,28 @@ Location::LocationReactor::onShipmentArrival(Fwk::Ptr<Shipment> &shipment)
 	}
 	else {
 		Segment::Ptr segment;
+		Connectivity::PtrConst conn = network_->connectivity();
 		try {
+			if (conn->routingMethod() == Connectivity::congestion()) {
+				segment = const_cast<Segment*>(conn->nextHop(notifier(), shipment).ptr());
+				if (segment) {
+					if (shipmentSplit(shipment, segment)) return;
+					// may throw exception
+					segment->arrivingShipmentIs(shipment);
+				}
+				else {
+					// DROP SHIPMENT
+					stats->droppedShipmentIs(shipment);
+					cerr << __FILE__":"<<__LINE__<<": LocationReactor::onShipmentArival() no route to " << destination.value() << endl;
+				}
+				return;
+			}
+
 			size_t thisLocationIndex = shipment->path()->locationIndex(notifier());
 			if (thisLocationIndex + 1 < shipment->path()->numParts()) {
 				Segment::PtrConst seg = shipment->path()->part(thisLocationIndex + 1).seg;
 				segment = const_cast<Segment*>(seg.ptr());
+				if (shipmentSplit(shipment, segment)) return;
 
 				// may throw exception
 				segment->arrivingShipmentIs(shipment);
@@ -216,28 +659,83 @@ Location::LocationReactor::onShipmentArrival(Fwk::Ptr<Shipment> &shipment)
 				cerr << __FILE__":"<<__LINE__<<": LocationReactor::onShipmentArival() next segment index out of bounds." << endl;
 			}
 		} catch(...) {
+			if (conn->waitPolicy() == Connectivity::waitQueue() && segment) {
+				// wait in line on the segment
+				segment->segmentReactor()->onWaitingShipment(shipment);
+				return;
+			}
 			// create retry activity
 			Activity::Ptr activity = activityManager_->activityNew("RetryActivity");
-			activity->lastNotifieeIs( new RetryActivityReactor(activityManager_, activity.ptr(), shipment.ptr(), segment.ptr(), network_) );
-			double wait = dynamic_cast<RetryActivityReactor*>(activity->notifiee().ptr())->wait();
+			RetryActivityReactor *retry = new RetryActivityReactor(activityManager_, activity.ptr(), shipment.ptr(), segment.ptr(), network_);
+			retry->locationIs(notifier());
+			activity->lastNotifieeIs(retry);
+			double wait = retry->wait();
 			activity->nextTimeIs(activityManager_->now().value() + wait);
 			activity->statusIs(Activity::nextTimeScheduled);
 		}
 	}
 }
 
+bool
+Location::LocationReactor::shipmentSplit(Fwk::Ptr<Shipment> &shipment, const Segment::Ptr &segment)
+{
+	if (network_->connectivity()->shipmentSplitting() != Connectivity::splittingEnabled()) return false;
+	if (!network_->fleet()) return false;
+
+	size_t perVehicle = network_->fleet()->capacity(segment->mode()).value();
+	size_t load = shipment->load().value();
+	if (perVehicle == 0 || load <= perVehicle) return false;
+
+	// each batch arrives here again and finds its own way out
+	for (size_t sent = 0; sent < load; sent += perVehicle) {
+		size_t batchLoad = (load - sent < perVehicle) ? load - sent : perVehicle;
+		Shipment::Ptr batch = network_->shipmentBatchNew(shipment, PackageCount(batchLoad));
+		notifier()->arrivingShipmentIs(batch);
+	}
+	return true;
+}
+
+RetryActivityReactor::RetryActivityReactor(Fwk::Ptr<Activity::Manager> manager,
+			Activity *activity, Shipment *shipment,
+			Segment *segment, Network *network):
+	Notifiee(activity),
+	network_(network),
+	successfullyForwardedShipment_(false),
+	totalTimeWaiting_(0.0),
+	since_(manager->now().value()),
+	wait_( (network->randomNew() % 10 + 1) / 10.0),
+	shipment_(shipment),
+	segment_(segment),
+	activity_(activity),
+	manager_(manager)
+	{}
+
 void RetryActivityReactor::onStatus() {
 	switch (activity_->status()) {
 		case Activity::executing:
 		{
+			INSTRUMENT_SCOPE(retryActivity);
 			//Retry forwarding the shipment
+			Connectivity::PtrConst conn = network_->connectivity();
+			if (location_ && conn && conn->routingMethod() == Connectivity::congestion()) {
+				Segment::PtrConst hop = conn->nextHop(location_, shipment_);
+				if (hop) segment_ = const_cast<Segment *>(hop.ptr());
+			}
 			try {
 				segment_->arrivingShipmentIs(shipment_);
 
 				// If we get to this line, we know this was successful
 				// otherwise we would throw an exception.
 				successfullyForwardedShipment_ = true;
+				Hours waited = Hours((float) (manager_->now().value() - since_));
+				shipment_->latencyInc(waited);
+				shipment_->waitInc(waited);
+				segment_->shipmentWaitIs(waited);
 			} catch(...) { /* we will reschedule ourselves */ }
+			if (network_->tracer()) {
+				network_->tracer()->retryIs(segment_.ptr(), shipment_.ptr(),
+					manager_->now().value(), successfullyForwardedShipment_);
+			}
 			break;
 		}
 	
@@ -274,6 +772,7 @@ void InjectActivityReactor::onStatus() {
     switch (activity_->status()) {
 	    case Activity::executing:
 	    {
+	    	INSTRUMENT_SCOPE(injectActivity);
 	    	Shipment::Ptr shipment = network_->shipmentNew(customer_, customer_->destination(), customer_->shipmentSize());
 			customer_->arrivingShipmentIs(shipment);
 			break;
@@ -299,7 +798,12 @@ void ForwardActivityReactor::onStatus() {
     switch (activity_->status()) {
 	    case Activity::executing:
 	    {
+	    	INSTRUMENT_SCOPE(forwardActivity);
+	    	if (segment_->tracer()) {
+	    		segment_->tracer()->transitIs(segment_.ptr(), shipment_.ptr(), departure_, manager_->now().value());
+	    	}
 	    	segment_->segmentLoadIs( PackageCount(segment_->segmentLoad().value() - shipment_->load().value()) );
+	    	segment_->segmentReactor()->onCapacityFreed();
 	    	Location::Ptr next = segment_->returnSegment()->source();
 	    	next->arrivingShipmentIs(shipment_);
 			break;
@@ -316,6 +820,78 @@ void ForwardActivityReactor::onStatus() {
     }
 }
 
+void TripActivityReactor::onStatus() {
+    switch (activity_->status()) {
+	    case Activity::executing:
+	    {
+	    	INSTRUMENT_SCOPE(tripActivity);
+	    	if (segment_->tracer()) {
+	    		segment_->tracer()->tripIs(segment_.ptr(), shipments_.size(), load_, departure_, manager_->now().value());
+	    	}
+	    	segment_->segmentLoadIs( PackageCount(segment_->segmentLoad().value() - load_.value()) );
+	    	segment_->vehiclesBusyIs( VehicleCount(segment_->vehiclesBusy().value() - vehicles_.value()) );
+	    	segment_->segmentReactor()->onCapacityFreed();
+	    	Location::Ptr next = segment_->returnSegment()->source();
+	    	for (size_t i = 0; i < shipments_.size(); ++i) {
+	    		next->arrivingShipmentIs(shipments_[i].shipment);
+	    	}
+	    	shipments_.clear();
+			break;
+		}
+	    case Activity::free:
+			break;
+
+	    case Activity::nextTimeScheduled:
+			//add myself to be scheduled
+			manager_->lastActivityIs(activity_);
+			break;
+
+	    default: break;
+    }
+}
+
+void WaitExpiryActivityReactor::onStatus() {
+    switch (activity_->status()) {
+	    case Activity::executing:
+	    {
+	    	INSTRUMENT_SCOPE(waitExpiryActivity);
+	    	segment_->segmentReactor()->onWaitExpiry();
+			break;
+		}
+
+	    case Activity::free:
+			break;
+
+	    case Activity::nextTimeScheduled:
+			//add myself to be scheduled
+			manager_->lastActivityIs(activity_);
+			break;
+
+	    default: break;
+    }
+}
+
+void TripTimeoutActivityReactor::onStatus() {
+    switch (activity_->status()) {
+	    case Activity::executing:
+	    {
+	    	INSTRUMENT_SCOPE(tripTimeoutActivity);
+	    	segment_->segmentReactor()->onTripTimeout(trip_);
+			break;
+		}
+
+	    case Activity::free:
+			break;
+
+	    case Activity::nextTimeScheduled:
+			//add myself to be scheduled
+			manager_->lastActivityIs(activity_);
+			break;
+
+	    default: break;
+    }
+}
+
 void FleetActivityReactor::onStatus() {
     switch (activity_->status()) {
 	    case Activity::executing:
@@ -347,6 +923,7 @@ void FleetActivityReactor::onStatus() {
 void
 Customer::transferRateIs(ShipmentCount tr){
 	transfer_rate_ = tr;
+	if (deferred(transferRateDeferred)) return;
 	// tell all the notifiees
 	if(notifiees()) {
 		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
@@ -361,6 +938,7 @@ Customer::transferRateIs(ShipmentCount tr){
 void
 Customer::shipmentSizeIs(PackageCount pc){
 	shipment_size_ = pc;
+	if (deferred(shipmentSizeDeferred)) return;
 	// tell all the notifiees
 	if(notifiees()) {
 		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
@@ -375,6 +953,7 @@ Customer::shipmentSizeIs(PackageCount pc){
 void
 Customer::destinationIs(Customer::Ptr c){
 	destination_ = c;
+	if (deferred(destinationDeferred)) return;
 
 	// tell all the notifiees
 	if(notifiees()) {
@@ -391,6 +970,25 @@ Customer::destinationIs(Customer::Ptr c){
 	}
 }
 
+bool
+Customer::deferred(Deferred change)
+{
+	if (!network_->batching()) return false;
+	if (!deferred_) network_->deferredCustomerIs(this);
+	deferred_ |= change;
+	return true;
+}
+
+void
+Customer::notifyDeferred()
+{
+	U8 deferred = deferred_;
+	deferred_ = 0;
+	if (deferred & transferRateDeferred) transferRateIs(transfer_rate_);
+	if (deferred & shipmentSizeDeferred) shipmentSizeIs(shipment_size_);
+	if (deferred & destinationDeferred) destinationIs(destination_);
+}
+
 void
 Customer::NotifieeConst::notifierIs(const Customer::PtrConst& _notifier) {
    Customer::Ptr notifierSave(const_cast<Customer *>(notifier_.ptr()));
@@ -493,7 +1091,7 @@ Path::locationIndex(const Location::PtrConst &location) const
 {
 	for (vector<Part>::const_iterator itr = path_.begin(); itr != path_.end(); ++itr) {
 		if (itr->type == segment()) continue;
-		if (itr->loc->name() == location->name())
+		if (itr->loc->symbol() == location->symbol())
 			return itr - path_.begin();
 	}
 	throw Fwk::RangeException("value=range()");
@@ -502,7 +1100,7 @@ Path::locationIndex(const Location::PtrConst &location) const
 Path::Membership
 Path::locationMembershipStatus(const Location::PtrConst &location) const
 {
-	if(usedLocations_.find(location->name()) != usedLocations_.end())  {
+	if(usedLocations_.find(location->symbol()) != usedLocations_.end())  {
 		return Path::isMember();
 	}
 	return Path::notMember();
@@ -531,7 +1129,7 @@ Path::endLocationIs(const Location::PtrConst &newEnd)
 			}
 		}
 		path_.push_back(Part(endLocation_));
-		usedLocations_.insert(endLocation_->name());
+		usedLocations_.insert(endLocation_->symbol());
 		numLocationsIs(numLocations() + 1);
 	}
 }
@@ -617,20 +1215,77 @@ Path::stringValue() const
 	return output.str();
 }
 
-Shipment::Shipment(Customer::Ptr s, Customer::Ptr d, PackageCount p, Network *network): 
-	Fwk::NamedInterface(Shipment::shipmentName(s, d)),
+Fwk::Arena &
+Shipment::arena()
+{
+	// never destroyed: see the comment in Engine.h
+	static Fwk::Arena *arena = new Fwk::Arena();
+	return *arena;
+}
+
+size_t Shipment::networks_ = 0;
+
+void
+Shipment::networksInc(int n)
+{
+	networks_ += n;
+	if (!networks_) arena().slabsDel();
+}
+
+Shipment::Shipment(const Customer::Ptr &s, const Customer::Ptr &d, PackageCount p, Network *network): 
+	id_(network->shipmentIdNew()),
 	network_(network),
 	src_(s),
 	dest_(d),
-	load_(p)
+	load_(p),
+	priority_(s->shipmentPriority())
 	{
-		path_ = network_->connectivity()->shipmentPath(name());
+		path_ = network_->connectivity()->shipmentPath(s, d);
 		if (!path_) {
 			cerr <<__FILE__<<":"<<__LINE__<< ": ShipmentShipment() path not possible" << endl;
 			throw Fwk::EntityNotFoundException("shipment path does not exist");
 		}
+		packages_outstanding_ = load_;
+		dropped_ = false;
+	}
+
+Shipment::Shipment(const Shipment::Ptr &shipment, PackageCount p):
+	id_(shipment->network_->shipmentIdNew()),
+	network_(shipment->network_),
+	src_(shipment->src_),
+	dest_(shipment->dest_),
+	path_(shipment->path_),
+	latency_(shipment->latency_),
+	wait_(shipment->wait_),
+	load_(p),
+	packages_outstanding_(p),
+	priority_(shipment->priority_),
+	dropped_(false)
+	{
+		// batches always hang off the original shipment; a batch that is
+		// split again hands the cost it has run up to that shipment
+		if (shipment->parent_) {
+			parent_ = shipment->parent_;
+			parent_->costInc(shipment->cost());
+		}
+		else parent_ = shipment;
 	}
 
+string
+Shipment::name() const
+{
+	return src_->name() + ":" + dest_->name();
+}
+
+void
+Shipment::batchArrivalIs(const Shipment::Ptr &batch)
+{
+	packages_outstanding_ = PackageCount(packages_outstanding_.value() - batch->load().value());
+	if (batch->latency() > latency_) latency_ = batch->latency();
+	if (batch->wait() > wait_) wait_ = batch->wait();
+	costInc(batch->cost());
+}
+
 void
 Connectivity::constraintsActiveDel()
 {
@@ -672,7 +1327,7 @@ Connectivity::constraintsActiveIs(int mask)
 void
 queueOrStore(Path::Ptr path, const Location::PtrConst &end, queue<Path::Ptr> &pathQueue, vector<Path::Ptr> &expeditedPaths, vector<Path::Ptr> &notExpeditedPaths)
 {
-	if (path->end()->name() == end->name()) {
+	if (path->end()->symbol() == end->symbol()) {
 		if (path->expedited() == Segment::expediteSupported()) {
 			expeditedPaths.push_back(path);
 		}
@@ -693,7 +1348,7 @@ copyPath(Path::Ptr original, Fleet::PtrConst fleet, const Location::PtrConst &ne
 }
 
 bool
-Connectivity::isValidExplorePath(Path::Ptr path) const
+Connectivity::isValidExplorePath(const Path::Ptr &path) const
 {
 	int constraints = constraintsActive();
 	bool validPath = true;
@@ -726,9 +1381,9 @@ Connectivity::isValidExplorePath(Path::Ptr path) const
 }
 
 bool
-Connectivity::isValidExplorePathNotExpedited(Path::Ptr one, Path::Ptr two) const
+Connectivity::isValidExplorePathNotExpedited(const Path::Ptr &one, const Path::Ptr &two) const
 {
-	one->expeditedIs(Segment::expediteNotSupported());
+	one.ptr()->expeditedIs(Segment::expediteNotSupported());
 	if (isValidExplorePath(one)) {
 		*(two.ptr()) = *(one.ptr());
 		return true;
@@ -788,7 +1443,7 @@ Connectivity::paths(SearchPattern pattern) const
 			else if (pattern == Connectivity::connect()) {
 				if (curr->locationMembershipStatus(nextLocation) == Path::notMember()) {
 					Path::Ptr copy = copyPath(curr, fleet(), nextLocation, nextSegment);
-					if (copy->end()->name() == constraintEnd()->name()) {
+					if (copy->end()->symbol() == constraintEnd()->symbol()) {
 						if (copy->expedited() == Segment::expediteSupported()) {
 							expeditedPaths.push_back(copy);
 						}
@@ -885,7 +1540,7 @@ Path::Ptr Connectivity::BFSShortestPath(Location::PtrConst &startLoc, Location::
 
 			if (curr->locationMembershipStatus(nextLocation) == Path::notMember()) {
 				Path::Ptr copy = copyPath(curr, fleet(), nextLocation, nextSegment);
-				if (copy->end()->name() == endLoc->name()) {
+				if (copy->end()->symbol() == endLoc->symbol()) {
 					return copy;
 				}
 				//don't push onto the queue if it's a customer
@@ -923,7 +1578,7 @@ Path::Ptr Connectivity::DijkstraShortestPath(Location::PtrConst &startLoc, Locat
 
 			if (curr->locationMembershipStatus(nextLocation) == Path::notMember()) {
 				Path::Ptr copy = copyPath(curr, fleet(), nextLocation, nextSegment);
-				if (copy->end()->name() == endLoc->name()) {
+				if (copy->end()->symbol() == endLoc->symbol()) {
 					if (!minimumCostPath) minimumCostPath = copy;
 					else if (copy->cost() < minimumCostPath->cost()) minimumCostPath = copy;
 				}
@@ -935,45 +1590,179 @@ Path::Ptr Connectivity::DijkstraShortestPath(Location::PtrConst &startLoc, Locat
 	return minimumCostPath;
 }
 
-map<string, Path::Ptr> Connectivity::routes(RoutingMethod rm){
-	map<string, Path::Ptr> routeMap;
-	vector<Location::PtrConst> locs = network_->locations();
+// weight of a segment's load ratio against its cost to go; at 1.0 a full
+// segment looks twice as expensive as an idle one
+static const float congestionWeight = 1.0f;
 
-	for(size_t i = 0; i < locs.size(); i++){
-		for(size_t j = 0; j < locs.size(); j++){
-			if (i == j) continue;
-			if (locs[i]->locationType() != Location::customer()) continue;
-			if (locs[j]->locationType() != Location::customer()) continue;
+Segment::PtrConst
+Connectivity::nextHop(const Location::PtrConst &location, const Shipment::PtrConst &shipment) const
+{
+	const NextHopTable &table = nextHopTable(shipment->dest());
+	map<Fwk::Symbol, HopList>::const_iterator found = table.hops.find(location->symbol());
+	if (found == table.hops.end() || found->second.empty()) return Segment::PtrConst();
+
+	const HopList &hops = found->second;
+	Segment::PtrConst best;
+	float bestScore = 0.f;
+	for (HopList::const_iterator it = hops.begin(); it != hops.end(); ++it) {
+		float capacity = (float) it->seg->capacity().value();
+		float load = (float) (it->seg->segmentLoad().value() + shipment->load().value());
+		if (capacity <= 0.f || load > capacity) continue;
+
+		float score = it->costToGo * (1.f + congestionWeight * load / capacity);
+		if (!best || score < bestScore) {
+			best = it->seg;
+			bestScore = score;
+		}
+	}
+	// everything is saturated: wait on the cheapest segment
+	if (!best) best = hops.front().seg;
+	return best;
+}
 
-			Path::Ptr shortPath;
-			
+const Connectivity::NextHopTable &
+Connectivity::nextHopTable(const Customer::PtrConst &destination) const
+{
+	NextHopTable &table = nextHops_[destination->symbol()];
+	if (table.version != network_->topologyVersion()) {
+		nextHopTableIs(destination, table);
+	}
+	return table;
+}
 
-			if (rm == dijkstra()) shortPath = DijkstraShortestPath(locs[i], locs[j]);
-//			if (shortPath) cout<<__FILE__<<": Dijkstra "<< shortPath->stringValue();
-			else if (rm == bfs()){ shortPath = BFSShortestPath(locs[i], locs[j]);
-//				if(shortPath) cout<<__FILE__<<": BFS: "<< shortPath->stringValue();
-			}
+class HopCostComp {
+public:
+	HopCostComp() {}
 
-			//cout<<__FILE__<<": BFS: "<< BFSShortestPath(locs[i], locs[j])->stringValue();
+	bool operator()(const pair<float, Location::PtrConst> &a, const pair<float, Location::PtrConst> &b) const {
+		return (a.first > b.first);
+	}
+};
+
+static bool
+hopCostLess(const Connectivity::Hop &a, const Connectivity::Hop &b)
+{
+	return a.costToGo < b.costToGo;
+}
 
-			if (shortPath){
-				stringstream key;
-				key << locs[i]->name() << ":" << locs[j]->name(); 
-				routeMap[key.str()] = shortPath;
+void
+Connectivity::nextHopTableIs(const Customer::PtrConst &destination, NextHopTable &table) const
+{
+	INSTRUMENT_SCOPE(nextHopTable);
+	typedef Location::SegmentIteratorConst SegmentIteratorConst;
+	typedef pair<float, Location::PtrConst> QueueEntry;
+
+	// Dijkstra backwards from the destination: a location's incoming
+	// segments are the return segments of its own outgoing ones. Customers
+	// other than the destination never relay shipments.
+	map<Fwk::Symbol, float> distance;
+	priority_queue<QueueEntry, vector<QueueEntry>, HopCostComp> pending;
+	distance[destination->symbol()] = 0.f;
+	pending.push(QueueEntry(0.f, destination.ptr()));
+
+	while (!pending.empty()) {
+		QueueEntry curr = pending.top();
+		pending.pop();
+		if (curr.first > distance[curr.second->symbol()]) continue;
+		if (curr.second->locationType() == Location::customer()
+			&& curr.second->symbol() != destination->symbol()) continue;
+
+		SegmentIteratorConst
+			beginSeg = curr.second->segmentsIteratorConstBegin(),
+			endSeg = curr.second->segmentsIteratorConstEnd();
+		for (SegmentIteratorConst it = beginSeg; it != endSeg; ++it) {
+			Segment::PtrConst incoming = (*it)->returnSegment();
+			if (!incoming || !incoming->source()) continue;
+			Location::PtrConst prev = incoming->source();
+			float d = curr.first + incoming->length().value();
+			map<Fwk::Symbol, float>::iterator known = distance.find(prev->symbol());
+			if (known == distance.end() || d < known->second) {
+				distance[prev->symbol()] = d;
+				pending.push(QueueEntry(d, prev));
 			}
 		}
 	}
+
+	// keep only downhill segments so a rerouted shipment cannot loop
+	table.hops.clear();
+	for (map<Fwk::Symbol, float>::const_iterator loc = distance.begin(); loc != distance.end(); ++loc) {
+		Location::PtrConst location = network_->location(loc->first.value());
+		HopList hops;
+		SegmentIteratorConst
+			beginSeg = location->segmentsIteratorConstBegin(),
+			endSeg = location->segmentsIteratorConstEnd();
+		for (SegmentIteratorConst it = beginSeg; it != endSeg; ++it) {
+			if (!(*it)->returnSegment()) continue;
+			Location::PtrConst next = (*it)->returnSegment()->source();
+			if (!next) continue;
+			map<Fwk::Symbol, float>::const_iterator known = distance.find(next->symbol());
+			if (known == distance.end() || known->second >= loc->second) continue;
+			if (next->locationType() == Location::customer()
+				&& next->symbol() != destination->symbol()) continue;
+			hops.push_back(Hop(*it, (*it)->length().value() + known->second));
+		}
+		if (hops.empty()) continue;
+		sort(hops.begin(), hops.end(), hopCostLess);
+		table.hops[loc->first] = hops;
+	}
+	table.version = network_->topologyVersion();
+}
+
+void
+Connectivity::simulationStatusIs(SimulationStatus s)
+{
+	if(simulationStatus() == off() && s == running()) { //simulation is starting
+		cout << "Preprocessing Network......" << endl;
+		if (!routes_installed_ || routes_version_ != network_->topologyVersion()) {
+			routes_dijkstra_ = routes(dijkstra());
+			routes_bfs_ = routes(bfs());
+			routes_version_ = network_->topologyVersion();
+		}
+		routes_installed_ = false;
+	}
+	simulation_status_ = s;
+}
+
+void
+Connectivity::precomputedRoutesIs(const RouteMap &dijkstraRoutes, const RouteMap &bfsRoutes)
+{
+	routes_dijkstra_ = dijkstraRoutes;
+	routes_bfs_ = bfsRoutes;
+	routes_version_ = network_->topologyVersion();
+	routes_installed_ = true;
+}
+
+Connectivity::RouteMap Connectivity::routes(RoutingMethod rm){
+	INSTRUMENT_SCOPE(routePrecompute);
+	RouteMap routeMap;
+
+	// only customers ship, so only pairs of customers need routes
+	for (Network::CustomerIterator src = network_->customerIter(); src.ptr(); ++src) {
+		Location::PtrConst srcLoc = src.ptr();
+		for (Network::CustomerIterator dest = network_->customerIter(); dest.ptr(); ++dest) {
+			if (src.ptr() == dest.ptr()) continue;
+
+			Location::PtrConst destLoc = dest.ptr();
+			Path::Ptr shortPath;
+			if (rm == dijkstra()) shortPath = DijkstraShortestPath(srcLoc, destLoc);
+			else if (rm == bfs()) shortPath = BFSShortestPath(srcLoc, destLoc);
+
+			if (shortPath) routeMap[RouteKey(src->id(), dest->id())] = shortPath;
+		}
+	}
 	return routeMap;
 }
 
+Network::~Network()
+{
+	// shipments this network's members still hold go after this; the
+	// arena's slabs follow the last of them if no other network is left
+	Shipment::networksInc(-1);
+}
+
 Location::Ptr
 Network::location(const Fwk::String &name) {
-	map<Fwk::String, Location::Ptr>::iterator found = locations_.find(name);
-	if(found == locations_.end()) {
-		return Location::Ptr();
-	}
-	
-	return found->second;
+	return locations_.member(name);
 }
 
 void
@@ -1010,8 +1799,9 @@ Network::segmentNew(Fwk::String name, Segment::Mode mode)
 		seg = Segment::SegmentNew(name, mode, this);
 		segmentIs(name, seg);
 	}
+	if (batching_) batch_.segments.push_back(seg);
 	// tell all the notifiees
-	if(notifiees()) {
+	else if(notifiees()) {
 		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
 			try { n->onSegmentNew(seg); }
 			catch(...) { cerr << "Network::segmentNew() notification for " << name << " unsuccessful" << endl; }
@@ -1025,10 +1815,16 @@ Network::segmentDel(Fwk::String name)
 {
 	// try to retrieve
 	Segment::Ptr seg = segment(name);
-	size_t n = segments_.erase(name);
+	size_t n = segments_.memberDel(name);
 	if(n == 0) return 0;
 
 	seg->sourceIs(Location::Ptr());
+	// its counters leave the network-wide totals with it
+	if (statistics_) {
+		statistics_->segmentShipmentsReceivedInc(-seg->numShipmentsReceived().value());
+		statistics_->segmentShipmentsToldToWaitInc(-seg->numShipmentsToldToWait().value());
+		statistics_->segmentShipmentsRefusedInc(-seg->numShipmentsRefused().value());
+	}
 
 	// tell all the notifiees
 	if(notifiees()) {
@@ -1074,10 +1870,13 @@ Network::customerNew(Fwk::String name)
 	// if not then create it and add to network
 	else {
 		customer = Customer::CustomerNew(name, this);
+		customer->idIs(customerIds_++);
+		customers_.push_back(customer.ptr());
 		locationIs(name, customer);
 	}
+	if (batching_) batch_.customers.push_back(customer);
 	// tell all the notifiees
-	if(notifiees()) {
+	else if(notifiees()) {
 		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
 			//Customer::Ptr cust = dynamic_cast<Customer *>(customer.ptr());
 			try { n->onCustomerNew(customer); }
@@ -1092,13 +1891,14 @@ Network::customerDel(Fwk::String name)
 {
 	// try to retrieve
 	Location::Ptr customer = location(name);
-	size_t n = locations_.erase(name);
+	size_t n = locations_.memberDel(name);
 	if(n == 0) return 0;
 
 	locationSegmentsDel(customer);
 	
 	// tell all the notifiees
 	Customer::Ptr cust = dynamic_cast<Customer *>(customer.ptr());
+	if (cust) customers_[cust->id()] = 0;
 	if(notifiees()) {
 		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
 			try { n->onCustomerDel(cust); }
@@ -1122,8 +1922,9 @@ Network::portNew(Fwk::String name)
 		port = Port::PortNew(name, this);
 		locationIs(name, port);
 	}
+	if (batching_) batch_.ports.push_back(dynamic_cast<Port *>(port.ptr()));
 	// tell all the notifiees
-	if(notifiees()) {
+	else if(notifiees()) {
 		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
 			Port::Ptr prt = dynamic_cast<Port *>(port.ptr());
 			try { n->onPortNew(prt); }
@@ -1138,7 +1939,7 @@ Network::portDel(Fwk::String name)
 {
 	// try to retrieve
 	Location::Ptr port = location(name);
-	size_t n = locations_.erase(name);
+	size_t n = locations_.memberDel(name);
 	if(n == 0) return 0;
 
 	locationSegmentsDel(port);
@@ -1168,8 +1969,9 @@ Network::terminalNew(Fwk::String name, Segment::Mode vehicle_type)
 		terminal = Terminal::TerminalNew(name, vehicle_type, this);
 		locationIs(name, terminal);
 	}
+	if (batching_) batch_.terminals.push_back(dynamic_cast<Terminal *>(terminal.ptr()));
 	// tell all the notifiees
-	if(notifiees()) {
+	else if(notifiees()) {
 		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
 			Terminal::Ptr term = dynamic_cast<Terminal *>(terminal.ptr());
 			try { n->onTerminalNew(term); }
@@ -1184,7 +1986,7 @@ Network::terminalDel(Fwk::String name)
 {
 	// try to retrieve
 	Location::Ptr terminal = location(name);
-	size_t n = locations_.erase(name);
+	size_t n = locations_.memberDel(name);
 	if(n == 0) return 0;
 
 	locationSegmentsDel(terminal);
@@ -1277,7 +2079,14 @@ Network::connectivityDel(Fwk::String name)
 	return conn;
 }
 Shipment::Ptr
-Network::shipmentNew(Customer::Ptr s, Customer::Ptr d, PackageCount p)
+Network::shipmentBatchNew(const Shipment::Ptr &shipment, PackageCount p)
+{
+	// batches are not new shipments as far as the notifiees are concerned
+	return Shipment::BatchNew(shipment, p);
+}
+
+Shipment::Ptr
+Network::shipmentNew(const Customer::Ptr &s, const Customer::Ptr &d, PackageCount p)
 {
 	Shipment::Ptr shipment = Shipment::ShipmentNew(s, d, p, this);
 	// tell all the notifiees
@@ -1290,6 +2099,39 @@ Network::shipmentNew(Customer::Ptr s, Customer::Ptr d, PackageCount p)
 	return shipment;	
 }
 
+void
+Network::batchingIs(bool b)
+{
+	if (b == batching_) return;
+	batching_ = b;
+	if (b) return;
+	Batch batch;
+	batch.segments.swap(batch_.segments);
+	batch.customers.swap(batch_.customers);
+	batch.ports.swap(batch_.ports);
+	batch.terminals.swap(batch_.terminals);
+	// tell all the notifiees
+	if(notifiees()) {
+		for(NotifieeIterator n=notifieeIter(); n.ptr(); ++n) {
+			try { n->onBatchNew(batch); }
+			catch(...) { cerr << "Network::batchingIs() notification unsuccessful" << endl; }
+		}
+	}
+	// then the changes customers held back, now that they are all known
+	vector<Customer::Ptr> customers;
+	customers.swap(deferredCustomers_);
+	for (size_t i = 0; i < customers.size(); i++) customers[i]->notifyDeferred();
+}
+
+void
+Network::NotifieeConst::onBatchNew(const Network::Batch &batch)
+{
+	for (size_t i = 0; i < batch.segments.size(); i++) onSegmentNew(batch.segments[i]);
+	for (size_t i = 0; i < batch.customers.size(); i++) onCustomerNew(batch.customers[i]);
+	for (size_t i = 0; i < batch.ports.size(); i++) onPortNew(batch.ports[i]);
+	for (size_t i = 0; i < batch.terminals.size(); i++) onTerminalNew(batch.terminals[i]);
+}
+
 void
 Network::NotifieeConst::notifierIs(const Network::PtrConst& _notifier) {
    Network::Ptr notifierSave(const_cast<Network *>(notifier_.ptr()));
@@ -1325,6 +2167,41 @@ Statistics::simulationShipmentStats() const
     return output.str();
 }
 
+void
+Statistics::shipmentAveragesIs(ostream &output) const
+{
+	output
+	<< "AvgReceived=" << avgShipmentsReceived() << " "
+	<< "AvgToldToWait=" << avgShipmentsToldToWait() << " "
+	<< "AvgRefused=" << avgShipmentsRefused() << " "
+	<< endl;
+}
+
+void
+Statistics::latencyIs(ostream &output) const
+{
+    output << "'all' : " << latency().stringValue() << endl;
+    output << "'wait' : " << wait().stringValue() << endl;
+    for (size_t i = 0; i < Priority::classes; i++) {
+    	Priority::Class c = (Priority::Class) i;
+    	if (!latency(c).count()) continue;
+    	output << "'" << Priority::className(c) << "' : " << latency(c).stringValue() << endl;
+    }
+}
+
+string
+Statistics::simulationSummary() const
+{
+	stringstream output;
+	output << simulationShipmentStats() << endl;
+	output << " --- Shipment Averages --- " << endl;
+	shipmentAveragesIs(output);
+	output << endl;
+	output << " --- Latency --- " << endl;
+	latencyIs(output);
+	return output.str();
+}
+
 string
 Statistics::simulationStatisticsOutput() const
 {
@@ -1352,29 +2229,18 @@ Statistics::simulationStatisticsOutput() const
     output << endl;
 
     output << " --- Shipment Averages --- " << endl;
-    Network::Ptr network = network_;
-    vector<Segment::PtrConst> segments = network->segments();
-	size_t numReceived = 0, numWait = 0, numRefused = 0;
-    for (size_t i = 0; i < segments.size(); i++) {
-    	Segment::PtrConst segment = dynamic_cast<Segment const*>(segments[i].ptr());
-    	numReceived += segment->numShipmentsReceived().value();
-    	numWait += segment->numShipmentsToldToWait().value();
-    	numRefused += segment->numShipmentsRefused().value();
-    }
-
-	output
-	<< "AvgReceived=" << (float) numReceived / (float) segments.size() << " "
-	<< "AvgToldToWait=" << (float) numWait / (float) segments.size() << " "
-	<< "AvgRefused=" << (float) numRefused / (float) segments.size() << " "
-	<< endl << endl << endl;
+    shipmentAveragesIs(output);
+    output << endl << endl;
 
     output << " --- Customers --- " << endl;
-    vector<Location::PtrConst> locations = network->locations();
+    Network::Ptr network = network_;
+    const vector<Network::Handle> &locations = network->locationHandlesByName();
     for (size_t i = 0; i < locations.size(); i++) {
-    	if (locations[i]->locationType() != Location::customer()) {
+    	Location *location = network->locationAt(locations[i]).ptr();
+    	if (location->locationType() != Location::customer()) {
     		continue;
     	}
-    	Customer::PtrConst customer = dynamic_cast<Customer const*>(locations[i].ptr());
+    	Customer const *customer = static_cast<Customer const*>(location);
     	//output << "# Shipments enroute   : " << numShipments(Statistics::enroute()) << endl;
     	output << "'" << customer->name() << "'->'";
     	if (customer->destination()) output << customer->destination()->name() << "' : ";
@@ -1386,10 +2252,15 @@ Statistics::simulationStatisticsOutput() const
     }
     output << endl << endl;
 
+    output << " --- Latency --- " << endl;
+    latencyIs(output);
+    output << endl << endl;
+
     output << " --- Segments --- " << endl;
+    const vector<Network::Handle> &segments = network->segmentHandlesByName();
 
     for (size_t i = 0; i < segments.size(); i++) {
-    	Segment::PtrConst segment = dynamic_cast<Segment const*>(segments[i].ptr());
+    	Segment const *segment = network->segmentAt(segments[i]).ptr();
 
     	output << segment->name() << " : "
     	<< "Received=" << segment->numShipmentsReceived().value() << " "
@@ -1408,6 +2279,21 @@ Statistics::onSegmentNew(Segment::Ptr segment)
 	numSegmentsIs(type, numSegments(type) + 1);
 }
 
+void
+Statistics::onBatchNew(const Network::Batch &batch)
+{
+	for (size_t i = 0; i < batch.segments.size(); i++) {
+		Segment::Mode type = batch.segments[i]->mode();
+		numSegments_[type]++;
+	}
+	for (size_t i = 0; i < batch.terminals.size(); i++) {
+		Segment::Mode type = batch.terminals[i]->vehicleType();
+		numTerminals_[type]++;
+	}
+	numCustomersIs(numCustomers() + batch.customers.size());
+	numPortsIs(numPorts() + batch.ports.size());
+}
+
 void
 Statistics::onCustomerNew(Customer::Ptr customer)
 {
@@ -1456,38 +2342,76 @@ Statistics::onTerminalDel(Terminal::Ptr terminal)
 }
 
 void
-Statistics::deliveredShipmentIs(Shipment::Ptr shipment)
+Statistics::deliveredShipmentIs(const Shipment::Ptr &shipment)
 {
-	map<string, ShippingRecord>::iterator found = shipmentRecords_.find(shipment->name());
-	found->second.numEnRouteInc(-1);
-	found->second.numDeliveredInc();
+	ShippingRecord &record = shippingRecord(shipment);
+	record.numEnRouteInc(-1);
+	record.numDeliveredInc();
+	latency_all_.valueIs(shipment->latency().value());
+	latency_[shipment->priority()].valueIs(shipment->latency().value());
+	wait_.valueIs(shipment->wait().value());
 	numShipmentsIs(Statistics::enroute(), numShipments(Statistics::enroute()) - 1);	
 	numShipmentsIs(Statistics::delivered(), numShipments(Statistics::delivered()) + 1);
+	if (network_->tracer()) {
+		network_->tracer()->deliveredIs(shipment.ptr(), activityManagerInstance(network_)->now().value());
+	}
 }
 
 void
-Statistics::droppedShipmentIs(Shipment::Ptr shipment)
+Statistics::droppedShipmentIs(const Shipment::Ptr &shipment)
 {
-	map<string, ShippingRecord>::iterator found = shipmentRecords_.find(shipment->name());
-	found->second.numEnRouteInc(-1);
-	found->second.numDroppedInc();
+	// losing any batch loses the shipment it was split from, once
+	if (shipment->parent()) {
+		droppedShipmentIs(shipment->parent());
+		return;
+	}
+	if (shipment->dropped()) return;
+	shipment.ptr()->droppedIs(true);
+
+	ShippingRecord &record = shippingRecord(shipment);
+	record.numEnRouteInc(-1);
+	record.numDroppedInc();
 	numShipmentsIs(Statistics::enroute(), numShipments(Statistics::enroute()) - 1);	
 	numShipmentsIs(Statistics::dropped(), numShipments(Statistics::dropped()) + 1);
+	if (network_->tracer()) {
+		network_->tracer()->droppedIs(shipment.ptr(), activityManagerInstance(network_)->now().value());
+	}
 }
 
 void
-Statistics::onShipmentNew(Shipment::Ptr shipment)
+Statistics::onShipmentNew(const Shipment::Ptr &shipment)
 {
-	numShipments_[Statistics::enroute()]++;
-	map<string, ShippingRecord>::iterator found = shipmentRecords_.find(shipment->name());
-	if (found == shipmentRecords_.end()) {
-		ShippingRecord record;
-		record.numEnRouteInc();
-		shipmentRecords_[shipment->name()] = record;
-	}
-	else {
-		found->second.numEnRouteInc();
-	}
+	numShipments_.count[Statistics::enroute()].valueInc();
+	shippingRecord(shipment).numEnRouteInc();
+}
+
+Statistics::ShippingRecord &
+Statistics::shippingRecord(const Shipment::Ptr &shipment)
+{
+	U32 src = shipment->source()->id();
+	U32 dest = shipment->dest()->id();
+	if (src >= shipmentRecords_.size()) shipmentRecords_.resize(network_->customerIds());
+	vector<ShippingRecord> &row = shipmentRecords_[src];
+	if (dest >= row.size()) row.resize(network_->customerIds());
+	return row[dest];
+}
+
+Statistics::ShippingRecord
+Statistics::shippingRecord(const Customer::PtrConst &src, const Customer::PtrConst &dest) const
+{
+	if (src->id() >= shipmentRecords_.size()) return ShippingRecord();
+	const vector<ShippingRecord> &row = shipmentRecords_[src->id()];
+	if (dest->id() >= row.size()) return ShippingRecord();
+	return row[dest->id()];
+}
+
+void
+Statistics::shippingRecordIs(const Customer::PtrConst &src, const Customer::PtrConst &dest, const ShippingRecord &record)
+{
+	if (src->id() >= shipmentRecords_.size()) shipmentRecords_.resize(network_->customerIds());
+	vector<ShippingRecord> &row = shipmentRecords_[src->id()];
+	if (dest->id() >= row.size()) row.resize(network_->customerIds());
+	row[dest->id()] = record;
 }
 
 void
@@ -5,20 +5,26 @@
 #include "fwk/BaseNotifiee.h"
 #include "fwk/NamedInterface.h"
 #include "fwk/HashMap.h"
+#include "fwk/Registry.h"
 #include "fwk/ListRaw.h"
 #include "fwk/LinkedList.h"
 #include "fwk/LinkedQueue.h"
 #include "fwk/Array.h"
+#include "fwk/Atomic.h"
+#include "fwk/Arena.h"
 #include "fwk/String.h"
 #include "Instance.h"
 #include "Nominal.h"
 #include "ActivityImpl.h"
+#include "Histogram.h"
 #include <string>
 #include <sstream>
 #include <vector>
 #include <map>
 #include <set>
 #include <queue>
+#include <deque>
+#include <algorithm>
 #include <typeinfo>
 
 namespace Shipping {
@@ -166,9 +172,100 @@ public:
 	}
 };
 
+// Shipment priority classes. Segments serve waiting shipments by class;
+// the weights apply under weighted fair admission.
+class Priority {
+public:
+	enum Class {
+		standard_ = 0,
+		expedited_,
+		highValue_
+	};
+	static const size_t classes = 3;
+
+	static inline Class standard() { return standard_; }
+	static inline Class expedited() { return expedited_; }
+	static inline Class highValue() { return highValue_; }
+
+	static unsigned weight(Class c) {
+		switch(c) {
+			case expedited_: return 2;
+			case highValue_: return 4;
+			default: return 1;
+		}
+	}
+	static string className(Class c) {
+		switch(c) {
+			case standard_: return "standard";
+			case expedited_: return "expedited";
+			case highValue_: return "high value";
+			default: return "";
+		}
+	}
+};
+
 class Shipment; // forward declared
 class Location; // forward declared
 class Network; // forward declared
+class Statistics; // forward declared
+class Tracer; // forward declared
+class Checkpoint; // forward declared
+
+// The per-segment state that admission, forwarding and the statistics read
+// on every hop (mode, vehicles, load, busy vehicles and the shipment
+// counters), kept column by column rather than in the segment objects, so
+// that a pass over many segments reads only the columns it needs from
+// contiguous memory. A network keeps one table and each of its segments
+// owns a row, which is reused once the segment is gone; Segment's
+// accessors read and write the row.
+class SegmentTable : public Fwk::PtrInterface<SegmentTable> {
+public:
+	typedef Fwk::Ptr<SegmentTable> Ptr;
+	typedef Fwk::Ptr<SegmentTable const> PtrConst;
+	typedef U32 Row;
+
+	// one more than the largest row in use
+	Row rows() const { return mode_.size(); }
+	U32 rowsUsed() const { return rowsUsed_; }
+	Row rowNew();
+	void rowDel(Row r);
+
+	U8 mode(Row r) const { return mode_[r]; }
+	void modeIs(Row r, U8 m) { mode_[r] = m; }
+	U32 vehicles(Row r) const { return vehicles_[r]; }
+	void vehiclesIs(Row r, U32 v) { vehicles_[r] = v; }
+	U32 load(Row r) const { return load_[r]; }
+	void loadIs(Row r, U32 l) { load_[r] = l; }
+	U32 vehiclesBusy(Row r) const { return vehiclesBusy_[r]; }
+	void vehiclesBusyIs(Row r, U32 v) { vehiclesBusy_[r] = v; }
+	U64 received(Row r) const { return received_[r]; }
+	void receivedIs(Row r, U64 n) { received_[r] = n; }
+	U64 refused(Row r) const { return refused_[r]; }
+	void refusedIs(Row r, U64 n) { refused_[r] = n; }
+	U64 toldToWait(Row r) const { return toldToWait_[r]; }
+	void toldToWaitIs(Row r, U64 n) { toldToWait_[r] = n; }
+
+	static SegmentTable::Ptr SegmentTableNew() {
+		Ptr m = new SegmentTable();
+		m->referencesDec(1);
+		// decr. refer count to compensate for initial val of 1
+		return m;
+	}
+
+protected:
+	SegmentTable(): rowsUsed_(0) {}
+
+	vector<U8> mode_;
+	vector<U32> vehicles_;
+	vector<U32> load_;
+	vector<U32> vehiclesBusy_;
+	vector<U64> received_;
+	vector<U64> refused_;
+	vector<U64> toldToWait_;
+	// rows given back, to be handed out again
+	vector<Row> free_;
+	U32 rowsUsed_;
+};
 class Segment : public Fwk::NamedInterface {
 public:
 	typedef Fwk::Ptr<Segment> Ptr;
@@ -191,19 +288,17 @@ public:
 	static inline ExpediteSupport expediteSupported() { return supported_; }
 	static inline ExpediteSupport expediteNotSupported() { return notSupported_; }
 
-	Mode mode() const { return mode_; }
+	Mode mode() const { return (Mode) table_->mode(row_); }
 	static string modeName(Mode m);
 	void modeIs(Mode m) {
-		mode_ = m;
+		table_->modeIs(row_, m);
 	}
 
 	Fwk::Ptr<Location> source() const { return source_; }
 	void sourceIs(Fwk::Ptr<Location> s);
 
 	Mile length() const { return length_; }
-	void lengthIs(Mile l) {
-		length_ = l;
-	}
+	void lengthIs(Mile l);
 
 	Segment::Ptr returnSegment() const { return return_segment_; }
 	void returnSegmentIs(Segment::Ptr &r);
@@ -218,26 +313,113 @@ public:
 		exp_support_ = es;
 	}
 
+	// refuses (throws) unless the shipment fits and nobody is queued ahead of it
 	void arrivingShipmentIs(Fwk::Ptr<Shipment> &shipment);
+	// takes the shipment on and notifies; callers check admits() first
+	void admit(Fwk::Ptr<Shipment> &shipment);
 
-	VehicleCount numVehicles() const { return numVehicles_; }
+	VehicleCount numVehicles() const { return VehicleCount(table_->vehicles(row_)); }
 	void numVehiclesIs(VehicleCount vc){
-		numVehicles_ = vc;
+		table_->vehiclesIs(row_, vc.value());
 	}
 
-	PackageCount segmentLoad() const { return segmentLoad_; }
+	// the segment's row in its network's SegmentTable
+	SegmentTable::Row tableRow() const { return row_; }
+
+	PackageCount segmentLoad() const { return PackageCount(table_->load(row_)); }
 	void segmentLoadIs(PackageCount pc){
-		segmentLoad_ = pc;
+		table_->loadIs(row_, pc.value());
 	}
 
-	ShipmentCount numShipmentsToldToWait() const { return shipments_told_to_wait_; }
-	void numShipmentsToldToWaitIs(ShipmentCount c) { shipments_told_to_wait_ = c; }	
+	// packages the segment can carry at once: numVehicles * fleet capacity
+	PackageCount capacity() const;
+
+	// Vehicle model, on when the fleet has a departure timeout for this
+	// segment's mode. Arriving shipments board the trip that is loading,
+	// which leaves when its vehicles are full or when the timeout expires,
+	// and the segment schedules one activity per trip rather than one per
+	// shipment. segmentLoad() counts boarding and travelling packages alike.
+	bool vehicleModel() const;
+	bool admits(const Fwk::Ptr<Shipment> &shipment) const;
+	VehicleCount vehiclesFor(PackageCount load) const;
 
-	ShipmentCount numShipmentsReceived() const { return shipments_received_; }
-	void numShipmentsReceivedIs(ShipmentCount c) { shipments_received_ = c; }
+	VehicleCount vehiclesBusy() const { return VehicleCount(table_->vehiclesBusy(row_)); }
+	void vehiclesBusyIs(VehicleCount vc) { table_->vehiclesBusyIs(row_, vc.value()); }
 
-	ShipmentCount numShipmentsRefused() const { return shipments_refused_; }
-	void numShipmentsRefusedIs(ShipmentCount c) { shipments_refused_ = c; }
+	// a shipment and the time it started waiting on the segment
+	struct Waiting {
+		Waiting(const Fwk::Ptr<Shipment> &_shipment, double _since):
+			shipment(_shipment), since(_since)
+			{}
+		Fwk::Ptr<Shipment> shipment;
+		double since;
+	};
+	typedef vector<Waiting> BoardingList;
+
+	// the trip that is loading; trip() numbers it so that a stale departure
+	// timeout can tell the trip it was set for has already left
+	U32 trip() const { return trip_; }
+	VehicleCount tripVehicles() const { return trip_vehicles_; }
+	PackageCount tripLoad() const { return trip_load_; }
+	const BoardingList &boarding() const { return boarding_; }
+	void tripNew(VehicleCount vehicles);
+	void boardingShipmentIs(const Fwk::Ptr<Shipment> &shipment, double now);
+	void tripDel(BoardingList &departing);
+	// puts back a loading trip as it was, for restoring a checkpoint
+	void tripIs(U32 trip, VehicleCount vehicles, PackageCount load, const BoardingList &boarding);
+
+	enum AdmissionPolicy {
+		weightedFair_ = 0,
+		strictPriority_
+	};
+	static inline AdmissionPolicy weightedFair() { return weightedFair_; }
+	static inline AdmissionPolicy strictPriority() { return strictPriority_; }
+
+	// how the wait queues of the different priority classes share capacity
+	AdmissionPolicy admissionPolicy() const { return admission_policy_; }
+	void admissionPolicyIs(AdmissionPolicy a) { admission_policy_ = a; }
+
+	// Shipments refused under the queue wait policy, one FIFO queue per
+	// priority class. As capacity frees up the segment picks a class by its
+	// admission policy and admits that class's head; a single expiry
+	// activity, set for the earliest head deadline, drops shipments that
+	// have waited too long.
+	typedef deque<Waiting> WaitQueue;
+	const WaitQueue &waiting(Priority::Class c) const { return waiting_ ? waiting_[c] : noneWaiting_; }
+	size_t waitingShipments() const;
+	void waitingShipmentIs(const Fwk::Ptr<Shipment> &shipment, double now);
+	// the class to serve next, false if nothing is waiting
+	bool waitingClass(Priority::Class &c) const;
+	Waiting waitingShipmentDel(Priority::Class c);
+	bool waitExpiryScheduled() const { return wait_expiry_scheduled_; }
+	void waitExpiryScheduledIs(bool s) { wait_expiry_scheduled_ = s; }
+	// replaces a class's queue, for restoring a checkpoint
+	void waitingIs(Priority::Class c, const WaitQueue &waiting);
+	// the turns each class has earned under weighted fair admission
+	int waitCredit(Priority::Class c) const { return wait_credit_[c]; }
+	void waitCreditIs(Priority::Class c, int credit) { wait_credit_[c] = credit; }
+
+	// the setters also pass the change on to the network's statistics,
+	// which keep running totals over all segments
+	ShipmentCount numShipmentsToldToWait() const { return ShipmentCount(table_->toldToWait(row_)); }
+	void numShipmentsToldToWaitIs(ShipmentCount c);
+
+	ShipmentCount numShipmentsReceived() const { return ShipmentCount(table_->received(row_)); }
+	void numShipmentsReceivedIs(ShipmentCount c);
+
+	ShipmentCount numShipmentsRefused() const { return ShipmentCount(table_->refused(row_)); }
+	void numShipmentsRefusedIs(ShipmentCount c);
+
+	// how long shipments waited for this segment before it took them
+	const Histogram &waitHistogram() const { return wait_histogram_ ? *wait_histogram_ : noWaits_; }
+	void waitHistogramIs(const Histogram &h);
+	void shipmentWaitIs(Hours h) {
+		if (!wait_histogram_) wait_histogram_ = new Histogram();
+		wait_histogram_->valueIs(h.value());
+	}
+
+	// where to record this segment's transits and waits; 0 if not tracing
+	Tracer *tracer() const;
 
 	class NotifieeConst : public virtual Fwk::NamedInterface::NotifieeConst {
 	public:
@@ -299,6 +481,10 @@ public:
 		typedef Fwk::Ptr<SegmentReactor const> PtrConst;
 
 		void onShipmentArrival(Fwk::Ptr<Shipment> &shipment);
+		void onTripTimeout(U32 trip);
+		void onWaitingShipment(Fwk::Ptr<Shipment> &shipment);
+		void onCapacityFreed();
+		void onWaitExpiry();
 
 		static SegmentReactor::Ptr SegmentReactorNew(const Segment::Ptr &notifier, Network *network) {
 			Ptr m = new SegmentReactor(notifier, network);
@@ -315,14 +501,22 @@ public:
 				notifierIs(notifier);
 			}
 
+		void tripDepartureIs();
+		void waitExpiryIs(double at);
+
 		Network *network_;
 		Activity::Manager::Ptr activityManager_;
 	};
 
-	void segmentReactorIs(SegmentReactor::Ptr reactor) { segmentReactor_ = reactor.ptr(); }
+	// The segment's own reactor is called directly, without a virtual call,
+	// ahead of the notifiee list, which is left to other observers.
+	SegmentReactor::Ptr segmentReactor() const { return segmentReactor_; }
+	void segmentReactorIs(SegmentReactor::Ptr reactor) {
+		if (reactor) notifiee_.deleteMember(reactor.ptr());
+		segmentReactor_ = reactor.ptr();
+	}
 	static Segment::Ptr SegmentNew(Fwk::String name, Mode mode, Network *network) {
 		Ptr m = new Segment(name, mode, network);
-		m->segmentReactorIs( SegmentReactor::SegmentReactorNew(m.ptr(), network) );
 		m->referencesDec(1);
 		// decr. refer count to compensate for initial val of 1
 		return m;
@@ -335,6 +529,9 @@ public:
 
 protected:
 	Segment(Fwk::String name, Mode mode, Network *network);
+	~Segment();
+	// the network's statistics, if it has any
+	Statistics *statistics() const;
 
 	void newNotifiee(Segment::NotifieeConst *n) const {
 		Segment* me = const_cast<Segment*>(this);
@@ -349,17 +546,28 @@ protected:
 	NotifieeList notifiee_;
 	Network *network_;
 	SegmentReactor::Ptr segmentReactor_;
-	Mode mode_;
+	// where the mode, vehicles, load and counters live
+	SegmentTable::Ptr table_;
+	SegmentTable::Row row_;
 	Fwk::Ptr<Location> source_;
 	Mile length_;
 	Segment::Ptr return_segment_;
 	Difficulty difficulty_;
 	ExpediteSupport exp_support_;
-	VehicleCount numVehicles_;
-	PackageCount segmentLoad_;
-	ShipmentCount shipments_received_;
-	ShipmentCount shipments_refused_;
-	ShipmentCount shipments_told_to_wait_;
+	VehicleCount trip_vehicles_;
+	PackageCount trip_load_;
+	U32 trip_;
+	BoardingList boarding_;
+	AdmissionPolicy admission_policy_;
+	// Most segments never have a shipment wait, so the queues (one per
+	// class) and the histogram are allocated on the first one; until then
+	// the getters return the empty ones below.
+	WaitQueue *waiting_;
+	int wait_credit_[Priority::classes];
+	bool wait_expiry_scheduled_;
+	Histogram *wait_histogram_;
+	static const WaitQueue noneWaiting_;
+	static const Histogram noWaits_;
 };
 
 class Location : public Fwk::NamedInterface {
@@ -490,11 +698,19 @@ public:
 				//cout << __FILE__ << ":" << __LINE__ << " LocationReactor()" << endl;
 			}
 
+		// true if shipment was split into batches instead of taking segment
+		bool shipmentSplit(Fwk::Ptr<Shipment> &shipment, const Fwk::Ptr<Segment> &segment);
+
 		Network *network_;
 		Activity::Manager::Ptr activityManager_;
 	};
 
-	void locationReactorIs(LocationReactor::Ptr reactor) { locationReactor_ = reactor; }
+	// Called directly rather than through the notifiee list, as for segments.
+	LocationReactor::Ptr locationReactor() const { return locationReactor_; }
+	void locationReactorIs(LocationReactor::Ptr reactor) {
+		if (reactor) notifiee_.deleteMember(reactor.ptr());
+		locationReactor_ = reactor;
+	}
 	static Location::Ptr LocationNew(Fwk::String name, LocationType location_type, Network *network) {
 		Ptr m = new Location(name, location_type, network);		
 		m->referencesDec(1);
@@ -571,8 +787,19 @@ public:
 	void shipmentsReceivedIs(ShipmentCount c) {
 		shipments_received_ = c;
 	}
+	// called once per delivered shipment
 	void totalLatencyInc(Hours l) {
 		total_latency_ = Hours(total_latency_.value() + l.value());
+		latency_histogram_.valueIs(l.value());
+	}
+	const Histogram &latencyHistogram() const { return latency_histogram_; }
+	Hours totalLatency() const { return total_latency_; }
+	// puts back the delivery totals a checkpoint saved
+	void deliveriesIs(ShipmentCount received, Hours latency, Dollars cost, const Histogram &h) {
+		shipments_received_ = received;
+		total_latency_ = latency;
+		total_cost_ = cost;
+		latency_histogram_ = h;
 	}
 	Hours avgLatency() const{
 		if (shipments_received_.value() > 0)
@@ -585,6 +812,20 @@ public:
 		return total_cost_;
 	}
 
+	// dense index assigned by the network, in creation order
+	U32 id() const { return id_; }
+	void idIs(U32 id) { id_ = id; }
+
+	// priority class of the shipments this customer sends
+	Priority::Class shipmentPriority() const { return shipment_priority_; }
+	void shipmentPriorityIs(Priority::Class c) { shipment_priority_ = c; }
+
+	// While the network is batching (Network::batchingIs), transferRateIs,
+	// shipmentSizeIs and destinationIs only note what changed; once the
+	// batch is over the network calls notifyDeferred, which tells the
+	// notifiees of each changed attribute once, with its final value.
+	void notifyDeferred();
+
 	class NotifieeConst : public virtual Fwk::NamedInterface::NotifieeConst {
 	public:
 	  	typedef Fwk::Ptr<NotifieeConst const> PtrConst;
@@ -702,7 +943,10 @@ public:
 	
 protected:
 	Customer(Fwk::String name, Network *network):
-		Location(name, Location::customer(), network)
+		Location(name, Location::customer(), network),
+		id_(0),
+		shipment_priority_(Priority::standard()),
+		deferred_(0)
 		{
 			//cout << __FILE__ << ":" << __LINE__ << " Customer()" << endl;
 		}
@@ -725,6 +969,14 @@ protected:
 	ShipmentCount shipments_received_;
 	Hours total_latency_;
 	Dollars total_cost_;
+	Histogram latency_histogram_;
+	U32 id_;
+	Priority::Class shipment_priority_;
+
+	// changes whose notifications are held back, as a mask of these
+	enum Deferred { transferRateDeferred = 1, shipmentSizeDeferred = 2, destinationDeferred = 4 };
+	bool deferred(Deferred change);
+	U8 deferred_;
 };
 
 class Port : public Location {
@@ -785,6 +1037,9 @@ public:
 		manager_(manager)
 		{}
 
+	// Fleet is only declared here
+	Fleet *fleet() const { return fleet_.ptr(); }
+
 protected:
 	Fwk::Ptr<Fleet> fleet_;
 	Activity::Ptr activity_;
@@ -819,34 +1074,39 @@ public:
 	MilesPerHour speed(Segment::Mode m) const { return speed(m, timeOfDay()); }
 	MilesPerHour speed(Segment::Mode m, TimeOfDay tod) const
 	{
-		map<string, MilesPerHour>::const_iterator found = speeds_.find(key(m, tod));
-		if (found != speeds_.end()) return found->second;
-		return MilesPerHour();
+		return speeds_[tod][m];
 	}
 	void speedIs(Segment::Mode m, MilesPerHour s, TimeOfDay tod) {
-		speeds_[key(m, tod)] = s;
+		speeds_[tod][m] = s;
 	}
 
 	PackageCount capacity(Segment::Mode m) const { return capacity(m, timeOfDay()); }
 	PackageCount capacity(Segment::Mode m, TimeOfDay tod) const
 	{
-		map<string, PackageCount>::const_iterator found = capacities_.find(key(m, tod));
-		if (found != capacities_.end()) return found->second;
-		return PackageCount();
+		return capacities_[tod][m];
 	}
 	void capacityIs(Segment::Mode m, PackageCount c, TimeOfDay tod) {
-		capacities_[key(m, tod)] = c;
+		capacities_[tod][m] = c;
+	}
+
+	// how long a partly loaded vehicle waits before leaving; 0 (the default)
+	// keeps the per-shipment segment model
+	Hours departureTimeout(Segment::Mode m) const {
+		map<Segment::Mode, Hours>::const_iterator found = departure_timeouts_.find(m);
+		if (found != departure_timeouts_.end()) return found->second;
+		return Hours();
+	}
+	void departureTimeoutIs(Segment::Mode m, Hours h) {
+		departure_timeouts_[m] = h;
 	}
 
 	Dollars costPerMile(Segment::Mode m) const { return costPerMile(m, timeOfDay()); }
 	Dollars costPerMile(Segment::Mode m, TimeOfDay tod) const
 	{
-		map<string, Dollars>::const_iterator found = costs_per_mile_.find(key(m, tod));
-		if (found != costs_per_mile_.end()) return found->second;
-		return Dollars();
+		return costs_per_mile_[tod][m];
 	}
 	void costPerMileIs(Segment::Mode m, Dollars cpm, TimeOfDay tod) {
-		costs_per_mile_[key(m, tod)] = cpm;
+		costs_per_mile_[tod][m] = cpm;
 	}
 
 	static Fleet::Ptr FleetNew(Fwk::String name, Network *network) {
@@ -863,18 +1123,12 @@ protected:
 		time_of_day_(Fleet::night()),
 		activityManager_(activityManagerInstance(network))
 		{
-			vector<string> keys;
-			keys.push_back(key(Segment::truck(), Fleet::day()));
-			keys.push_back(key(Segment::boat(), Fleet::day()));
-			keys.push_back(key(Segment::plane(), Fleet::day()));
-			keys.push_back(key(Segment::truck(), Fleet::night()));
-			keys.push_back(key(Segment::boat(), Fleet::night()));
-			keys.push_back(key(Segment::plane(), Fleet::night()));
-
-			for (size_t i = 0; i < keys.size(); i++) {
-				costs_per_mile_[keys[i]] = Dollars(1.f);
-				speeds_[keys[i]] = MilesPerHour(1.f);
-				capacities_[keys[i]] = PackageCount(100);
+			for (size_t t = 0; t < times; t++) {
+				for (size_t m = 0; m < modes; m++) {
+					costs_per_mile_[t][m] = Dollars(1.f);
+					speeds_[t][m] = MilesPerHour(1.f);
+					capacities_[t][m] = PackageCount(100);
+				}
 			}
 
 			Activity::Ptr activity = activityManager_->activityNew("FleetActivity");
@@ -883,16 +1137,15 @@ protected:
 			activity->statusIs(Activity::nextTimeScheduled);
 		}
 
-	string key(Segment::Mode m, TimeOfDay t) const {
-		stringstream stream;
-		stream << Segment::modeName(m) << "_" << Fleet::timeOfDayString(t);
-		return stream.str();
-	}
+	// indexed by time of day and mode, since admission asks for a capacity
+	// on every hop
+	enum { times = night_ + 1, modes = Segment::plane_ + 1 };
 
 	Network *network_;
-	map<string, MilesPerHour> speeds_;
-	map<string, PackageCount> capacities_;
-	map<string, Dollars> costs_per_mile_;
+	MilesPerHour speeds_[times][modes];
+	PackageCount capacities_[times][modes];
+	Dollars costs_per_mile_[times][modes];
+	map<Segment::Mode, Hours> departure_timeouts_;
 
 	TimeOfDay time_of_day_;
 	Activity::Manager::Ptr activityManager_;
@@ -953,6 +1206,8 @@ public:
 	Hours hours() const { return hours_; }
 	Dollars cost() const { return cost_; }
 	Mile distance() const { return distance_; }
+	// what crossing segment costs on this path, expedite surcharge included
+	Dollars calculateCost(const Segment::PtrConst &segment) const;
 	
 	Segment::ExpediteSupport expedited() const { return expedited_; }
 	void expeditedIs(Segment::ExpediteSupport es);
@@ -969,7 +1224,7 @@ public:
 
 protected:
 	Path(const Fleet::PtrConst &f):
-		Fwk::NamedInterface("path"),
+		Fwk::NamedInterface(pathName()),
 		fleet_(f),
 		numSegments_(0),
 		numLocations_(0),
@@ -978,13 +1233,18 @@ protected:
 			endSegmentPart_.type = Path::nil();
 		}
 
+	// every path has the same name, interned once rather than per path
+	static Fwk::Symbol pathName() {
+		static Fwk::Symbol name("path");
+		return name;
+	}
+
 	void numSegmentsIs(size_t n) { numSegments_ = n; }
 	void numLocationsIs(size_t n) { numLocations_ = n; }
 	void hoursIs(Hours t) { hours_ = t; }
 	void costIs(Dollars d) { cost_ = d; }
 	void distanceIs(Mile m) { distance_ = m; }
 
-	Dollars calculateCost(const Segment::PtrConst &segment) const;
 	Hours calculateHours(const Segment::PtrConst &segment) const;
 
 	Fleet::PtrConst fleet_;
@@ -993,7 +1253,7 @@ protected:
 	Segment::PtrConst endSegment_;
 	Part endSegmentPart_;
 
-	set<Fwk::String> usedLocations_;
+	set<Fwk::Symbol> usedLocations_;
 	vector<Part> path_;
 	size_t numSegments_;
 	size_t numLocations_;
@@ -1004,19 +1264,22 @@ protected:
 	Mile distance_;
 };
 
-class Shipment : public Fwk::NamedInterface {
+// unique within a network, handed out in creation order
+typedef U64 ShipmentId;
+
+class Shipment : public Fwk::PtrInterface<Shipment> {
 public:
 	typedef Fwk::Ptr<Shipment> Ptr;
 	typedef Fwk::Ptr<Shipment const> PtrConst;
 
-	static string shipmentName(const Customer::Ptr &source, const Customer::Ptr &destination)
-	{
-		stringstream stream;
-		stream << source->name() << ":" << destination->name();
-		return stream.str(); 
-	}
-	
-	Customer::Ptr source() { return src_; }
+	// batches get ids of their own
+	ShipmentId id() const { return id_; }
+	void idIs(ShipmentId id) { id_ = id; }
+
+	// "source:destination"; built on each call, so only for logging
+	string name() const;
+
+	Customer::Ptr source() const { return src_; }
 	void sourceIs(Customer::Ptr s) { src_ = s; }
 
 	Customer::Ptr dest() const { return dest_; }
@@ -1030,23 +1293,83 @@ public:
 
 	Hours latency() const { return latency_; }
 	void latencyInc(Hours l) { latency_ = Hours(latency_.value() + l.value()); }
+	void latencyIs(Hours l) { latency_ = l; }
+
+	// time spent waiting for segments, under any wait policy; it is part of
+	// latency() too, which is transit plus waiting
+	Hours wait() const { return wait_; }
+	void waitInc(Hours w) { wait_ = Hours(wait_.value() + w.value()); }
+	void waitIs(Hours w) { wait_ = w; }
+
+	// accumulated per segment traversed, so it holds for rerouted shipments too
+	Dollars cost() const { return cost_; }
+	void costInc(Dollars d) { cost_ = Dollars(cost_.value() + d.value()); }
+	void costIs(Dollars d) { cost_ = d; }
+
+	// A batch is a vehicle-sized piece of a split shipment. Batches travel on
+	// their own and fold back into their parent when they reach the
+	// destination; the parent is what Statistics and the customer count.
+	Shipment::Ptr parent() const { return parent_; }
+	void parentIs(const Shipment::Ptr &parent) { parent_ = parent; }
+	PackageCount packagesOutstanding() const { return packages_outstanding_; }
+	void packagesOutstandingIs(PackageCount p) { packages_outstanding_ = p; }
+	void batchArrivalIs(const Shipment::Ptr &batch);
+
+	bool dropped() const { return dropped_; }
+	void droppedIs(bool d) { dropped_ = d; }
 
-	static Shipment::Ptr ShipmentNew(Customer::Ptr s, Customer::Ptr d, PackageCount p, Network *network) {
+	Priority::Class priority() const { return priority_; }
+	void priorityIs(Priority::Class p) { priority_ = p; }
+
+	static Shipment::Ptr ShipmentNew(const Customer::Ptr &s, const Customer::Ptr &d, PackageCount p, Network *network) {
 		Ptr m = new Shipment(s, d, p, network);
 		m->referencesDec(1);
 		// decr. refer count to compensate for initial val of 1
 		return m;
 	}
 
+	// split off a batch of p packages from shipment, which may itself be a batch
+	static Shipment::Ptr BatchNew(const Shipment::Ptr &shipment, PackageCount p) {
+		Ptr m = new Shipment(shipment, p);
+		m->referencesDec(1);
+		// decr. refer count to compensate for initial val of 1
+		return m;
+	}
+
+	// Shipments are carved out of a slab arena instead of the general
+	// heap. The arena is shared by every network in the process and never
+	// destroyed, so shipments still held by the activity manager at exit
+	// stay valid. Its slabs go back to malloc once the last network is
+	// destroyed and the last shipment deleted, whichever comes later, or
+	// through arena().slabsDel() at any time no shipment is live.
+	static void *operator new(size_t size) { return arena().objectNew(size); }
+	static void operator delete(void *p, size_t size) {
+		arena().objectDel(p, size);
+		if (!networks_ && !arena().live()) arena().slabsDel();
+	}
+	static Fwk::Arena &arena();
+	// networks in the process; Network's constructor and destructor keep it
+	static size_t networks() { return networks_; }
+	static void networksInc(int n);
+
 protected:
-	Shipment(Customer::Ptr s, Customer::Ptr d, PackageCount p, Network *network);
+	Shipment(const Customer::Ptr &s, const Customer::Ptr &d, PackageCount p, Network *network);
+	Shipment(const Shipment::Ptr &shipment, PackageCount p);
 
+	ShipmentId id_;
 	Network *network_;
+	static size_t networks_;
 	Customer::Ptr src_;
 	Customer::Ptr dest_;
-	PackageCount load_;
 	Path::PtrConst path_;
+	Shipment::Ptr parent_;
 	Hours latency_;
+	Hours wait_;
+	Dollars cost_;
+	PackageCount load_;
+	PackageCount packages_outstanding_;
+	Priority::Class priority_;
+	bool dropped_;
 };
 
 class RetryActivityReactor : public Activity::Notifiee {
@@ -1058,27 +1381,35 @@ public:
 
 	RetryActivityReactor(Fwk::Ptr<Activity::Manager> manager,
 				Activity *activity, Shipment *shipment,
-				Segment *segment, Network *network):
-		Notifiee(activity),
-		network_(network),
-		successfullyForwardedShipment_(false),
-		totalTimeWaiting_(0.0),
-		wait_( (rand() % 10 + 1) / 10.0),
-		shipment_(shipment),
-		segment_(segment),
-		activity_(activity),
-		manager_(manager)
-		{}
-
-	double wait() { return wait_; }
+				Segment *segment, Network *network);
+
+	Fwk::Ptr<Shipment> shipment() const { return shipment_; }
+	Fwk::Ptr<Segment> segment() const { return segment_; }
+	// where the shipment waits to leave from; under congestion routing each
+	// attempt asks Connectivity::nextHop for a segment from here again
+	Location::Ptr location() const { return location_; }
+	void locationIs(const Location::Ptr &l) { location_ = l; }
+	bool successfullyForwardedShipment() const { return successfullyForwardedShipment_; }
+	double totalTimeWaiting() const { return totalTimeWaiting_; }
+	double since() const { return since_; }
+	double wait() const { return wait_; }
+	// picks the retries up where a checkpoint left them
+	void retriesIs(bool forwarded, double totalTimeWaiting, double since, double wait) {
+		successfullyForwardedShipment_ = forwarded;
+		totalTimeWaiting_ = totalTimeWaiting;
+		since_ = since;
+		wait_ = wait;
+	}
 
 protected:
 	Network *network_;
 	bool successfullyForwardedShipment_;
 	double totalTimeWaiting_;
+	double since_;
 	double wait_;
 	Fwk::Ptr<Shipment> shipment_;
 	Fwk::Ptr<Segment> segment_;
+	Location::Ptr location_;
 	Activity::Ptr activity_;
 	Fwk::Ptr<Activity::Manager> manager_;
 };
@@ -1096,6 +1427,9 @@ public:
 		manager_(manager)
 		{}
 
+	Customer::Ptr customer() const { return customer_; }
+	double rate() const { return rate_; }
+
 protected:
 	Network *network_;
 	Customer::Ptr customer_;
@@ -1113,13 +1447,100 @@ public:
 		Notifiee(activity),
 		segment_(segment),
 		shipment_(shipment),
+		departure_(manager->now().value()),
 		activity_(activity),
 		manager_(manager)
 		{}
 
+	Segment::Ptr segment() const { return segment_; }
+	Shipment::Ptr shipment() const { return shipment_; }
+	double departure() const { return departure_; }
+	void departureIs(double d) { departure_ = d; }
+
 protected:
 	Segment::Ptr segment_;
 	Shipment::Ptr shipment_;
+	double departure_;
+	Activity::Ptr activity_;
+	Fwk::Ptr<Activity::Manager> manager_;
+};
+
+// carries one trip's shipments across the segment
+class TripActivityReactor : public Activity::Notifiee {
+public:
+	void onStatus();
+
+	TripActivityReactor(Fwk::Ptr<Activity::Manager> manager, Activity *activity,
+						Segment *segment, VehicleCount vehicles, PackageCount load):
+		Notifiee(activity),
+		segment_(segment),
+		vehicles_(vehicles),
+		load_(load),
+		departure_(manager->now().value()),
+		activity_(activity),
+		manager_(manager)
+		{}
+
+	Segment::Ptr segment() const { return segment_; }
+	VehicleCount vehicles() const { return vehicles_; }
+	PackageCount load() const { return load_; }
+	double departure() const { return departure_; }
+	void departureIs(double d) { departure_ = d; }
+	Segment::BoardingList &shipments() { return shipments_; }
+	const Segment::BoardingList &shipments() const { return shipments_; }
+
+protected:
+	Segment::Ptr segment_;
+	VehicleCount vehicles_;
+	PackageCount load_;
+	double departure_;
+	Segment::BoardingList shipments_;
+	Activity::Ptr activity_;
+	Fwk::Ptr<Activity::Manager> manager_;
+};
+
+// drops the shipments at the head of a segment's wait queue once they
+// have waited too long
+class WaitExpiryActivityReactor : public Activity::Notifiee {
+public:
+	void onStatus();
+
+	WaitExpiryActivityReactor(Fwk::Ptr<Activity::Manager> manager, Activity *activity,
+						Segment *segment):
+		Notifiee(activity),
+		segment_(segment),
+		activity_(activity),
+		manager_(manager)
+		{}
+
+	Segment::Ptr segment() const { return segment_; }
+
+protected:
+	Segment::Ptr segment_;
+	Activity::Ptr activity_;
+	Fwk::Ptr<Activity::Manager> manager_;
+};
+
+// sends trip off partly loaded if it is still loading when the timeout expires
+class TripTimeoutActivityReactor : public Activity::Notifiee {
+public:
+	void onStatus();
+
+	TripTimeoutActivityReactor(Fwk::Ptr<Activity::Manager> manager, Activity *activity,
+						Segment *segment, U32 trip):
+		Notifiee(activity),
+		segment_(segment),
+		trip_(trip),
+		activity_(activity),
+		manager_(manager)
+		{}
+
+	Segment::Ptr segment() const { return segment_; }
+	U32 trip() const { return trip_; }
+
+protected:
+	Segment::Ptr segment_;
+	U32 trip_;
 	Activity::Ptr activity_;
 	Fwk::Ptr<Activity::Manager> manager_;
 };
@@ -1153,10 +1574,12 @@ public:
 
 	enum RoutingMethod {
 		dijkstra_,
-		bfs_
+		bfs_,
+		congestion_
 	};
 	static inline RoutingMethod dijkstra() { return dijkstra_; }
 	static inline RoutingMethod bfs() { return bfs_; }
+	static inline RoutingMethod congestion() { return congestion_; }
 
 	
 	void constraintsActiveIs(int mask);
@@ -1199,6 +1622,30 @@ public:
 		expedited_ = es;
 	}
 
+	enum WaitPolicy {
+		waitRetry_ = 0,
+		waitQueue_
+	};
+	static inline WaitPolicy waitRetry() { return waitRetry_; }
+	static inline WaitPolicy waitQueue() { return waitQueue_; }
+
+	// what a shipment does when its segment is full: poll it with
+	// backed-off retry activities (the default) or queue on the segment
+	WaitPolicy waitPolicy() const { return wait_policy_; }
+	void waitPolicyIs(WaitPolicy w) { wait_policy_ = w; }
+
+	enum ShipmentSplitting {
+		splittingDisabled_ = 0,
+		splittingEnabled_
+	};
+	static inline ShipmentSplitting splittingEnabled() { return splittingEnabled_; }
+	static inline ShipmentSplitting splittingDisabled() { return splittingDisabled_; }
+
+	// with splitting enabled, shipments bigger than one vehicle of the next
+	// segment's mode leave in vehicle-sized batches
+	ShipmentSplitting shipmentSplitting() const { return splitting_; }
+	void shipmentSplittingIs(ShipmentSplitting s) { splitting_ = s; }
+
 	void fleetIs(const Fleet::PtrConst &f) { fleet_ = f; }
 	Fleet::PtrConst fleet() const { return fleet_; }
 
@@ -1210,8 +1657,13 @@ public:
 	void routingMethodIs(RoutingMethod rm) {
 		routing_method_ = rm;
 	}
-	Path::PtrConst shipmentPath(const string &s) const {
-		map<string, Path::Ptr>::const_iterator it;
+	// routes between customers, keyed by their ids
+	typedef pair<U32, U32> RouteKey;
+	typedef map<RouteKey, Path::Ptr> RouteMap;
+
+	Path::PtrConst shipmentPath(const Customer::PtrConst &source, const Customer::PtrConst &destination) const {
+		RouteKey s(source->id(), destination->id());
+		RouteMap::const_iterator it;
 		Path::Ptr p;
 
 		if(routingMethod() == bfs()){
@@ -1221,7 +1673,8 @@ public:
 				return p;
 			} 
 		}
-		if(routingMethod() == dijkstra()){
+		// congestion routing uses the dijkstra route as its reference path
+		if(routingMethod() == dijkstra() || routingMethod() == congestion()){
 			it = routes_dijkstra_.find(s);
 			if (it != routes_dijkstra_.end()) {
 				p = it->second;
@@ -1231,6 +1684,26 @@ public:
 		return Path::Ptr();
 	}
 
+	struct Hop {
+		Hop(const Segment::PtrConst &s, float c): seg(s), costToGo(c) {}
+
+		Segment::PtrConst seg;
+		float costToGo; // miles to the destination when leaving on seg
+	};
+	typedef vector<Hop> HopList;
+	struct NextHopTable {
+		NextHopTable(): version(0) {}
+
+		U32 version; // network topology version the table was built at
+		map<Fwk::Symbol, HopList> hops; // keyed by location name
+	};
+
+	// Next segment for shipment at location under congestion routing: the
+	// downhill segment with the best load-weighted cost to the destination
+	// that still has room, else the cheapest one (the shipment waits there,
+	// but leaves on whichever hop frees up first).
+	Segment::PtrConst nextHop(const Location::PtrConst &location, const Shipment::PtrConst &shipment) const;
+
 	static Connectivity::Ptr ConnectivityNew(Fwk::String name, Network *network) {
 		Ptr m = new Connectivity(name, network);
 		m->referencesDec(1);
@@ -1244,18 +1717,22 @@ public:
 	SimulationStatus simulationStatus() const{
 		return simulation_status_;
 	}
-	void simulationStatusIs(SimulationStatus s) {
-		//cout <<__FILE__<<":"<< __LINE__<< " inside simulationStatusIs()" << endl;
-		if(simulationStatus() == off() && s == running()) { //simulation is starting
-			cout << "Preprocessing Network......" << endl;
-			//cout <<__FILE__<<":"<< __LINE__<< " doing dijkstra()" << endl;
-			routes_dijkstra_ = routes(dijkstra());
-			//cout <<__FILE__<<":"<< __LINE__<< " doing bfs()" << endl;
-			routes_bfs_ = routes(bfs());
-		}
-		simulation_status_ = s;
+	// starting the simulation precomputes the routes between customers,
+	// unless routes were installed since at the current topology version
+	void simulationStatusIs(SimulationStatus s);
+
+	// the routes between customers as last precomputed or installed, and the
+	// network topology version they were found at (0 for none yet)
+	const RouteMap &precomputedRoutes(RoutingMethod rm) const {
+		return rm == bfs() ? routes_bfs_ : routes_dijkstra_;
 	}
-	
+	U32 routesVersion() const { return routes_version_; }
+	// installs routes found elsewhere, such as in a snapshot (Loader.h)
+	void precomputedRoutesIs(const RouteMap &dijkstraRoutes, const RouteMap &bfsRoutes);
+	// precomputes the routes now, without starting the simulation; the next
+	// start keeps them unless the topology changes first
+	void precomputedRoutesIs() { precomputedRoutesIs(routes(dijkstra()), routes(bfs())); }
+
 
 protected:	
 	Connectivity(Fwk::String name, Network *network):
@@ -1264,16 +1741,23 @@ protected:
 		expedited_(Segment::expediteNotSupported()),
 		mask_(0),
 		routing_method_(dijkstra()),
-		simulation_status_(off())
+		simulation_status_(off()),
+		wait_policy_(waitRetry()),
+		splitting_(splittingDisabled()),
+		routes_version_(0),
+		routes_installed_(false)
 		{}
 
-	bool isValidExplorePath(Path::Ptr path) const;
-	bool isValidExplorePathNotExpedited(Path::Ptr one, Path::Ptr two) const;
+	bool isValidExplorePath(const Path::Ptr &path) const;
+	bool isValidExplorePathNotExpedited(const Path::Ptr &one, const Path::Ptr &two) const;
 	vector<string> stringifyPaths(SearchPattern pattern, vector<Path::Ptr> &completedPaths) const;
-	map<string, Path::Ptr> routes(RoutingMethod rm);
+	RouteMap routes(RoutingMethod rm);
 	Path::Ptr DijkstraShortestPath(Location::PtrConst &startLoc, Location::PtrConst &endLoc);
 	Path::Ptr BFSShortestPath(Location::PtrConst &startLoc, Location::PtrConst &endLoc);
 
+	const NextHopTable &nextHopTable(const Customer::PtrConst &destination) const;
+	void nextHopTableIs(const Customer::PtrConst &destination, NextHopTable &table) const;
+
 
 	Network *network_;
 	Segment::ExpediteSupport expedited_;
@@ -1286,9 +1770,14 @@ protected:
 	Hours hours_;
 	RoutingMethod routing_method_;
 	SimulationStatus simulation_status_;
-	map<string, Path::Ptr> routes_dijkstra_;
-	map<string, Path::Ptr> routes_bfs_;
-	
+	WaitPolicy wait_policy_;
+	ShipmentSplitting splitting_;
+	RouteMap routes_dijkstra_;
+	RouteMap routes_bfs_;
+	U32 routes_version_;
+	bool routes_installed_;
+	// per destination, rebuilt lazily when the topology version moves on
+	mutable map<Fwk::Symbol, NextHopTable> nextHops_;
 };
 
 class Statistics; // Forward declaration
@@ -1299,29 +1788,87 @@ public:
 
 
 	Location::Ptr location(const Fwk::String &name);
+	// copies, in name order; the iterators below walk the network in place
 	vector<Location::PtrConst> locations() const {
 		vector<Location::PtrConst> locs;
-		for (map<string, Location::Ptr>::const_iterator itr = locations_.begin(); itr != locations_.end(); ++itr) {
-			locs.push_back(itr->second.ptr());
-		}
+		const vector<Handle> &handles = locations_.handlesByName();
+		locs.reserve(handles.size());
+		for (size_t i = 0; i < handles.size(); i++) locs.push_back(locations_.member(handles[i]).ptr());
 		return locs;
 	}
 
+	// copies, in name order
 	vector<Segment::PtrConst> segments() const {
 		vector<Segment::PtrConst> segs;
-		for (map<string, Segment::Ptr>::const_iterator itr = segments_.begin(); itr != segments_.end(); ++itr) {
-			segs.push_back(itr->second.ptr());
-		}
+		const vector<Handle> &handles = segments_.handlesByName();
+		segs.reserve(handles.size());
+		for (size_t i = 0; i < handles.size(); i++) segs.push_back(segments_.member(handles[i]).ptr());
 		return segs;
 	}
-	Segment::Ptr segment(const Fwk::String &name) {
-		map<Fwk::String, Segment::Ptr>::iterator found = segments_.find(name);
-		if(found == segments_.end()) return Segment::Ptr();
-		return found->second;
-	}
+	Segment::Ptr segment(const Fwk::String &name) const {
+		return segments_.member(name);
+	}
+
+	// Locations and segments are kept in registries (fwk/Registry.h): a
+	// handle names one for as long as it is in the network, and is resolved
+	// without hashing the name again. Handles run from 0 to locationHandles()
+	// or segmentHandles(), with null entities in the gaps.
+	typedef Fwk::Registry<Location::Ptr>::Handle Handle;
+	static Handle noHandle() { return Fwk::Registry<Location::Ptr>::none(); }
+	Handle locationHandle(const Fwk::String &name) const { return locations_.handle(name); }
+	Handle locationHandles() const { return locations_.handles(); }
+	const Location::Ptr &locationAt(Handle h) const { return locations_.member(h); }
+	Handle segmentHandle(const Fwk::String &name) const { return segments_.handle(name); }
+	Handle segmentHandles() const { return segments_.handles(); }
+	const Segment::Ptr &segmentAt(Handle h) const { return segments_.member(h); }
+	// the handles in name order, for listings that have to be sorted; valid
+	// until a location or segment is added or deleted
+	const vector<Handle> &locationHandlesByName() const { return locations_.handlesByName(); }
+	const vector<Handle> &segmentHandlesByName() const { return segments_.handlesByName(); }
+	size_t locationCount() const { return locations_.members(); }
+
+	// Walks the locations or segments where they are, in handle order,
+	// without copying or counting references:
+	//   for (Network::SegmentIterator i = network->segmentIter(); i.ptr(); ++i)
+	// Entities must not be added or deleted while walking.
+	template<class E>
+	class RegistryIterator {
+	public:
+		RegistryIterator(const Fwk::Registry<Fwk::Ptr<E> > &registry):
+			registry_(&registry), handle_(0) { skip(); }
+		E *ptr() const { return handle_ < registry_->handles() ? registry_->member(handle_).ptr() : 0; }
+		E *operator->() const { return ptr(); }
+		Handle handle() const { return handle_; }
+		RegistryIterator &operator++() { ++handle_; skip(); return *this; }
+	private:
+		void skip() { while (handle_ < registry_->handles() && !registry_->member(handle_)) ++handle_; }
+		const Fwk::Registry<Fwk::Ptr<E> > *registry_;
+		Handle handle_;
+	};
+	typedef RegistryIterator<Location> LocationIterator;
+	typedef RegistryIterator<Segment> SegmentIterator;
+	LocationIterator locationIter() const { return LocationIterator(locations_); }
+	SegmentIterator segmentIter() const { return SegmentIterator(segments_); }
+
+	// The customers by id (Customer::id), null where one has been deleted,
+	// and a walk over the live ones in id order, in place like the above.
+	Customer *customer(U32 id) const { return customers_[id]; }
+	class CustomerIterator {
+	public:
+		CustomerIterator(const vector<Customer *> &customers): customers_(&customers), id_(0) { skip(); }
+		Customer *ptr() const { return id_ < customers_->size() ? (*customers_)[id_] : 0; }
+		Customer *operator->() const { return ptr(); }
+		CustomerIterator &operator++() { ++id_; skip(); return *this; }
+	private:
+		void skip() { while (id_ < customers_->size() && !(*customers_)[id_]) ++id_; }
+		const vector<Customer *> *customers_;
+		size_t id_;
+	};
+	CustomerIterator customerIter() const { return CustomerIterator(customers_); }
 
 	Fleet::PtrConst fleet() const { return fleet_; }
 	Connectivity::PtrConst connectivity() const { return connectivity_; }
+	Connectivity::Ptr connectivity() { return connectivity_; }
 	Fwk::Ptr<Statistics const> statistics() const { return statistics_; }
 
 	void expediteSupportIs(Fwk::String name, Segment::ExpediteSupport supported);
@@ -1346,7 +1893,62 @@ public:
 	Connectivity::Ptr connectivityNew(Fwk::String name);
 	Connectivity::Ptr connectivityDel(Fwk::String name);
 
-	Shipment::Ptr shipmentNew(Customer::Ptr s, Customer::Ptr d, PackageCount p);
+	Shipment::Ptr shipmentNew(const Customer::Ptr &s, const Customer::Ptr &d, PackageCount p);
+	Shipment::Ptr shipmentBatchNew(const Shipment::Ptr &shipment, PackageCount p);
+
+	// bumped whenever segments are connected, disconnected or resized
+	U32 topologyVersion() const { return topologyVersion_; }
+	void topologyVersionInc() { ++topologyVersion_; }
+
+	// number of customer ids handed out so far
+	U32 customerIds() const { return customerIds_; }
+
+	// number of shipment ids handed out so far, and the next one
+	ShipmentId shipmentIds() const { return shipmentIds_; }
+	ShipmentId shipmentIdNew() { return shipmentIds_++; }
+	void shipmentIdsIs(ShipmentId ids) { shipmentIds_ = ids; }
+
+	size_t segmentCount() const { return segments_.members(); }
+	// the segments' packed state (see SegmentTable)
+	SegmentTable::Ptr segmentTable() const { return segmentTable_; }
+
+	// The engine's own random numbers (the retry policy's back-off), so
+	// that a run can be repeated from its seed and a checkpoint can carry
+	// the generator on. xorshift64*; setting the seed restarts it.
+	U64 randomSeed() const { return randomSeed_; }
+	void randomSeedIs(U64 seed) { randomSeed_ = seed; randomState_ = seed ? seed : 1; }
+	// where the generator has got to since the seed
+	U64 randomState() const { return randomState_; }
+	void randomStateIs(U64 state) { randomState_ = state; }
+	U32 randomNew() {
+		randomState_ ^= randomState_ >> 12;
+		randomState_ ^= randomState_ << 25;
+		randomState_ ^= randomState_ >> 27;
+		return (U32) ((randomState_ * 2685821657736338717ULL) >> 32);
+	}
+
+	// What the xNew calls created while batching was on (see batchingIs).
+	struct Batch {
+		vector<Segment::Ptr> segments;
+		vector<Customer::Ptr> customers;
+		vector<Port::Ptr> ports;
+		vector<Terminal::Ptr> terminals;
+	};
+
+	// While batching, segmentNew, customerNew, portNew and terminalNew
+	// collect what they create instead of notifying; turning it off hands
+	// the whole batch to each notifiee in one onBatchNew() call. Bulk
+	// loaders use this to avoid a notifiee fan-out per entity. Customers
+	// hold back their own notifications too (Customer::notifyDeferred),
+	// which are delivered after the batch.
+	bool batching() const { return batching_; }
+	void batchingIs(bool b);
+	// a customer holding back notifications until batching ends
+	void deferredCustomerIs(Customer::Ptr c) { deferredCustomers_.push_back(c); }
+
+	// receives simulation events while set (see Trace.h); not owned
+	Tracer *tracer() const { return tracer_; }
+	void tracerIs(Tracer *t) { tracer_ = t; }
 
 	static Network::Ptr NetworkNew(Fwk::String name) {
 		Ptr m = new Network(name);		
@@ -1375,7 +1977,10 @@ public:
 		virtual void onPortDel(Port::Ptr port) {}
 		virtual void onTerminalDel(Terminal::Ptr terminal) {}
 
-		virtual void onShipmentNew(Shipment::Ptr shipment) {}
+		virtual void onShipmentNew(const Shipment::Ptr &shipment) {}
+
+		// by default, the onXNew calls the batch stands in for
+		virtual void onBatchNew(const Network::Batch &batch);
 
 		virtual void onNumExpediteSupportedSegments(int n) {}
 
@@ -1429,8 +2034,17 @@ public:
 
 protected:
 	Network(Fwk::String name):
-		Fwk::NamedInterface(name)
-		{}
+		Fwk::NamedInterface(name),
+		segmentTable_(SegmentTable::SegmentTableNew()),
+		topologyVersion_(1),
+		customerIds_(0),
+		shipmentIds_(0),
+		randomSeed_(1),
+		randomState_(1),
+		tracer_(0),
+		batching_(false)
+		{ Shipment::networksInc(1); }
+	~Network();
 
 	void newNotifiee(Network::NotifieeConst *n) const {
 		Network* me = const_cast<Network*>(this);
@@ -1442,21 +2056,32 @@ protected:
 	}
 
 	void locationIs(const Fwk::String &name, Location::Ptr m) {
-		locations_[name] = m;
+		locations_.memberIs(name, m);
 	}
 	void segmentIs(const Fwk::String &name, Segment::Ptr m) {
-		segments_[name] = m;
+		segments_.memberIs(name, m);
 	}
 
 	void locationSegmentsDel(Location::Ptr m);
 
-
 	NotifieeList notifiee_;
-	map<Fwk::String, Location::Ptr> locations_;
-	map<Fwk::String, Segment::Ptr> segments_;
+	Fwk::Registry<Location::Ptr> locations_;
+	Fwk::Registry<Segment::Ptr> segments_;
+	SegmentTable::Ptr segmentTable_;
+	// by id; the registry holds the references
+	vector<Customer *> customers_;
 	Fleet::Ptr fleet_;
 	Fwk::Ptr<Statistics> statistics_;
 	Connectivity::Ptr connectivity_;
+	U32 topologyVersion_;
+	U32 customerIds_;
+	ShipmentId shipmentIds_;
+	U64 randomSeed_;
+	U64 randomState_;
+	Tracer *tracer_;
+	bool batching_;
+	vector<Customer::Ptr> deferredCustomers_;
+	Batch batch_;
 };
 
 
@@ -1476,6 +2101,7 @@ public:
 	static inline ShipmentStatus dropped() { return dropped_;}
 
 	struct ShippingRecord {
+		ShippingRecord() { record[0] = record[1] = record[2] = 0; }
 		int record[3];
 
 		void numEnRouteInc(int n = 1) { record[enroute_] += n; }
@@ -1491,14 +2117,47 @@ public:
 	size_t numPorts() const { return numPorts_; }
 	size_t numTerminals(Segment::Mode mode) const { return numTerminals_[mode]; }
 	size_t numSegments(Segment::Mode mode) const { return numSegments_[mode]; }
-	size_t numShipments(ShipmentStatus status) const { return numShipments_[status]; }
-
-	void deliveredShipmentIs(Shipment::Ptr shipment);
-	void droppedShipmentIs(Shipment::Ptr shipment);
+	size_t numShipments(ShipmentStatus status) const { return numShipments_.count[status]; }
+	void numShipmentsIs(ShipmentStatus status, size_t n) {
+		numShipments_.count[status].valueIs(n);
+	}
+
+	// sums of every segment's counters, kept current by the segments'
+	// setters, and their averages over the network's segments; all O(1)
+	size_t numSegmentShipmentsReceived() const { return segmentTotals_.received; }
+	size_t numSegmentShipmentsToldToWait() const { return segmentTotals_.toldToWait; }
+	size_t numSegmentShipmentsRefused() const { return segmentTotals_.refused; }
+	float avgShipmentsReceived() const { return (float) numSegmentShipmentsReceived() / (float) network_->segmentCount(); }
+	float avgShipmentsToldToWait() const { return (float) numSegmentShipmentsToldToWait() / (float) network_->segmentCount(); }
+	float avgShipmentsRefused() const { return (float) numSegmentShipmentsRefused() / (float) network_->segmentCount(); }
+
+	// deltas are modulo 2^64, so a decrease is passed as a wrapped size_t
+	void segmentShipmentsReceivedInc(size_t n) { segmentTotals_.received.valueInc(n); }
+	void segmentShipmentsToldToWaitInc(size_t n) { segmentTotals_.toldToWait.valueInc(n); }
+	void segmentShipmentsRefusedInc(size_t n) { segmentTotals_.refused.valueInc(n); }
+
+	// shipments between a pair of customers, by state
+	ShippingRecord shippingRecord(const Customer::PtrConst &src, const Customer::PtrConst &dest) const;
+	void shippingRecordIs(const Customer::PtrConst &src, const Customer::PtrConst &dest, const ShippingRecord &record);
+
+	void deliveredShipmentIs(const Shipment::Ptr &shipment);
+	void droppedShipmentIs(const Shipment::Ptr &shipment);
+
+	// delivery latency of all shipments and of each priority class, and
+	// the total time shipments spent waiting for segments
+	const Histogram &latency() const { return latency_all_; }
+	const Histogram &latency(Priority::Class c) const { return latency_[c]; }
+	const Histogram &wait() const { return wait_; }
+	void latencyHistogramIs(const Histogram &h) { latency_all_ = h; }
+	void latencyHistogramIs(Priority::Class c, const Histogram &h) { latency_[c] = h; }
+	void waitHistogramIs(const Histogram &h) { wait_ = h; }
 
 	float percentExpeditedSegments();
 
 	string simulationShipmentStats() const;
+	// shipment counts, segment averages and latency, without walking the
+	// network, so it is cheap enough to poll during long runs
+	string simulationSummary() const;
 	string simulationStatisticsOutput() const;
 	
 
@@ -1519,7 +2178,13 @@ protected:
 			for(size_t i = 0; i < 3; i++) {
 				numTerminals_[i] = 0;
 				numSegments_[i] = 0;
-				numShipments_[i] = 0;
+			}
+			// segments from before the statistics existed; later changes
+			// arrive through the segments' setters
+			for (Network::SegmentIterator i = network->segmentIter(); i.ptr(); ++i) {
+				segmentShipmentsReceivedInc(i->numShipmentsReceived().value());
+				segmentShipmentsToldToWaitInc(i->numShipmentsToldToWait().value());
+				segmentShipmentsRefusedInc(i->numShipmentsRefused().value());
 			}
 		}
 
@@ -1535,10 +2200,6 @@ protected:
 	void numSegmentsIs(Segment::Mode mode, size_t n) {
 		numSegments_[mode] = n;
 	}
-	void numShipmentsIs(ShipmentStatus status, size_t n) {
-		numShipments_[status] = n;
-	}
-
 	void onSegmentNew(Segment::Ptr segment);
 	void onCustomerNew(Customer::Ptr customer);
 	void onPortNew(Port::Ptr port);
@@ -1549,19 +2210,46 @@ protected:
 	void onPortDel(Port::Ptr port);
 	void onTerminalDel(Terminal::Ptr terminal);
 
-	void onShipmentNew(Shipment::Ptr shipment);
+	void onShipmentNew(const Shipment::Ptr &shipment);
+
+	void onBatchNew(const Network::Batch &batch);
 	
 	void onNumExpediteSupportedSegments(int n);
 
-	map<string, ShippingRecord> shipmentRecords_;
+	void shipmentAveragesIs(ostream &output) const;
+	void latencyIs(ostream &output) const;
+
+	// indexed by source then destination Customer::id(); rows grow on demand
+	ShippingRecord &shippingRecord(const Shipment::Ptr &shipment);
+	vector< vector<ShippingRecord> > shipmentRecords_;
+	Histogram latency_all_;
+	Histogram latency_[Priority::classes];
+	Histogram wait_;
 
 	Network *network_;
 	size_t numCustomers_;
 	size_t numPorts_;
 	size_t numTerminals_[3];
 	size_t numSegments_[3];
-	size_t numShipments_[3];
 	size_t numExpeditedSegments_;
+
+	// every shipment event updates these; padded by a cache line on each
+	// side so they never share one with the rarely written counts, without
+	// over-aligning Statistics (which operator new would not honour).
+	// Atomic so the metrics exporter can read them from its own thread.
+	struct ShipmentCounters {
+		char padBefore[64];
+		Fwk::Atomic<size_t> count[3];
+		char padAfter[64];
+	};
+	ShipmentCounters numShipments_;
+
+	struct SegmentTotals {
+		Fwk::Atomic<size_t> received;
+		Fwk::Atomic<size_t> toldToWait;
+		Fwk::Atomic<size_t> refused;
+	};
+	SegmentTotals segmentTotals_;
 };
 
 } /* end namespace */
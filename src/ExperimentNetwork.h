@@ -0,0 +1,14 @@
+#ifndef EXPERIMENTNETWORK_H
+#define EXPERIMENTNETWORK_H
+
+#include "Instance.h"
+
+// The network experiment and benchmark run on: 100 sources and 1
+// destination, connected to a hub terminal which is in turn connected to
+// 10 terminals, each of which is connected to 10 sources, all by truck
+// segments. Every source ships to the destination; shipments hold 100
+// packages, or with randomSizes a size drawn with rand() per source from
+// 1 to 1,000 packages.
+void SetUpExperimentNetwork(Ptr<Instance::Manager> &manager, bool randomSizes);
+
+#endif
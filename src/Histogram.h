@@ -0,0 +1,109 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <string>
+#include <sstream>
+
+namespace Shipping {
+
+// Fixed-memory, log-linear histogram of non-negative values (hours), in
+// the style of an HDR histogram. Values are kept as integer units of
+// 0.01h. Below 2^subBucketBits units every unit has its own bucket; above
+// that each power of two is split into 2^subBucketBits buckets, so the
+// relative error stays under 1/2^subBucketBits across the whole range.
+// Recording is O(1) and never allocates.
+class Histogram {
+public:
+	static const unsigned subBucketBits = 4;
+	static const unsigned subBuckets = 1 << subBucketBits;
+	static const unsigned buckets = (32 - subBucketBits + 1) * subBuckets;
+
+	Histogram():
+		count_(0),
+		sum_(0.0),
+		max_(0.0)
+		{
+			for (unsigned i = 0; i < buckets; i++) bucket_[i] = 0;
+		}
+
+	void valueIs(double v) {
+		if (v < 0.0) v = 0.0;
+		double units = v / unit();
+		unsigned u = units >= 4294967295.0 ? 4294967295u : (unsigned) units;
+		bucket_[index(u)]++;
+		count_++;
+		sum_ += v;
+		if (v > max_) max_ = v;
+	}
+
+	size_t count() const { return count_; }
+	double mean() const { return count_ ? sum_ / count_ : 0.0; }
+	double max() const { return max_; }
+
+	// the raw counts, so a histogram can be saved and put back as it was
+	double sum() const { return sum_; }
+	unsigned bucket(unsigned i) const { return bucket_[i]; }
+	void bucketIs(unsigned i, unsigned n) { bucket_[i] = n; }
+	void totalsIs(size_t count, double sum, double max) {
+		count_ = count;
+		sum_ = sum;
+		max_ = max;
+	}
+
+	// smallest recorded value v such that p percent of the values are <= v,
+	// to within a bucket; 0 if nothing has been recorded
+	double percentile(double p) const {
+		if (!count_) return 0.0;
+		size_t rank = (size_t) (p / 100.0 * count_ + 0.5);
+		if (rank < 1) rank = 1;
+		if (rank > count_) rank = count_;
+		size_t seen = 0;
+		for (unsigned i = 0; i < buckets; i++) {
+			seen += bucket_[i];
+			if (seen >= rank) {
+				double upper = (lowerBound(i) + width(i)) * unit();
+				return upper < max_ ? upper : max_;
+			}
+		}
+		return max_;
+	}
+
+	// "count=3 mean=1.50 p50=1.50 p95=2.50 p99=2.50 max=2.50"
+	std::string stringValue() const {
+		std::stringstream out;
+		out.setf(std::ios::fixed, std::ios::floatfield);
+		out.precision(2);
+		out << "count=" << count_ << " mean=" << mean()
+			<< " p50=" << percentile(50) << " p95=" << percentile(95)
+			<< " p99=" << percentile(99) << " max=" << max_;
+		return out.str();
+	}
+
+protected:
+	static double unit() { return 0.01; }
+
+	static unsigned index(unsigned u) {
+		if (u < subBuckets) return u;
+		unsigned e = 31 - __builtin_clz(u);
+		unsigned shift = e - subBucketBits;
+		return (shift + 1) * subBuckets + ((u >> shift) - subBuckets);
+	}
+	static double lowerBound(unsigned i) {
+		if (i < subBuckets) return i;
+		unsigned k = i / subBuckets;
+		return (double) ((subBuckets + i % subBuckets) * (1u << (k - 1)));
+	}
+	static double width(unsigned i) {
+		if (i < subBuckets) return 1;
+		return (double) (1u << (i / subBuckets - 1));
+	}
+
+	unsigned bucket_[buckets];
+	size_t count_;
+	double sum_;
+	double max_;
+};
+
+} /* end namespace */
+
+#endif
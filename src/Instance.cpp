@@ -1,14 +1,67 @@
 #include <stdlib.h>
+#include <errno.h>
 #include <iostream>
 #include <map>
 #include <vector>
 #include "Instance.h"
 #include "Engine.h"
+#include "Sampler.h"
+#include "Metrics.h"
+#include "Instrument.h"
+#include "Trace.h"
+#include "Loader.h"
+#include "Checkpoint.h"
+#include <fstream>
+
+//
+// Instances that do not resolve attribute ids
+//
+string Instance::attribute(AttributeId id) {
+    std::cerr<<"bad input"<<std::endl;
+    return "";
+}
+
+void Instance::attributeIs(AttributeId id, const string& v) {
+    std::stringstream s;
+    s <<"Attribute "<< id<<" not supported.";
+    throw Fwk::AttributeNotSupportedException(s.str());
+}
+
+double Instance::attributeValue(AttributeId id) {
+    std::cerr<<"bad input"<<std::endl;
+    return 0;
+}
+
+void Instance::attributeValueIs(AttributeId id, double v) {
+    std::stringstream s;
+    s <<"Attribute "<< id<<" is not numeric.";
+    throw Fwk::AttributeNotSupportedException(s.str());
+}
 
 namespace Shipping {
 
 using namespace std;
 
+// an attribute name and the id a rep resolves it to
+struct AttributeName {
+    const char* name;
+    Instance::AttributeId id;
+};
+
+static Instance::AttributeId attributeIdOf(const AttributeName* names, size_t count, const string& name) {
+    for (size_t i = 0; i < count; i++) {
+        if (name == names[i].name) return names[i].id;
+    }
+    return 0;
+}
+
+static void attributeNotSupported(const string& name) {
+    stringstream s;
+    s <<"Attribute "<< name<<" not supported.";
+    cerr<<s.str()<<endl;
+    throw Fwk::AttributeNotSupportedException(s.str());
+}
+
 //
 // Rep layer classes
 //
@@ -31,12 +84,50 @@ public:
 
     Network* network() { return network_.ptr(); }
 
+    // Manager methods
+    bool transaction() { return transaction_; }
+    void transactionIs(bool open);
+
+    // Records a change to instance for when the transaction closes; false,
+    // for the change to be made now, if there is no transaction open.
+    // pending is the instance's own, indexed by id, and lets a repeated
+    // change find the one it replaces without a search.
+    bool changeIs(Instance* instance, Instance::AttributeId id, const string& v, vector<size_t>& pending) {
+        if (!transaction_) return false;
+        changeNew(instance, id, pending).value = v;
+        return true;
+    }
+    bool changeIs(Instance* instance, Instance::AttributeId id, double v, vector<size_t>& pending) {
+        if (!transaction_) return false;
+        Change& change = changeNew(instance, id, pending);
+        change.numeric = true;
+        change.number = v;
+        return true;
+    }
+
 private:
+    struct Change {
+        Ptr<Instance> instance;
+        Instance::AttributeId id;
+        bool numeric;
+        string value;
+        double number;
+    };
+    Change& changeNew(Instance* instance, Instance::AttributeId id, vector<size_t>& pending);
+
+    // rep for a location or segment created on the engine directly, as a
+    // Loader does; null if there is none by that name
+    Ptr<Instance> entityRep(const string& name);
+
     Network::Ptr network_;
     Ptr<ConnRep> conn_;
     Ptr<FleetRep> fleet_;
     Ptr<StatsRep> stats_;
-    map<string,Ptr<Instance> > instance_;
+    Fwk::Registry<Ptr<Instance> > instance_;
+    bool transaction_;
+    // whether the network was batching before the transaction opened
+    bool batching_;
+    vector<Change> changes_;
 };
 
 //-------------------------LOCATION-----------------------------------
@@ -55,10 +146,8 @@ public:
 protected:
     Ptr<Location> location_;
     Ptr<Network> network_;
-    int segmentNumber(const string& name);
-
-private:
     Ptr<ManagerImpl> manager_;
+    int segmentNumber(const string& name);
     
 };
 
@@ -122,32 +211,71 @@ public:
         c_ = l;
     }
     
+    enum {
+        transferRateAttribute = 1,
+        shipmentSizeAttribute,
+        destinationAttribute,
+        shipmentPriorityAttribute,
+        shipmentsReceivedAttribute,
+        averageLatencyAttribute,
+        totalCostAttribute
+    };
+
+    AttributeId attributeId(const string& name) {
+        static const AttributeName names[] = {
+            { "Transfer Rate", transferRateAttribute },
+            { "Shipment Size", shipmentSizeAttribute },
+            { "Destination", destinationAttribute },
+            { "Shipment Priority", shipmentPriorityAttribute },
+            { "Shipments Received", shipmentsReceivedAttribute },
+            { "Average Latency", averageLatencyAttribute },
+            { "Total Cost", totalCostAttribute }
+        };
+        return attributeIdOf(names, sizeof(names) / sizeof(names[0]), name);
+    }
+
     void attributeIs(const string& name, const string& value){
-        if (name == "Transfer Rate"){
-            int val = atoi(value.c_str());
-            //cout << c_->name() << " transferRate=" << val << endl;
-            ShipmentCount s = ShipmentCount(val);
-            c_->transferRateIs(s);
-        }
-        else if (name == "Shipment Size"){
-            int val = atoi(value.c_str());
-            //cout << c_->name() << " shipmentSize=" << val << endl;
-            PackageCount s = PackageCount(val);
-            c_->shipmentSizeIs(s);
-        }
-        else if (name == "Destination"){
+        AttributeId id = attributeId(name);
+        if (id == transferRateAttribute || id == shipmentSizeAttribute ||
+            id == destinationAttribute || id == shipmentPriorityAttribute) attributeIs(id, value);
+        else attributeNotSupported(name);
+    }
+
+    void attributeIs(AttributeId id, const string& value){
+        if (id >= transferRateAttribute && id <= shipmentPriorityAttribute &&
+            manager_->changeIs(this, id, value, pending_)) return;
+        if (id == transferRateAttribute || id == shipmentSizeAttribute){
+            attributeValueIs(id, atoi(value.c_str()));
+        }
+        else if (id == destinationAttribute){
             Customer::Ptr loc = dynamic_cast<Customer *>(network_->location(value).ptr());
             c_->destinationIs(loc);
         }
-        else {
-            stringstream s;
-            s <<"Attribute "<< name<<" not supported.";
-            cerr<<s<<endl;
-            throw Fwk::AttributeNotSupportedException(s.str());
+        else if (id == shipmentPriorityAttribute){
+            if (value == "standard") c_->shipmentPriorityIs(Priority::standard());
+            if (value == "expedited") c_->shipmentPriorityIs(Priority::expedited());
+            if (value == "high value") c_->shipmentPriorityIs(Priority::highValue());
         }
+        else Instance::attributeIs(id, value);
+    }
+
+    void attributeValueIs(AttributeId id, double v){
+        if ((id == transferRateAttribute || id == shipmentSizeAttribute) &&
+            manager_->changeIs(this, id, v, pending_)) return;
+        if (id == transferRateAttribute){
+            //cout << c_->name() << " transferRate=" << v << endl;
+            c_->transferRateIs(ShipmentCount((int) v));
+        }
+        else if (id == shipmentSizeAttribute){
+            //cout << c_->name() << " shipmentSize=" << v << endl;
+            c_->shipmentSizeIs(PackageCount((int) v));
+        }
+        else Instance::attributeValueIs(id, v);
     }
 
     string attribute(const string& name) {
+        AttributeId id = attributeId(name);
+        if (id) return attribute(id);
         if(name.substr(0, 7) == "segment"){
             int i = segmentNumber(name);
             if (i != 0) {
@@ -156,40 +284,45 @@ public:
             }
             cerr << "Error with segment #" << i;
         }
-        else if (name == "Transfer Rate"){
-          //(in shipments per day)  
-            ShipmentCount shipperday = c_->transferRate();
-            return shipperday.stringValue();
-        } 
-        else if (name == "Shipment Size"){
-          //(in packages)
-            PackageCount shipsize = c_->shipmentSize();
-            return shipsize.stringValue();   
-        }
-        else if (name == "Destination"){
-            //(an absolute name of a location)
-            Location::Ptr d = c_->destination();
-            return d->name();
-        }
-        else if (name == "Shipments Received"){
-            //read-only; the number of shipments destined for and received by this location
-            ShipmentCount shiprec = c_->shipmentsReceived();
-            return shiprec.stringValue();
-        }
-        else if (name == "Average Latency"){
-            //: read-only; the average virtual time it takes a shipment to make its way from the source to the destination, excluding refused shipments
-            Hours t = c_->avgLatency();
-            return t.stringValue();
-        }
-        else if (name == "Total Cost"){
-            //: read-only; the total cost of all packages that have been received by this location (Groups only)
-            Dollars d = c_->totalCost();
-            return d.stringValue();
-        }
-
         cerr<<"bad input"<<endl;
         return "";
-        
+    }
+
+    string attribute(AttributeId id) {
+        switch (id) {
+            case transferRateAttribute:
+                //(in shipments per day)
+                return c_->transferRate().stringValue();
+            case shipmentSizeAttribute:
+                //(in packages)
+                return c_->shipmentSize().stringValue();
+            case destinationAttribute:
+                //(an absolute name of a location)
+                return c_->destination()->name();
+            case shipmentsReceivedAttribute:
+                //read-only; the number of shipments destined for and received by this location
+                return c_->shipmentsReceived().stringValue();
+            case averageLatencyAttribute:
+                //: read-only; the average virtual time it takes a shipment to make its way from the source to the destination, excluding refused shipments
+                return c_->avgLatency().stringValue();
+            case totalCostAttribute:
+                //: read-only; the total cost of all packages that have been received by this location (Groups only)
+                return c_->totalCost().stringValue();
+            case shipmentPriorityAttribute:
+                return Priority::className(c_->shipmentPriority());
+        }
+        return Instance::attribute(id);
+    }
+
+    double attributeValue(AttributeId id) {
+        switch (id) {
+            case transferRateAttribute: return c_->transferRate().value();
+            case shipmentSizeAttribute: return c_->shipmentSize().value();
+            case shipmentsReceivedAttribute: return c_->shipmentsReceived().value();
+            case averageLatencyAttribute: return c_->avgLatency().value();
+            case totalCostAttribute: return c_->totalCost().value();
+        }
+        return Instance::attributeValue(id);
     }
 
 protected:
@@ -197,6 +330,8 @@ protected:
         network_->customerDel(location_->name());
     }
     Customer::Ptr c_;
+    // where this customer's changes are in the open transaction, by id
+    vector<size_t> pending_;
 
 };
 
@@ -224,8 +359,25 @@ public:
     {
         network_ = n;
     }
-    string attribute(const string& name);
+    enum {
+        sourceAttribute = 1,
+        lengthAttribute,
+        returnSegmentAttribute,
+        difficultyAttribute,
+        expediteSupportAttribute,
+        shipmentsReceivedAttribute,
+        shipmentsRefusedAttribute,
+        capacityAttribute,
+        admissionPolicyAttribute
+    };
+
+    AttributeId attributeId(const string& name);
+    string attribute(const string& name) { return attribute(attributeId(name)); }
+    string attribute(AttributeId id);
     void attributeIs(const string& name, const string& v);
+    void attributeIs(AttributeId id, const string& v);
+    double attributeValue(AttributeId id);
+    void attributeValueIs(AttributeId id, double v);
 protected:
     void onZeroReferences() {
         network_->segmentDel(segment_->name());
@@ -235,6 +387,8 @@ protected:
 private:
     Ptr<ManagerImpl> manager_;
     Ptr<Network> network_;
+    // where this segment's changes are in the open transaction, by id
+    vector<size_t> pending_;
 };
 
 class TruckSegmentRep : public SegmentRep {
@@ -264,50 +418,80 @@ public:
     }
 };
 
-string SegmentRep::attribute(const string& name) {
-    if(name == "source"){
-        Location::Ptr src = segment_->source();
-        if (!src) return "";
-        return src->name();
-    }
-    else if (name == "length"){
-       Mile m = segment_->length();
-       return m.stringValue();
-    }
-    else if (name == "return segment"){
-        Segment::Ptr ret = segment_->returnSegment();
-        if (!ret) return "";
-        return ret->name();
-    }
-    else if (name == "difficulty"){
-        Difficulty diff = segment_ -> difficulty();
-        return diff.stringValue();
-    }
-    else if (name == "expedite support"){
-        Segment::ExpediteSupport es = segment_->expediteSupport();
-        if (es == Segment::expediteSupported()) return "yes";
-        if (es == Segment::expediteNotSupported()) return "no";
-    }
-    else if (name == "Shipments Received"){
-        ShipmentCount s = segment_ -> numShipmentsReceived();
-        return s.stringValue();
-    }
-    else if (name == "Shipments Refused"){
-        ShipmentCount s = segment_ -> numShipmentsRefused();
-        return s.stringValue();
-    }
-    else if (name == "Capacity"){
-        VehicleCount c = segment_ -> numVehicles();
-        return c.stringValue();
-    }
-    
-    cerr<<"bad input"<<endl;
-    return "";
+Instance::AttributeId SegmentRep::attributeId(const string& name) {
+    static const AttributeName names[] = {
+        { "source", sourceAttribute },
+        { "length", lengthAttribute },
+        { "return segment", returnSegmentAttribute },
+        { "difficulty", difficultyAttribute },
+        { "expedite support", expediteSupportAttribute },
+        { "Shipments Received", shipmentsReceivedAttribute },
+        { "Shipments Refused", shipmentsRefusedAttribute },
+        { "Capacity", capacityAttribute },
+        { "admission policy", admissionPolicyAttribute }
+    };
+    return attributeIdOf(names, sizeof(names) / sizeof(names[0]), name);
+}
+
+string SegmentRep::attribute(AttributeId id) {
+    switch (id) {
+        case sourceAttribute:
+        {
+            Location::Ptr src = segment_->source();
+            if (!src) return "";
+            return src->name();
+        }
+        case lengthAttribute:
+            return segment_->length().stringValue();
+        case returnSegmentAttribute:
+        {
+            Segment::Ptr ret = segment_->returnSegment();
+            if (!ret) return "";
+            return ret->name();
+        }
+        case difficultyAttribute:
+            return segment_->difficulty().stringValue();
+        case expediteSupportAttribute:
+        {
+            Segment::ExpediteSupport es = segment_->expediteSupport();
+            if (es == Segment::expediteSupported()) return "yes";
+            if (es == Segment::expediteNotSupported()) return "no";
+            break;
+        }
+        case shipmentsReceivedAttribute:
+            return segment_->numShipmentsReceived().stringValue();
+        case shipmentsRefusedAttribute:
+            return segment_->numShipmentsRefused().stringValue();
+        case capacityAttribute:
+            return segment_->numVehicles().stringValue();
+        case admissionPolicyAttribute:
+            if (segment_->admissionPolicy() == Segment::strictPriority()) return "strict";
+            return "weighted";
+    }
+    return Instance::attribute(id);
 }
 
+double SegmentRep::attributeValue(AttributeId id) {
+    switch (id) {
+        case lengthAttribute: return segment_->length().value();
+        case difficultyAttribute: return segment_->difficulty().value();
+        case shipmentsReceivedAttribute: return segment_->numShipmentsReceived().value();
+        case shipmentsRefusedAttribute: return segment_->numShipmentsRefused().value();
+        case capacityAttribute: return segment_->numVehicles().value();
+    }
+    return Instance::attributeValue(id);
+}
 
 void SegmentRep::attributeIs(const string& name, const string& v) {
-    if(name == "source") {
+    AttributeId id = attributeId(name);
+    if (!id || id == shipmentsReceivedAttribute || id == shipmentsRefusedAttribute) attributeNotSupported(name);
+    attributeIs(id, v);
+}
+
+void SegmentRep::attributeIs(AttributeId id, const string& v) {
+    if (id && id <= admissionPolicyAttribute && id != shipmentsReceivedAttribute &&
+        id != shipmentsRefusedAttribute && manager_->changeIs(this, id, v, pending_)) return;
+    if(id == sourceAttribute) {
         if (v==""){
             segment_->sourceIs(Location::Ptr());
         }
@@ -319,30 +503,21 @@ void SegmentRep::attributeIs(const string& name, const string& v) {
             }
         }
     }
-    else if (name == "length"){
-       float m = atof(v.c_str());
-       if (m < 0) return;
-       Mile mi = Mile(m);
-       segment_->lengthIs(mi);
+    else if (id == lengthAttribute || id == difficultyAttribute){
+        attributeValueIs(id, atof(v.c_str()));
     }
-    else if (name == "return segment"){
+    else if (id == returnSegmentAttribute){
         Segment::Ptr seg = network_ -> segment(v);
         segment_->returnSegmentIs(seg);
     }
-    else if (name == "difficulty"){
-        float d = atof(v.c_str());
-        if (d < 1.f || d > 5.f) return;
-        Difficulty diff = Difficulty(d);
-        segment_->difficultyIs(diff);
+    else if (id == capacityAttribute){
+        attributeValueIs(id, atoi(v.c_str()));
     }
-    else if (name == "Capacity"){
-        int c = atoi(v.c_str());
-        if (c < 0) return;
-        VehicleCount count = VehicleCount(c);
-        segment_->numVehiclesIs(count);
-
+    else if (id == admissionPolicyAttribute){
+        if (v == "strict") segment_->admissionPolicyIs(Segment::strictPriority());
+        if (v == "weighted") segment_->admissionPolicyIs(Segment::weightedFair());
     }
-    else if (name == "expedite support"){
+    else if (id == expediteSupportAttribute){
         if (v == "yes" && segment_->expediteSupport() == Segment::expediteNotSupported()) {
             network_->expediteSupportIs(segment_->name(), Segment::expediteSupported());
         }
@@ -350,13 +525,28 @@ void SegmentRep::attributeIs(const string& name, const string& v) {
             network_->expediteSupportIs(segment_->name(), Segment::expediteNotSupported());
         }    
     }
-    else {
-        stringstream s;
-        s <<"Attribute "<< name<<" not supported.";
-        cerr<<s<<endl;
-        throw Fwk::AttributeNotSupportedException(s.str());
-    }
+    else Instance::attributeIs(id, v);
+}
 
+void SegmentRep::attributeValueIs(AttributeId id, double v) {
+    if ((id == lengthAttribute || id == difficultyAttribute || id == capacityAttribute) &&
+        manager_->changeIs(this, id, v, pending_)) return;
+    if (id == lengthAttribute){
+       float m = v;
+       if (m < 0) return;
+       segment_->lengthIs(Mile(m));
+    }
+    else if (id == difficultyAttribute){
+        float d = v;
+        if (d < 1.f || d > 5.f) return;
+        segment_->difficultyIs(Difficulty(d));
+    }
+    else if (id == capacityAttribute){
+        int c = (int) v;
+        if (c < 0) return;
+        segment_->numVehiclesIs(VehicleCount(c));
+    }
+    else Instance::attributeValueIs(id, v);
 }
 
 
@@ -365,22 +555,120 @@ void SegmentRep::attributeIs(const string& name, const string& v) {
 class StatsRep : public Instance {
 public:
     StatsRep(const string& name, ManagerImpl* manager, Ptr<Statistics> s) :
-        Instance(name), manager_(manager)
+        Instance(name), manager_(manager), sampleCapacity_(4096)
     {
         statistics_ = s;
 
     }
     string attribute(const string& name);
-    void attributeIs(const string& name, const string& v) {
-    }
+    void attributeIs(const string& name, const string& v);
     ~StatsRep(){
         //do nothing
     }
 private:
+    string percentileAttribute(const string& name);
     Ptr<ManagerImpl> manager_;
     Ptr<Statistics> statistics_;
+    Ptr<Sampler> sampler_;
+    size_t sampleCapacity_;
+    Ptr<MetricsExporter> exporter_;
+    Ptr<Tracer> tracer_;
 };
 
+void StatsRep::attributeIs(const string& name, const string& v) {
+    if (name == "sample capacity"){
+        // rows kept per column; only applies to a sampler not yet started
+        int c = atoi(v.c_str());
+        if (c > 0) sampleCapacity_ = c;
+    }
+    else if (name == "sample interval"){
+        double interval = atof(v.c_str());
+        if (interval < 0) return;
+        // restarts a sampler stopped by an interval of 0
+        if (sampler_) sampler_->intervalIs(interval);
+        else if (interval > 0) sampler_ = Sampler::SamplerNew(manager_->network(), interval, sampleCapacity_);
+    }
+    else if (name == "metrics port"){
+        // serve on 127.0.0.1:<port> (0 picks a free port); negative stops
+        char *end;
+        errno = 0;
+        long port = strtol(v.c_str(), &end, 10);
+        if (v.empty() || *end != '\0' || errno == ERANGE || port > 65535) {
+            cerr<<"StatsRep::attributeIs() invalid metrics port "<<v<<endl;
+            return;
+        }
+        exporter_ = Ptr<MetricsExporter>();
+        if (port < 0) return;
+        try {
+            exporter_ = MetricsExporter::MetricsExporterNew(manager_->network(), port);
+        } catch (Fwk::Exception &e) {
+            cerr<<"StatsRep::attributeIs() cannot serve metrics on port "<<v<<": "<<e.what()<<endl;
+        }
+    }
+    else if (name == "trace file"){
+        // a path starts a trace there; "" finishes the current one
+        if (tracer_) {
+            manager_->network()->tracerIs(0);
+            tracer_->closeIs();
+            tracer_ = Ptr<Tracer>();
+        }
+        if (v.empty()) return;
+        tracer_ = Tracer::TracerNew(v);
+        if (!tracer_->ok()){
+            cerr<<"StatsRep::attributeIs() cannot open "<<v<<endl;
+            tracer_ = Ptr<Tracer>();
+            return;
+        }
+        manager_->network()->tracerIs(tracer_.ptr());
+    }
+    else if (name == "sample csv file" || name == "sample binary file"){
+        if (!sampler_) return;
+        bool csv = name == "sample csv file";
+        ofstream out(v.c_str(), csv ? ios::out : ios::out | ios::binary);
+        if (!out){
+            cerr<<"StatsRep::attributeIs() cannot open "<<v<<endl;
+            return;
+        }
+        if (csv) sampler_->csvIs(out);
+        else sampler_->binaryIs(out);
+    }
+}
+
+
+// "latency p95" (all shipments), "latency p95 <customer>",
+// "wait p99" (all shipments), "wait p99 <segment>"
+string StatsRep::percentileAttribute(const string& name){
+    bool latency = name.substr(0, 9) == "latency p";
+    size_t start = latency ? 9 : 6;
+    size_t space = name.find(' ', start);
+    double p = atof(name.substr(start, space - start).c_str());
+    if (p <= 0 || p > 100){
+        cerr<<"bad input"<<endl;
+        return "";
+    }
+
+    const Histogram *h = latency ? &statistics_->latency() : &statistics_->wait();
+    if (space != string::npos){
+        string entity = name.substr(space + 1);
+        if (latency){
+            Customer *c = dynamic_cast<Customer *>(manager_->network()->location(entity).ptr());
+            if (!c){
+                cerr<<"bad input"<<endl;
+                return "";
+            }
+            h = &c->latencyHistogram();
+        }
+        else{
+            Segment::Ptr seg = manager_->network()->segment(entity);
+            if (!seg){
+                cerr<<"bad input"<<endl;
+                return "";
+            }
+            h = &seg->waitHistogram();
+        }
+    }
+    return NumberConverter<float>::toString((float) h->percentile(p));
+}
 
 string StatsRep::attribute(const string& name){
     int v = -1;
@@ -421,6 +709,34 @@ string StatsRep::attribute(const string& name){
     else if (name == "shipment output") {
         return statistics_->simulationShipmentStats();
     }
+    else if (name == "summary output") {
+        return statistics_->simulationSummary();
+    }
+    else if (name == "instrument output") {
+        return Instrument::report();
+    }
+    else if (name == "metrics port"){
+        if (!exporter_) return "";
+        return NumberConverter<size_t>::toString(exporter_->port());
+    }
+    else if (name == "sample csv"){
+        if (!sampler_) return "";
+        stringstream out;
+        sampler_->csvIs(out);
+        return out.str();
+    }
+    else if (name.substr(0, 9) == "latency p" || name.substr(0, 6) == "wait p"){
+        return percentileAttribute(name);
+    }
+    else if (name.substr(0, 18) == "latency histogram "){
+        string c = name.substr(18);
+        for (size_t i = 0; i < Priority::classes; i++) {
+            if (c == Priority::className((Priority::Class) i))
+                return statistics_->latency((Priority::Class) i).stringValue();
+        }
+        cerr<<"bad input"<<endl;
+        return "";
+    }
     else {
         cerr<<"bad input"<<endl;
         return "";
@@ -450,6 +766,24 @@ public:
         if (name == "routing algorithm"){
             if (v == "dijkstra") connectivity_->routingMethodIs(Connectivity::dijkstra());
             if (v == "BFS") connectivity_ -> routingMethodIs(Connectivity::bfs());
+            if (v == "congestion") connectivity_->routingMethodIs(Connectivity::congestion());
+        }
+        else if (name == "wait policy"){
+            if (v == "queue") connectivity_->waitPolicyIs(Connectivity::waitQueue());
+            if (v == "retry") connectivity_->waitPolicyIs(Connectivity::waitRetry());
+        }
+        else if (name == "shipment splitting"){
+            if (v == "yes") connectivity_->shipmentSplittingIs(Connectivity::splittingEnabled());
+            if (v == "no") connectivity_->shipmentSplittingIs(Connectivity::splittingDisabled());
+        }
+        else if (name == "random seed"){
+            U64 seed = 0;
+            stringstream s(v);
+            if (!(s >> seed)) {
+                cerr<<"bad input"<<endl;
+                return;
+            }
+            network_->randomSeedIs(seed);
         }
         else{
             stringstream s;
@@ -546,6 +880,19 @@ void getStartStop(string n, string &start, string &stop){
 
 string ConnRep::attribute(const string& name) {
     string returnval = "";
+    if (name == "wait policy"){
+        if (connectivity_->waitPolicy() == Connectivity::waitRetry()) return "retry";
+        return "queue";
+    }
+    if (name == "shipment splitting"){
+        if (connectivity_->shipmentSplitting() == Connectivity::splittingEnabled()) return "yes";
+        return "no";
+    }
+    if (name == "random seed"){
+        stringstream s;
+        s << network_->randomSeed();
+        return s.str();
+    }
     string task = getTask(name);
     if (task=="connect"){
         string start = "";
@@ -610,147 +957,252 @@ public:
     {
         fleet_ = f;
     }
-    string attribute(const string& name);
+    // an attribute's id is 1 + mode * properties + property
+    enum Property {
+        speed,
+        speedDay,
+        speedNight,
+        cost,
+        costDay,
+        costNight,
+        capacity,
+        capacityDay,
+        capacityNight,
+        departureTimeout,
+        properties
+    };
+
+    AttributeId attributeId(const string& name);
+    string attribute(const string& name) { return attribute(attributeId(name)); }
+    string attribute(AttributeId id);
     void attributeIs(const string& name, const string& v);
+    void attributeIs(AttributeId id, const string& v);
+    double attributeValue(AttributeId id);
+    void attributeValueIs(AttributeId id, double v);
     Ptr<Fleet> fleet(){ return fleet_; }
 
 private:
     Ptr<ManagerImpl> manager_;
     Ptr<Fleet> fleet_;
-    void getModeAndProperty(const string& name, string &mode, string& property);
+    // where the fleet's changes are in the open transaction, by id
+    vector<size_t> pending_;
+    // false for an id that is not a fleet attribute's
+    bool modeAndProperty(AttributeId id, Segment::Mode& mode, Property& property);
 };
 
-void FleetRep::getModeAndProperty(const string& name, string& mode, string& property){
-    size_t commaindex = name.find(',');
-    if (commaindex==string::npos){
-        cerr<<"bad input"<<endl;
-        return;
+Instance::AttributeId FleetRep::attributeId(const string& name){
+    static const char* modes[] = { "Truck", "Boat", "Plane" };
+    static const char* propertyNames[properties] = {
+        "speed", "speed day", "speed night",
+        "cost", "cost day", "cost night",
+        "capacity", "capacity day", "capacity night",
+        "departure timeout"
+    };
+    size_t commaindex = name.find(", ");
+    if (commaindex == string::npos) return 0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++){
+        if (name.compare(0, commaindex, modes[m]) != 0) continue;
+        for (size_t p = 0; p < properties; p++){
+            if (name.compare(commaindex + 2, string::npos, propertyNames[p]) == 0) return 1 + m * properties + p;
+        }
     }
-    mode = name.substr(0, commaindex);
-    property = name.substr(commaindex + 2, name.length());
+    return 0;
 }
 
-string FleetRep::attribute(const string& name){
-    string mode, property;
-    getModeAndProperty(name, mode, property);
+bool FleetRep::modeAndProperty(AttributeId id, Segment::Mode& mode, Property& property){
+    if (id == 0 || id > 3 * properties) return false;
+    static const Segment::Mode modes[] = { Segment::truck(), Segment::boat(), Segment::plane() };
+    mode = modes[(id - 1) / properties];
+    property = (Property) ((id - 1) % properties);
+    return true;
+}
 
+string FleetRep::attribute(AttributeId id){
     Segment::Mode m;
-    if (mode == "Truck"){
-        m = Segment::truck();
-    } else if (mode == "Boat"){
-        m = Segment::boat();
-    } else if (mode == "Plane"){
-        m = Segment::plane();
-    } else {
-        cerr<<"bad input"<<endl;
-        return "";
-    }
+    Property property;
+    if (!modeAndProperty(id, m, property)) return Instance::attribute(id);
 
-    if (property=="speed"){
-        return (fleet_ -> speed(m)).stringValue();
-    }else if (property=="speed day"){
-        return (fleet_ -> speed(m, Fleet::day()).stringValue());
-    }else if (property == "speed night"){
-        return (fleet_ -> speed(m, Fleet::night()).stringValue());
-    }
+    switch (property){
+        case speed: return (fleet_ -> speed(m)).stringValue();
+        case speedDay: return (fleet_ -> speed(m, Fleet::day()).stringValue());
+        case speedNight: return (fleet_ -> speed(m, Fleet::night()).stringValue());
 
-    else if (property == "cost"){
-        return fleet_ -> costPerMile(m).stringValue();
-    }else if (property == "cost day"){
-        return fleet_ -> costPerMile(m, Fleet::day()).stringValue();
-    }else if (property == "cost night"){
-        return fleet_ -> costPerMile(m, Fleet::night()).stringValue();
-    }
+        case cost: return fleet_ -> costPerMile(m).stringValue();
+        case costDay: return fleet_ -> costPerMile(m, Fleet::day()).stringValue();
+        case costNight: return fleet_ -> costPerMile(m, Fleet::night()).stringValue();
 
-    else if (property== "capacity"){
-        return fleet_ -> capacity(m).stringValue();
-    }else if (property == "capacity day"){
-        return fleet_ -> capacity(m, Fleet::day()).stringValue();
-    }else if (property == "capacity night"){
-        return fleet_ -> capacity(m, Fleet::night()).stringValue();
+        case capacity: return fleet_ -> capacity(m).stringValue();
+        case capacityDay: return fleet_ -> capacity(m, Fleet::day()).stringValue();
+        case capacityNight: return fleet_ -> capacity(m, Fleet::night()).stringValue();
+
+        case departureTimeout: return fleet_ -> departureTimeout(m).stringValue();
+        default: return Instance::attribute(id);
     }
+}
 
-    else{
-        cerr<<"bad input"<<endl;
-        return "";
+double FleetRep::attributeValue(AttributeId id){
+    Segment::Mode m;
+    Property property;
+    if (!modeAndProperty(id, m, property)) return Instance::attributeValue(id);
+
+    switch (property){
+        case speed: return fleet_ -> speed(m).value();
+        case speedDay: return fleet_ -> speed(m, Fleet::day()).value();
+        case speedNight: return fleet_ -> speed(m, Fleet::night()).value();
+
+        case cost: return fleet_ -> costPerMile(m).value();
+        case costDay: return fleet_ -> costPerMile(m, Fleet::day()).value();
+        case costNight: return fleet_ -> costPerMile(m, Fleet::night()).value();
+
+        case capacity: return fleet_ -> capacity(m).value();
+        case capacityDay: return fleet_ -> capacity(m, Fleet::day()).value();
+        case capacityNight: return fleet_ -> capacity(m, Fleet::night()).value();
+
+        case departureTimeout: return fleet_ -> departureTimeout(m).value();
+        default: return Instance::attributeValue(id);
     }
 }
 
 void FleetRep::attributeIs(const string& name, const string& v) {
-    string mode, property;
-    getModeAndProperty(name, mode, property);
+    AttributeId id = attributeId(name);
+    if (!id) attributeNotSupported(name);
+    attributeIs(id, v);
+}
 
+void FleetRep::attributeIs(AttributeId id, const string& v) {
+    Segment::Mode m;
+    Property property;
+    if (!modeAndProperty(id, m, property)) Instance::attributeIs(id, v);
+    else if (manager_->changeIs(this, id, v, pending_)) return;
+    else if (property == capacity || property == capacityDay || property == capacityNight) {
+        attributeValueIs(id, atoi(v.c_str()));
+    }
+    else attributeValueIs(id, atof(v.c_str()));
+}
 
+void FleetRep::attributeValueIs(AttributeId id, double v) {
     Segment::Mode m;
-    if (mode == "Truck"){
-        m = Segment::truck();
-    } else if (mode == "Boat"){
-        m = Segment::boat();
-    } else if (mode == "Plane"){
-        m = Segment::plane();
-    } else {
-       stringstream s;
-        s <<"Attribute "<< name<<" not supported.";
-        cerr<<s<<endl;
-        throw Fwk::AttributeNotSupportedException(s.str());
+    Property property;
+    if (!modeAndProperty(id, m, property)) {
+        Instance::attributeValueIs(id, v);
+        return;
     }
+    if (manager_->changeIs(this, id, v, pending_)) return;
 
-    if (property=="speed"){
-        float f = atof(v.c_str());
-        if (f < 0) return;
-        MilesPerHour mph = MilesPerHour(f);
-        fleet_ -> speedIs(m, mph, Fleet::day());
-        fleet_ -> speedIs(m, mph, Fleet::night());
-    }else if(property=="speed day"){
-        float f = atof(v.c_str());
-        if (f < 0) return;
-        MilesPerHour mph = MilesPerHour(f);
-        fleet_ -> speedIs(m, mph, Fleet::day());
-    }else if(property=="speed night"){
-        float f = atof(v.c_str());
-        if (f < 0) return;
-        MilesPerHour mph = MilesPerHour(f);
-        fleet_ -> speedIs(m, mph, Fleet::night());
-    }
-
-    else if (property == "cost"){
-        float f = atof(v.c_str());
-        if (f < 0) return;
-        Dollars d = Dollars(f);
-        fleet_ -> costPerMileIs(m, d, Fleet::day());
-        fleet_ -> costPerMileIs(m, d, Fleet::night());
-    }else if (property == "cost day"){
-        float f = atof(v.c_str());
-        if (f < 0) return;
-        Dollars d = Dollars(f);
-        fleet_ -> costPerMileIs(m, d, Fleet::day());
-    }else if (property == "cost night"){
-        float f = atof(v.c_str());
-        if (f < 0) return;
-        Dollars d = Dollars(f);
-        fleet_ -> costPerMileIs(m, d, Fleet::night());
-    }
-
-    else if (property== "capacity"){
-        int c = atoi(v.c_str());
-        if (c < 0) return;
-        PackageCount p = PackageCount(c);
-        fleet_ -> capacityIs(m, p, Fleet::day());
-        fleet_ -> capacityIs(m, p, Fleet::night());
-    }else if (property == "capacity day"){
-        int c = atoi(v.c_str());
+    if (property == capacity || property == capacityDay || property == capacityNight){
+        int c = (int) v;
         if (c < 0) return;
         PackageCount p = PackageCount(c);
-        fleet_ -> capacityIs(m, p, Fleet::day());
-    }else if (property == "capacity night"){
-        int c = atoi(v.c_str());
-        if (c < 0) return;
-        PackageCount p = PackageCount(c);
-        fleet_ -> capacityIs(m, p, Fleet::night());
+        if (property != capacityNight) fleet_ -> capacityIs(m, p, Fleet::day());
+        if (property != capacityDay) fleet_ -> capacityIs(m, p, Fleet::night());
+        return;
+    }
+
+    float f = v;
+    if (f < 0) return;
+    switch (property){
+        case speed:
+            fleet_ -> speedIs(m, MilesPerHour(f), Fleet::day());
+            fleet_ -> speedIs(m, MilesPerHour(f), Fleet::night());
+            break;
+        case speedDay: fleet_ -> speedIs(m, MilesPerHour(f), Fleet::day()); break;
+        case speedNight: fleet_ -> speedIs(m, MilesPerHour(f), Fleet::night()); break;
+
+        case cost:
+            fleet_ -> costPerMileIs(m, Dollars(f), Fleet::day());
+            fleet_ -> costPerMileIs(m, Dollars(f), Fleet::night());
+            break;
+        case costDay: fleet_ -> costPerMileIs(m, Dollars(f), Fleet::day()); break;
+        case costNight: fleet_ -> costPerMileIs(m, Dollars(f), Fleet::night()); break;
+
+        case departureTimeout: fleet_ -> departureTimeoutIs(m, Hours(f)); break;
+        default: break;
+    }
+}
+
+//----------------------LOADER----------------------------------------
+
+class LoaderRep : public Instance {
+public:
+    LoaderRep(const string& name, ManagerImpl* manager, Ptr<Loader> l) :
+        Instance(name), manager_(manager)
+    {
+        loader_ = l;
     }
+    string attribute(const string& name);
+    void attributeIs(const string& name, const string& v);
+
+private:
+    Ptr<ManagerImpl> manager_;
+    Ptr<Loader> loader_;
+    Ptr<Checkpoint> checkpoint_;
+};
 
+string LoaderRep::attribute(const string& name){
+    if (name == "checkpoint" || name == "checkpoint wait"){
+        if (!checkpoint_) return "none";
+        // "checkpoint wait" blocks until the writing child has exited
+        Checkpoint::Status status = name == "checkpoint" ? checkpoint_->status() : checkpoint_->checkpointWait();
+        if (status == Checkpoint::writing()) return "writing";
+        if (status == Checkpoint::written()) return "written";
+        if (status == Checkpoint::failed()) return "failed";
+        return "none";
+    }
+    size_t v;
+    if (name == "locations") v = loader_->locations();
+    else if (name == "segments") v = loader_->segments();
+    else if (name == "demands") v = loader_->demands();
+    else if (name == "errors") v = loader_->errors();
+    else {
+        cerr<<"bad input"<<endl;
+        return "";
+    }
+    stringstream s;
+    s << v;
+    return s.str();
+}
 
-    else{
+void LoaderRep::attributeIs(const string& name, const string& v) {
+    if (name == "csv file" || name == "binary file"){
+        bool csv = name == "csv file";
+        ifstream in(v.c_str(), csv ? ios::in : ios::in | ios::binary);
+        if (!in){
+            cerr<<"LoaderRep::attributeIs() cannot open "<<v<<endl;
+            return;
+        }
+        try {
+            if (csv) loader_->csvIs(in);
+            else loader_->binaryIs(in);
+        } catch (Fwk::Exception &e) {
+            cerr<<"LoaderRep::attributeIs() cannot load "<<v<<": "<<e.what()<<endl;
+        }
+    }
+    else if (name == "binary output file"){
+        ofstream out(v.c_str(), ios::out | ios::binary);
+        if (!out){
+            cerr<<"LoaderRep::attributeIs() cannot open "<<v<<endl;
+            return;
+        }
+        loader_->binaryWrite(out);
+    }
+    else if (name == "snapshot file" || name == "snapshot output file"){
+        try {
+            if (name == "snapshot file") loader_->snapshotIs(v);
+            else loader_->snapshotWrite(v);
+        } catch (Fwk::Exception &e) {
+            cerr<<"LoaderRep::attributeIs() cannot use snapshot "<<v<<": "<<e.what()<<endl;
+        }
+    }
+    else if (name == "checkpoint file" || name == "checkpoint output file"){
+        if (!checkpoint_) checkpoint_ = Checkpoint::CheckpointNew(manager_->network());
+        try {
+            if (name == "checkpoint file") checkpoint_->restoreIs(v);
+            else checkpoint_->checkpointIs(v);
+        } catch (Fwk::Exception &e) {
+            cerr<<"LoaderRep::attributeIs() cannot use checkpoint "<<v<<": "<<e.what()<<endl;
+        }
+    }
+    else {
         stringstream s;
         s <<"Attribute "<< name<<" not supported.";
         cerr<<s<<endl;
@@ -760,9 +1212,50 @@ void FleetRep::attributeIs(const string& name, const string& v) {
 
 //---------------------MANAGER-----------------------------------------------
 
-ManagerImpl::ManagerImpl() : network_(Network::NetworkNew("network"))
+ManagerImpl::ManagerImpl() : network_(Network::NetworkNew("network")),
+    transaction_(false), batching_(false)
 {}
 
+ManagerImpl::Change& ManagerImpl::changeNew(Instance* instance, Instance::AttributeId id, vector<size_t>& pending) {
+    if (pending.size() <= id) pending.resize(id + 1, ~(size_t) 0);
+    // an entry left from an earlier transaction points at some other change
+    size_t index = pending[id];
+    if (index < changes_.size() && changes_[index].instance.ptr() == instance && changes_[index].id == id) {
+        Change& change = changes_[index];
+        change.numeric = false;
+        return change;
+    }
+    pending[id] = changes_.size();
+    changes_.push_back(Change());
+    Change& change = changes_.back();
+    change.instance = instance;
+    change.id = id;
+    change.numeric = false;
+    return change;
+}
+
+void ManagerImpl::transactionIs(bool open) {
+    if (open == transaction_) return;
+    transaction_ = open;
+    if (open) {
+        batching_ = network_->batching();
+        network_->batchingIs(true);
+        return;
+    }
+    vector<Change> changes;
+    changes.swap(changes_);
+    try {
+        for (size_t i = 0; i < changes.size(); i++) {
+            if (changes[i].numeric) changes[i].instance->attributeValueIs(changes[i].id, changes[i].number);
+            else changes[i].instance->attributeIs(changes[i].id, changes[i].value);
+        }
+    } catch (...) {
+        network_->batchingIs(batching_);
+        throw;
+    }
+    network_->batchingIs(batching_);
+}
+
 
 Ptr<Instance> ManagerImpl::instanceNew(const string& name, const string& type) {
     if (instance(name)) return NULL;
@@ -770,93 +1263,99 @@ Ptr<Instance> ManagerImpl::instanceNew(const string& name, const string& type) {
     if(!fleet_){
         Ptr<Fleet> fleet = network_->fleetNew("fleet");
         fleet_ = new FleetRep("fleet", this, fleet);
-        instance_["fleet"] = fleet_;
+        instance_.memberIs("fleet", fleet_);
     }
     if(!stats_){
         Ptr<Statistics> stats = network_->statisticsNew("stats");
         stats->notifierIs(network_);
         stats_ = new StatsRep("stats", this, stats);
-        instance_["stats"] = stats_;
+        instance_.memberIs("stats", stats_);
     }
     if(!conn_){
         Ptr<Connectivity> conn = network_->connectivityNew("conn");
         conn->fleetIs(fleet_->fleet());
         conn_ = new ConnRep("conn", this, network_, conn);
-        instance_["conn"] = conn_;
+        instance_.memberIs("conn", conn_);
     }
 
 
     if(type == "Customer"){
         Ptr<Customer> l = network_->customerNew(name);
         Ptr<CustomerRep> c = new CustomerRep(name, this, l, network_);
-        instance_[name] = c;
+        instance_.memberIs(name, c);
         return c;
     }
  
     else if(type == "Port"){
         Ptr<Location> l = network_->portNew(name);
         Ptr<PortRep> p = new PortRep(name, this, l, network_);
-        instance_[name] = p;
+        instance_.memberIs(name, p);
         return p;
     }
 
     else if (type == "Truck terminal") {
         Ptr<Location> l = network_->terminalNew(name, Segment::truck());
         Ptr<TerminalRep> t = new TerminalRep(name, this, l, network_);
-        instance_[name] = t;
+        instance_.memberIs(name, t);
         return t;
     }
 
     else if (type == "Boat terminal"){
         Ptr<Location> l = network_->terminalNew(name, Segment::boat());
         Ptr<TerminalRep> t = new TerminalRep(name, this, l, network_);
-        instance_[name] = t;
+        instance_.memberIs(name, t);
         return t;
     }
 
     else if (type == "Plane terminal"){
         Ptr<Location> l = network_->terminalNew(name, Segment::plane());
         Ptr<TerminalRep> t = new TerminalRep(name, this, l, network_);
-        instance_[name] = t;
+        instance_.memberIs(name, t);
         return t;
     }
 
     else if (type == "Truck segment"){
         Ptr<Segment> seg = network_->segmentNew(name, Segment::truck());
         Ptr<TruckSegmentRep> s = new TruckSegmentRep(name, this, network_, seg);
-        instance_[name] = s;
+        instance_.memberIs(name, s);
         return s;
     }
 
     else if (type == "Boat segment"){
         Ptr<Segment> seg = network_->segmentNew(name, Segment::boat());
         Ptr<BoatSegmentRep> s = new BoatSegmentRep(name, this, network_, seg);
-        instance_[name] = s;
+        instance_.memberIs(name, s);
         return s;
     }
 
     else if (type == "Plane segment"){
         Ptr<Segment> seg = network_->segmentNew(name, Segment::plane());
         Ptr<PlaneSegmentRep> s = new PlaneSegmentRep(name, this, network_, seg);
-        instance_[name] = s;
+        instance_.memberIs(name, s);
         return s;
     }
 
     else if (type == "Stats"){
-        instance_[name] = stats_;
+        instance_.memberIs(name, stats_);
         return stats_;
     }
 
     else if (type == "Conn"){
-        instance_[name] = conn_;
+        instance_.memberIs(name, conn_);
         return conn_;
     }
 
     else if (type == "Fleet"){
-        instance_[name] = fleet_;
+        instance_.memberIs(name, fleet_);
         return fleet_;
     }
 
+    else if (type == "Loader"){
+        Ptr<LoaderRep> l = new LoaderRep(name, this, Loader::LoaderNew(network_.ptr()));
+        instance_.memberIs(name, l);
+        return l;
+    }
+
     stringstream s;
     s <<"Attribute "<< type<<" not supported.";
     cerr<<s<<endl;
@@ -866,16 +1365,42 @@ Ptr<Instance> ManagerImpl::instanceNew(const string& name, const string& type) {
 
 
 Ptr<Instance> ManagerImpl::instance(const string& name) {
-    map<string,Ptr<Instance> >::const_iterator t = instance_.find(name);
+    Fwk::Registry<Ptr<Instance> >::Handle t = instance_.handle(name);
+
+    return t == instance_.none() ? entityRep(name) : instance_.member(t);
 
-    return t == instance_.end() ? Ptr<Instance>() : (*t).second;
+}
 
+Ptr<Instance> ManagerImpl::entityRep(const string& name) {
+    Ptr<Instance> rep;
+    Location::Ptr l = network_->location(name);
+    Segment::Ptr seg = l ? Segment::Ptr() : network_->segment(name);
+    if (l && l->locationType() == Location::customer()) {
+        rep = new CustomerRep(name, this, dynamic_cast<Customer *>(l.ptr()), network_);
+    }
+    else if (l && l->locationType() == Location::port()) {
+        rep = new PortRep(name, this, l, network_);
+    }
+    else if (l) {
+        rep = new TerminalRep(name, this, l, network_);
+    }
+    else if (seg && seg->mode() == Segment::truck()) {
+        rep = new TruckSegmentRep(name, this, network_, seg);
+    }
+    else if (seg && seg->mode() == Segment::boat()) {
+        rep = new BoatSegmentRep(name, this, network_, seg);
+    }
+    else if (seg) {
+        rep = new PlaneSegmentRep(name, this, network_, seg);
+    }
+    if (rep) instance_.memberIs(name, rep);
+    return rep;
 }
 
 void ManagerImpl::instanceDel(const string& name) {
     Ptr<Instance> entityToDel = instance(name);
     if (entityToDel != fleet_ && entityToDel != stats_ && entityToDel != conn_) {
-        instance_.erase(name);
+        instance_.memberDel(name);
         entityToDel->referencesDec(entityToDel->references());
     }
 }
@@ -41,6 +41,34 @@ public:
     ///
     virtual void attributeIs(const string& name, const string& v) = 0;
 
+    ///
+    /// Attributes can also be named by an id, resolved from the name once
+    /// with attributeId and then passed to the calls below, which neither
+    /// compare names nor, for the numeric ones, convert values to and from
+    /// strings. Ids are only meaningful to instances of the type that
+    /// resolved them (any "Truck segment" for an id one truck segment
+    /// returned); 0 means the instance does not resolve the name, in which
+    /// case the string calls above still apply.
+    ///
+    typedef unsigned AttributeId;
+    virtual AttributeId attributeId(const string& attributeName) {
+        return 0;
+    }
+
+    ///
+    /// The same as attribute and attributeIs with the id's name.
+    ///
+    virtual string attribute(AttributeId id);
+    virtual void attributeIs(AttributeId id, const string& v);
+
+    ///
+    /// The value of a numeric attribute as a number, and setting it from
+    /// one, without going through strings. Attributes that are not numbers
+    /// read as 0 and cannot be set this way.
+    ///
+    virtual double attributeValue(AttributeId id);
+    virtual void attributeValueIs(AttributeId id, double v);
+
     // See full definition below.
     class Manager;
 
@@ -91,6 +119,20 @@ public:
     ///
     virtual void instanceDel(const string& name) = 0;
 
+    ///
+    /// While a transaction is open, attributeIs and attributeValueIs on
+    /// segment, customer and fleet instances check the attribute and
+    /// record the change instead of making it, a later change to the same
+    /// attribute of the same instance replacing an earlier one. Entities
+    /// created meanwhile are not announced to the rest of the network.
+    /// Closing the transaction applies each recorded change once, in the
+    /// order first made, and then sends the notifications they and the
+    /// new entities cause, coalesced so that each customer tells its
+    /// reactors about each changed attribute once.
+    ///
+    virtual bool transaction() = 0;
+    virtual void transactionIs(bool open) = 0;
+
 };
 
 ///
@@ -111,6 +153,7 @@ public:
 ///     "Stats"
 ///     "Conn"
 ///     "Fleet"
+///     "Loader"
 ///
 /// The returned instances for Customer, Port, and the terminal types
 /// are referred to as location instances, and support attributes
@@ -178,6 +221,30 @@ public:
 /// The Stats, Conn and Fleet types are special in that the manager
 /// only allows one instance of each type to exist at any given time.
 ///
+/// A Loader instance builds network entities in bulk from a file (see
+/// Loader.h for the formats). Setting its "csv file" or "binary file"
+/// attribute to a path loads that file; setting "binary output file"
+/// writes the whole network out in the binary format. The "locations",
+/// "segments", "demands" and "errors" attributes count what it has read.
+/// Loaded entities are available through instance() like any other.
+/// "snapshot output file" writes the network together with its
+/// precomputed routes, and "snapshot file" loads such a snapshot so that
+/// starting the simulation does not search for the routes again.
+/// "checkpoint output file" starts writing a checkpoint of the running
+/// simulation in the background (see Checkpoint.h), and "checkpoint"
+/// reads back as "none", "writing", "written" or "failed"; "checkpoint
+/// file" restores one into a network that has no entities yet. The Conn
+/// instance's "random seed" seeds the engine's random numbers, so that
+/// runs that use them can be repeated.
+///
+/// Segment, Customer and Fleet instances resolve their attribute names to
+/// ids (Instance::attributeId). Of those, a segment's "length",
+/// "difficulty", "Capacity", "Shipments Received" and "Shipments Refused",
+/// a customer's "Transfer Rate", "Shipment Size", "Shipments Received",
+/// "Average Latency" and "Total Cost", and every fleet attribute are
+/// numeric and can be read and set with attributeValue and
+/// attributeValueIs.
+///
 extern Ptr<Instance::Manager> shippingInstanceManager();
 
 #endif
@@ -0,0 +1,130 @@
+#include "Instrument.h"
+#include <sstream>
+#include <cstdlib>
+#include <new>
+#include <string.h>
+#include <time.h>
+
+namespace Shipping {
+
+const char *
+Instrument::probeName(Probe p)
+{
+	switch (p) {
+		case locationArrival_: return "LocationReactor::onShipmentArrival";
+		case segmentArrival_: return "SegmentReactor::onShipmentArrival";
+		case capacityFreed_: return "SegmentReactor::onCapacityFreed";
+		case injectActivity_: return "InjectActivityReactor";
+		case forwardActivity_: return "ForwardActivityReactor";
+		case retryActivity_: return "RetryActivityReactor";
+		case tripActivity_: return "TripActivityReactor";
+		case tripTimeoutActivity_: return "TripTimeoutActivityReactor";
+		case waitExpiryActivity_: return "WaitExpiryActivityReactor";
+		case routePrecompute_: return "Connectivity::routes";
+		case nextHopTable_: return "Connectivity::nextHopTableIs";
+		default: return "";
+	}
+}
+
+#ifdef SHIPPING_INSTRUMENT
+
+thread_local Instrument::Counters Instrument::counters_;
+
+U64
+Instrument::nanoseconds()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (U64) t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// the tick rate is measured between program start and each report
+static const U64 startTicks = Instrument::ticks();
+static const U64 startNanoseconds = Instrument::nanoseconds();
+
+bool Instrument::enabled() { return true; }
+U64 Instrument::events(Probe p) { return counters_.events[p]; }
+U64 Instrument::allocations() { return counters_.allocations; }
+U64 Instrument::allocatedBytes() { return counters_.allocatedBytes; }
+
+double
+Instrument::seconds(Probe p)
+{
+	double ticks = (double) (Instrument::ticks() - startTicks);
+	double nanoseconds = (double) (Instrument::nanoseconds() - startNanoseconds);
+	if (ticks <= 0) return 0.0;
+	return counters_.ticks[p] * (nanoseconds / ticks) / 1e9;
+}
+
+void
+Instrument::resetIs()
+{
+	memset(&counters_, 0, sizeof(counters_));
+}
+
+#else
+
+bool Instrument::enabled() { return false; }
+U64 Instrument::events(Probe p) { return 0; }
+double Instrument::seconds(Probe p) { return 0.0; }
+U64 Instrument::allocations() { return 0; }
+U64 Instrument::allocatedBytes() { return 0; }
+void Instrument::resetIs() {}
+
+#endif
+
+std::string
+Instrument::report()
+{
+	std::stringstream out;
+	if (!enabled()) {
+		out << "instrumentation disabled; rebuild with make INSTRUMENT=1" << std::endl;
+		return out.str();
+	}
+	out << " --- Instrumentation --- " << std::endl;
+	for (size_t i = 0; i < probes_; i++) {
+		Probe p = (Probe) i;
+		if (!events(p)) continue;
+		out << probeName(p) << " : events=" << events(p)
+			<< " seconds=" << seconds(p)
+			<< " ns/event=" << seconds(p) * 1e9 / events(p) << std::endl;
+	}
+	out << "allocations=" << allocations() << " bytes=" << allocatedBytes() << std::endl;
+	return out.str();
+}
+
+} /* end namespace */
+
+#ifdef SHIPPING_INSTRUMENT
+
+// counting replacements for the global allocator; the nothrow and sized
+// forms in the runtime call these
+static void *
+countedAllocation(size_t size)
+{
+	Shipping::Instrument::Counters &c = Shipping::Instrument::counters();
+	c.allocations++;
+	c.allocatedBytes += size;
+	for (;;) {
+		void *p = malloc(size ? size : 1);
+		if (p) return p;
+		std::new_handler handler = std::set_new_handler(0);
+		std::set_new_handler(handler);
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+#if __cplusplus >= 201103L
+void *operator new(size_t size) { return countedAllocation(size); }
+void *operator new[](size_t size) { return countedAllocation(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+#else
+void *operator new(size_t size) throw(std::bad_alloc) { return countedAllocation(size); }
+void *operator new[](size_t size) throw(std::bad_alloc) { return countedAllocation(size); }
+void operator delete(void *p) throw() { free(p); }
+void operator delete[](void *p) throw() { free(p); }
+#endif
+
+#endif
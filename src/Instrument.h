@@ -0,0 +1,105 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include "fwk/Types.h"
+#include <string>
+
+// Hot path instrumentation, compiled in only with -DSHIPPING_INSTRUMENT
+// (make INSTRUMENT=1). INSTRUMENT_SCOPE(probe) at the top of a function
+// counts the call and adds the time until the scope ends to that probe;
+// times are inclusive, so a location arrival that forwards onto a segment
+// also contains the segment's arrival. Counters are kept per thread and
+// cost a couple of TSC reads per event; the report covers the calling
+// thread, which is the simulation thread. The instrumented build also
+// replaces the global operator new to count allocations. Without the flag
+// INSTRUMENT_SCOPE expands to nothing and the report says so.
+
+#ifdef SHIPPING_INSTRUMENT
+#define INSTRUMENT_SCOPE(probe) \
+	Shipping::Instrument::ScopedTimer instrumentScope__(Shipping::Instrument::probe())
+#else
+#define INSTRUMENT_SCOPE(probe)
+#endif
+
+namespace Shipping {
+
+class Instrument {
+public:
+	enum Probe {
+		locationArrival_ = 0,
+		segmentArrival_,
+		capacityFreed_,
+		injectActivity_,
+		forwardActivity_,
+		retryActivity_,
+		tripActivity_,
+		tripTimeoutActivity_,
+		waitExpiryActivity_,
+		routePrecompute_,
+		nextHopTable_,
+		probes_
+	};
+	static inline Probe locationArrival() { return locationArrival_; }
+	static inline Probe segmentArrival() { return segmentArrival_; }
+	static inline Probe capacityFreed() { return capacityFreed_; }
+	static inline Probe injectActivity() { return injectActivity_; }
+	static inline Probe forwardActivity() { return forwardActivity_; }
+	static inline Probe retryActivity() { return retryActivity_; }
+	static inline Probe tripActivity() { return tripActivity_; }
+	static inline Probe tripTimeoutActivity() { return tripTimeoutActivity_; }
+	static inline Probe waitExpiryActivity() { return waitExpiryActivity_; }
+	static inline Probe routePrecompute() { return routePrecompute_; }
+	static inline Probe nextHopTable() { return nextHopTable_; }
+
+	static const char *probeName(Probe p);
+
+	static bool enabled();
+	static U64 events(Probe p);
+	static double seconds(Probe p);
+	static U64 allocations();
+	static U64 allocatedBytes();
+
+	// zeroes this thread's counters
+	static void resetIs();
+	// one line per probe that fired, then the allocation counts
+	static std::string report();
+
+#ifdef SHIPPING_INSTRUMENT
+	static inline U64 ticks() {
+#if defined(__i386__) || defined(__x86_64__)
+		U32 lo, hi;
+		__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+		return ((U64) hi << 32) | lo;
+#else
+		return nanoseconds();
+#endif
+	}
+	static U64 nanoseconds();
+
+	struct Counters {
+		U64 events[probes_];
+		U64 ticks[probes_];
+		U64 allocations;
+		U64 allocatedBytes;
+	};
+	static thread_local Counters counters_;
+	static Counters &counters() { return counters_; }
+
+	class ScopedTimer {
+	public:
+		ScopedTimer(Probe p) : probe_(p), start_(ticks()) {}
+		~ScopedTimer() {
+			Counters &c = counters();
+			c.events[probe_]++;
+			c.ticks[probe_] += ticks() - start_;
+		}
+	private:
+		Probe probe_;
+		U64 start_;
+	};
+#endif
+};
+
+} /* end namespace */
+
+#endif
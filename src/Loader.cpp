@@ -0,0 +1,823 @@
+#include "Loader.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+
+namespace Shipping {
+
+static const char magic[] = "SHNET001";
+static const char snapshotMagic[] = "SHSNAP01";
+static const U32 none = ~0u;
+
+// location types in the binary format; terminals add their mode
+static const U8 customerType = 0;
+static const U8 portType = 1;
+static const U8 terminalType = 2;
+static const U8 locationTypes = terminalType + 3;
+
+static const U8 noMode = 3;
+
+static U8
+modeCode(const string &mode)
+{
+	if (mode == "truck") return Segment::truck();
+	if (mode == "boat") return Segment::boat();
+	if (mode == "plane") return Segment::plane();
+	return noMode;
+}
+
+static U8
+priorityCode(const string &priority)
+{
+	if (priority == "expedited") return Priority::expedited();
+	if (priority == "high value") return Priority::highValue();
+	return Priority::standard();
+}
+
+// splits line at commas into fields, reusing their storage
+static size_t
+fieldsIs(const string &line, vector<string> &fields)
+{
+	size_t n = 0;
+	size_t start = 0;
+	for (;;) {
+		size_t comma = line.find(',', start);
+		size_t end = comma == string::npos ? line.size() : comma;
+		if (end > start && line[end - 1] == '\r') --end;
+		if (n == fields.size()) fields.push_back(string());
+		fields[n++].assign(line, start, end - start);
+		if (comma == string::npos) return n;
+		start = comma + 1;
+	}
+}
+
+namespace {
+
+// Batches the network's notifications while a load builds entities, and
+// puts the network's batching back as it was when the load is done, or
+// when it ends early with an exception.
+class BatchingScope {
+public:
+	BatchingScope(Network *network): network_(network), prior_(network->batching()), open_(true) {
+		network_->batchingIs(true);
+	}
+	~BatchingScope() {
+		if (!open_) return;
+		try { network_->batchingIs(prior_); }
+		catch (...) {}
+	}
+	void end() {
+		open_ = false;
+		network_->batchingIs(prior_);
+	}
+private:
+	Network *network_;
+	bool prior_;
+	bool open_;
+};
+
+}
+
+// "line n: ", for error messages
+static string
+at(size_t line)
+{
+	stringstream where;
+	where << "line " << line << ": ";
+	return where.str();
+}
+
+namespace {
+
+// a segment's CSV fields, kept until every record has been created
+struct SegmentLinks {
+	Segment::Ptr segment;
+	string source;
+	float length;
+	string returnSegment;
+	int capacity;
+	float difficulty;
+	bool expedited;
+};
+
+struct DemandLinks {
+	string customer;
+	string destination;
+	int shipmentSize;
+	int transferRate;
+	U8 priority;
+};
+
+}
+
+Loader::Ptr
+Loader::LoaderNew(Network *network)
+{
+	Ptr m = new Loader(network);
+	m->referencesDec(1);
+	// decr. refer count to compensate for initial val of 1
+	return m;
+}
+
+Loader::Loader(Network *network):
+	network_(network),
+	locations_(0),
+	segments_(0),
+	demands_(0),
+	errors_(0)
+	{}
+
+void
+Loader::errorIs(const string &message)
+{
+	cerr << "Loader: " << message << endl;
+	++errors_;
+}
+
+Location::Ptr
+Loader::locationNew(const string &name, U8 type)
+{
+	Location::Ptr location;
+	if (type == customerType) location = network_->customerNew(name);
+	else if (type == portType) location = network_->portNew(name);
+	else if (type < locationTypes) location = network_->terminalNew(name, (Segment::Mode) (type - terminalType));
+	if (!location) {
+		errorIs("cannot create location " + name);
+		return location;
+	}
+	++locations_;
+	return location;
+}
+
+Segment::Ptr
+Loader::segmentNew(const string &name, U8 mode)
+{
+	Segment::Ptr segment;
+	if (mode < noMode) segment = network_->segmentNew(name, (Segment::Mode) mode);
+	if (!segment) {
+		errorIs("cannot create segment " + name);
+		return segment;
+	}
+	++segments_;
+	return segment;
+}
+
+// negative length and capacity and a difficulty out of range leave the
+// segment's defaults
+void
+Loader::segmentIs(Segment::Ptr segment, const Location::Ptr &source, float length,
+	const Segment::Ptr &returnSegment, int capacity, float difficulty, bool expedited)
+{
+	if (source) segment->sourceIs(source);
+	if (length >= 0) segment->lengthIs(Mile(length));
+	if (returnSegment) {
+		Segment::Ptr r = returnSegment;
+		segment->returnSegmentIs(r);
+	}
+	if (capacity >= 0) segment->numVehiclesIs(VehicleCount(capacity));
+	if (difficulty >= 1.f && difficulty <= 5.f) segment->difficultyIs(Difficulty(difficulty));
+	if (expedited && segment->expediteSupport() == Segment::expediteNotSupported()) {
+		network_->expediteSupportIs(segment->name(), Segment::expediteSupported());
+	}
+}
+
+void
+Loader::demandIs(Customer::Ptr customer, const Customer::Ptr &destination,
+	int shipmentSize, int transferRate, U8 priority)
+{
+	// the destination goes last: once all three are set the customer
+	// starts injecting
+	if (priority < Priority::classes) customer->shipmentPriorityIs((Priority::Class) priority);
+	customer->shipmentSizeIs(PackageCount(shipmentSize));
+	customer->transferRateIs(ShipmentCount(transferRate));
+	customer->destinationIs(destination);
+	++demands_;
+}
+
+void
+Loader::csvIs(std::istream &in)
+{
+	Fleet::Ptr fleet = const_cast<Fleet *>(network_->fleet().ptr());
+	vector<SegmentLinks> links;
+	vector<DemandLinks> demands;
+	vector<string> field;
+	string line;
+	size_t lineNumber = 0;
+	BatchingScope batching(network_);
+
+	while (std::getline(in, line)) {
+		++lineNumber;
+		if (line.empty() || line[0] == '#' || line == "\r") continue;
+		size_t n = fieldsIs(line, field);
+		const string &kind = field[0];
+		try {
+			if (kind == "customer" || kind == "port") {
+				if (n < 2) { errorIs(at(lineNumber) + "missing name"); continue; }
+				locationNew(field[1], kind == "customer" ? customerType : portType);
+			}
+			else if (kind == "terminal") {
+				U8 mode = n > 2 ? modeCode(field[2]) : noMode;
+				if (n < 3 || mode == noMode) { errorIs(at(lineNumber) + "terminal needs a name and a mode"); continue; }
+				locationNew(field[1], terminalType + mode);
+			}
+			else if (kind == "segment") {
+				U8 mode = n > 2 ? modeCode(field[2]) : noMode;
+				if (n < 3 || mode == noMode) { errorIs(at(lineNumber) + "segment needs a name and a mode"); continue; }
+				SegmentLinks l;
+				l.segment = segmentNew(field[1], mode);
+				if (!l.segment) continue;
+				l.source = n > 3 ? field[3] : "";
+				l.length = n > 4 && !field[4].empty() ? atof(field[4].c_str()) : -1;
+				l.returnSegment = n > 5 ? field[5] : "";
+				l.capacity = n > 6 && !field[6].empty() ? atoi(field[6].c_str()) : -1;
+				l.difficulty = n > 7 && !field[7].empty() ? atof(field[7].c_str()) : 0;
+				l.expedited = n > 8 && field[8] == "yes";
+				links.push_back(l);
+			}
+			else if (kind == "demand") {
+				if (n < 5) { errorIs(at(lineNumber) + "demand needs a customer, destination, size and rate"); continue; }
+				DemandLinks d;
+				d.customer = field[1];
+				d.destination = field[2];
+				d.shipmentSize = atoi(field[3].c_str());
+				d.transferRate = atoi(field[4].c_str());
+				d.priority = n > 5 ? priorityCode(field[5]) : Priority::standard();
+				demands.push_back(d);
+			}
+			else if (kind == "fleet") {
+				U8 mode = n > 1 ? modeCode(field[1]) : noMode;
+				if (mode == noMode) { errorIs(at(lineNumber) + "fleet needs a mode"); continue; }
+				if (!fleet) fleet = network_->fleetNew("fleet");
+				Segment::Mode m = (Segment::Mode) mode;
+				if (n > 2 && !field[2].empty()) {
+					fleet->speedIs(m, MilesPerHour(atof(field[2].c_str())), Fleet::day());
+					fleet->speedIs(m, MilesPerHour(atof(field[2].c_str())), Fleet::night());
+				}
+				if (n > 3 && !field[3].empty()) {
+					fleet->costPerMileIs(m, Dollars(atof(field[3].c_str())), Fleet::day());
+					fleet->costPerMileIs(m, Dollars(atof(field[3].c_str())), Fleet::night());
+				}
+				if (n > 4 && !field[4].empty()) {
+					fleet->capacityIs(m, PackageCount(atoi(field[4].c_str())), Fleet::day());
+					fleet->capacityIs(m, PackageCount(atoi(field[4].c_str())), Fleet::night());
+				}
+				if (n > 5 && !field[5].empty()) fleet->departureTimeoutIs(m, Hours(atof(field[5].c_str())));
+			}
+			else errorIs(at(lineNumber) + "unknown record " + kind);
+		} catch (Fwk::Exception &e) {
+			// values the engine's types reject, such as negative speeds
+			errorIs(at(lineNumber) + e.what());
+		}
+	}
+
+	// every entity exists now, so references can be resolved in any order
+	for (size_t i = 0; i < links.size(); i++) {
+		const SegmentLinks &l = links[i];
+		Location::Ptr source = l.source.empty() ? Location::Ptr() : network_->location(l.source);
+		Segment::Ptr returnSegment = l.returnSegment.empty() ? Segment::Ptr() : network_->segment(l.returnSegment);
+		if (!l.source.empty() && !source) {
+			errorIs("segment " + l.segment->name() + ": no location " + l.source);
+		}
+		if (!l.returnSegment.empty() && !returnSegment) {
+			errorIs("segment " + l.segment->name() + ": no segment " + l.returnSegment);
+		}
+		segmentIs(l.segment, source, l.length, returnSegment, l.capacity, l.difficulty, l.expedited);
+	}
+	batching.end();
+	for (size_t i = 0; i < demands.size(); i++) {
+		const DemandLinks &d = demands[i];
+		Customer::Ptr customer = dynamic_cast<Customer *>(network_->location(d.customer).ptr());
+		Customer::Ptr destination = dynamic_cast<Customer *>(network_->location(d.destination).ptr());
+		if (!customer || !destination) {
+			errorIs("demand " + d.customer + " to " + d.destination + ": no such customer");
+			continue;
+		}
+		demandIs(customer, destination, d.shipmentSize, d.transferRate, d.priority);
+	}
+}
+
+namespace {
+
+// walks a binary image in memory, handing out its columns where they lie
+class ImageReader {
+public:
+	ImageReader(const char *image, size_t bytes): next_(image), end_(image + bytes) {}
+
+	const char *bytes(size_t n) {
+		if (n > (size_t) (end_ - next_)) throw Fwk::StorageException("network file truncated");
+		const char *b = next_;
+		next_ += n;
+		return b;
+	}
+	U32 count() {
+		U32 n;
+		memcpy(&n, bytes(sizeof(n)), sizeof(n));
+		return n;
+	}
+	const char *next() const { return next_; }
+
+private:
+	const char *next_;
+	const char *end_;
+};
+
+// n values of T read in place; each value is copied out on access, as a
+// column following a byte-wide one need not be aligned
+template<class T>
+class Column {
+public:
+	Column(ImageReader &in, size_t n): data_(in.bytes(n * sizeof(T))) {}
+
+	T operator[](size_t i) const {
+		T v;
+		memcpy(&v, data_ + i * sizeof(T), sizeof(T));
+		return v;
+	}
+
+private:
+	const char *data_;
+};
+
+}
+
+template<class T>
+static void
+columnWrite(std::ostream &out, const vector<T> &column)
+{
+	if (!column.empty()) out.write(reinterpret_cast<const char *>(&column[0]), column.size() * sizeof(T));
+}
+
+static void
+countWrite(std::ostream &out, U32 n)
+{
+	out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+// name lengths, then the names' bytes back to back
+static void
+namesRead(ImageReader &in, vector<string> &names, size_t n)
+{
+	Column<U32> lengths(in, n);
+	size_t total = 0;
+	for (size_t i = 0; i < n; i++) total += lengths[i];
+	const char *next = in.bytes(total);
+	names.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		names[i].assign(next, lengths[i]);
+		next += lengths[i];
+	}
+}
+
+static void
+namesWrite(std::ostream &out, const vector<string> &names)
+{
+	vector<U32> lengths(names.size());
+	for (size_t i = 0; i < names.size(); i++) lengths[i] = names[i].size();
+	columnWrite(out, lengths);
+	for (size_t i = 0; i < names.size(); i++) out.write(names[i].data(), names[i].size());
+}
+
+struct FleetColumns {
+	float speed[2];
+	float cost[2];
+	U32 capacity[2];
+	float departureTimeout;
+};
+
+void
+Loader::binaryIs(std::istream &in)
+{
+	stringstream image;
+	image << in.rdbuf();
+	string bytes = image.str();
+	imageIs(bytes.data(), bytes.size());
+}
+
+size_t
+Loader::imageIs(const char *image, size_t bytes)
+{
+	if (bytes < sizeof(magic) - 1 || memcmp(image, magic, sizeof(magic) - 1) != 0) {
+		throw Fwk::StorageException("not a network file");
+	}
+	ImageReader in(image + sizeof(magic) - 1, bytes - (sizeof(magic) - 1));
+
+	FleetColumns modes[3];
+	memcpy(modes, in.bytes(sizeof(modes)), sizeof(modes));
+
+	// find every column before touching the network, so a truncated image
+	// leaves it as it was
+	size_t locationCount = in.count();
+	Column<U8> locationType(in, locationCount);
+	vector<string> locationName;
+	namesRead(in, locationName, locationCount);
+
+	size_t segments = in.count();
+	Column<U8> segmentMode(in, segments);
+	vector<string> segmentName;
+	namesRead(in, segmentName, segments);
+	Column<U32> source(in, segments);
+	Column<float> length(in, segments);
+	Column<U32> returnSegment(in, segments);
+	Column<U32> capacity(in, segments);
+	Column<float> difficulty(in, segments);
+	Column<U8> expedited(in, segments);
+
+	size_t demands = in.count();
+	Column<U32> customer(in, demands);
+	Column<U32> destination(in, demands);
+	Column<U32> shipmentSize(in, demands);
+	Column<U32> transferRate(in, demands);
+	Column<U8> priority(in, demands);
+
+	Fleet::Ptr fleet = const_cast<Fleet *>(network_->fleet().ptr());
+	if (!fleet) fleet = network_->fleetNew("fleet");
+	for (size_t m = 0; m < 3; m++) {
+		Segment::Mode mode = (Segment::Mode) m;
+		for (size_t t = 0; t < 2; t++) {
+			Fleet::TimeOfDay tod = t ? Fleet::night() : Fleet::day();
+			fleet->speedIs(mode, MilesPerHour(modes[m].speed[t]), tod);
+			fleet->costPerMileIs(mode, Dollars(modes[m].cost[t]), tod);
+			fleet->capacityIs(mode, PackageCount(modes[m].capacity[t]), tod);
+		}
+		fleet->departureTimeoutIs(mode, Hours(modes[m].departureTimeout));
+	}
+
+	BatchingScope batching(network_);
+	vector<Location::Ptr> &locations = imageLocations_;
+	locations.assign(locationCount, Location::Ptr());
+	for (size_t i = 0; i < locationCount; i++) {
+		locations[i] = locationNew(locationName[i], locationType[i]);
+	}
+	vector<Segment::Ptr> &segmentList = imageSegments_;
+	segmentList.assign(segments, Segment::Ptr());
+	for (size_t i = 0; i < segments; i++) {
+		segmentList[i] = segmentNew(segmentName[i], segmentMode[i]);
+	}
+	for (size_t i = 0; i < segments; i++) {
+		if (!segmentList[i]) continue;
+		Location::Ptr src = source[i] < locationCount ? locations[source[i]] : Location::Ptr();
+		Segment::Ptr ret = returnSegment[i] < segments ? segmentList[returnSegment[i]] : Segment::Ptr();
+		segmentIs(segmentList[i], src, length[i], ret, capacity[i], difficulty[i], expedited[i]);
+	}
+	batching.end();
+
+	for (size_t i = 0; i < demands; i++) {
+		Customer::Ptr c, d;
+		if (customer[i] < locationCount) c = dynamic_cast<Customer *>(locations[customer[i]].ptr());
+		if (destination[i] < locationCount) d = dynamic_cast<Customer *>(locations[destination[i]].ptr());
+		if (!c || !d) {
+			errorIs("demand refers to a location that is not a customer");
+			continue;
+		}
+		demandIs(c, d, shipmentSize[i], transferRate[i], priority[i]);
+	}
+	return in.next() - image;
+}
+
+Location::Ptr
+Loader::imageLocation(size_t index) const
+{
+	return index < imageLocations_.size() ? imageLocations_[index] : Location::Ptr();
+}
+
+Segment::Ptr
+Loader::imageSegment(size_t index) const
+{
+	return index < imageSegments_.size() ? imageSegments_[index] : Segment::Ptr();
+}
+
+void
+Loader::binaryWrite(std::ostream &out) const
+{
+	out.write(magic, sizeof(magic) - 1);
+
+	FleetColumns modes[3];
+	memset(modes, 0, sizeof(modes));
+	Fleet::PtrConst fleet = network_->fleet();
+	for (size_t m = 0; fleet && m < 3; m++) {
+		Segment::Mode mode = (Segment::Mode) m;
+		for (size_t t = 0; t < 2; t++) {
+			Fleet::TimeOfDay tod = t ? Fleet::night() : Fleet::day();
+			modes[m].speed[t] = fleet->speed(mode, tod).value();
+			modes[m].cost[t] = fleet->costPerMile(mode, tod).value();
+			modes[m].capacity[t] = fleet->capacity(mode, tod).value();
+		}
+		modes[m].departureTimeout = fleet->departureTimeout(mode).value();
+	}
+	out.write(reinterpret_cast<const char *>(modes), sizeof(modes));
+
+	vector<Location::PtrConst> locations = network_->locations();
+	map<const Location *, U32> locationIndex;
+	vector<U8> locationType(locations.size());
+	vector<string> locationName(locations.size());
+	for (size_t i = 0; i < locations.size(); i++) {
+		const Location *l = locations[i].ptr();
+		locationIndex[l] = i;
+		locationName[i] = l->name();
+		if (l->locationType() == Location::customer()) locationType[i] = customerType;
+		else if (l->locationType() == Location::port()) locationType[i] = portType;
+		else locationType[i] = terminalType + dynamic_cast<const Terminal *>(l)->vehicleType();
+	}
+	countWrite(out, locations.size());
+	columnWrite(out, locationType);
+	namesWrite(out, locationName);
+
+	vector<Segment::PtrConst> segments = network_->segments();
+	map<const Segment *, U32> segmentIndex;
+	for (size_t i = 0; i < segments.size(); i++) segmentIndex[segments[i].ptr()] = i;
+	vector<U8> segmentMode(segments.size()), expedited(segments.size());
+	vector<string> segmentName(segments.size());
+	vector<U32> source(segments.size()), returnSegment(segments.size()), capacity(segments.size());
+	vector<float> length(segments.size()), difficulty(segments.size());
+	for (size_t i = 0; i < segments.size(); i++) {
+		const Segment *s = segments[i].ptr();
+		segmentMode[i] = s->mode();
+		segmentName[i] = s->name();
+		source[i] = s->source() ? locationIndex[s->source().ptr()] : none;
+		length[i] = s->length().value();
+		returnSegment[i] = s->returnSegment() ? segmentIndex[s->returnSegment().ptr()] : none;
+		capacity[i] = s->numVehicles().value();
+		difficulty[i] = s->difficulty().value();
+		expedited[i] = s->expediteSupport() == Segment::expediteSupported();
+	}
+	countWrite(out, segments.size());
+	columnWrite(out, segmentMode);
+	namesWrite(out, segmentName);
+	columnWrite(out, source);
+	columnWrite(out, length);
+	columnWrite(out, returnSegment);
+	columnWrite(out, capacity);
+	columnWrite(out, difficulty);
+	columnWrite(out, expedited);
+
+	vector<U32> customer, destination, shipmentSize, transferRate;
+	vector<U8> priority;
+	for (size_t i = 0; i < locations.size(); i++) {
+		const Customer *c = dynamic_cast<const Customer *>(locations[i].ptr());
+		if (!c || !c->destination()) continue;
+		customer.push_back(i);
+		destination.push_back(locationIndex[c->destination().ptr()]);
+		shipmentSize.push_back(c->shipmentSize().value());
+		transferRate.push_back(c->transferRate().value());
+		priority.push_back(c->shipmentPriority());
+	}
+	countWrite(out, customer.size());
+	columnWrite(out, customer);
+	columnWrite(out, destination);
+	columnWrite(out, shipmentSize);
+	columnWrite(out, transferRate);
+	columnWrite(out, priority);
+}
+
+namespace {
+
+enum SectionKind {
+	networkSection = 1,
+	dijkstraSection,
+	bfsSection,
+	stateSection
+};
+
+struct SectionEntry {
+	U32 kind;
+	U32 reserved;
+	U64 offset;
+	U64 bytes;
+};
+
+// a read-only mapping of a whole file, released on destruction
+class Mapping {
+public:
+	Mapping(const string &path): image_(0), bytes_(0) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw Fwk::ErrnoException(errno, path);
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			int error = errno;
+			close(fd);
+			throw Fwk::ErrnoException(error, path);
+		}
+		bytes_ = st.st_size;
+		if (bytes_) {
+			void *image = mmap(0, bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (image == MAP_FAILED) {
+				int error = errno;
+				close(fd);
+				throw Fwk::ErrnoException(error, path);
+			}
+			image_ = static_cast<const char *>(image);
+		}
+		close(fd);
+	}
+	~Mapping() { if (image_) munmap(const_cast<char *>(image_), bytes_); }
+
+	const char *image() const { return image_; }
+	size_t bytes() const { return bytes_; }
+
+	// the section of the given kind, or null if the snapshot has none
+	const char *section(U32 kind, size_t &bytes) const {
+		ImageReader in(image_ + sizeof(snapshotMagic) - 1, bytes_ - (sizeof(snapshotMagic) - 1));
+		size_t sections = in.count();
+		in.count();
+		for (size_t i = 0; i < sections; i++) {
+			SectionEntry entry;
+			memcpy(&entry, in.bytes(sizeof(entry)), sizeof(entry));
+			if (entry.kind != kind) continue;
+			if (entry.offset > bytes_ || entry.bytes > bytes_ - entry.offset) {
+				throw Fwk::StorageException("snapshot truncated");
+			}
+			bytes = entry.bytes;
+			return image_ + entry.offset;
+		}
+		return 0;
+	}
+
+private:
+	Mapping(const Mapping &);
+	Mapping &operator=(const Mapping &);
+
+	const char *image_;
+	size_t bytes_;
+};
+
+}
+
+// the routes as written by routesWrite, rebuilt over the entities of the
+// last binary read; routes through anything that was skipped are dropped
+static void
+routesRead(const char *section, size_t bytes, const Loader *loader, const Fleet::PtrConst &fleet,
+	Connectivity::RouteMap &routes)
+{
+	// sections start 8-byte aligned in the file, so the words are aligned
+	const U32 *words = reinterpret_cast<const U32 *>(section);
+	size_t available = bytes / sizeof(U32);
+	if (!available) throw Fwk::StorageException("snapshot truncated");
+	size_t n = words[0];
+	if (available < 3 * n + 2) throw Fwk::StorageException("snapshot truncated");
+	const U32 *source = words + 1;
+	const U32 *destination = source + n;
+	const U32 *first = destination + n;
+	const U32 *parts = first + n + 1;
+	if (available - (3 * n + 2) < first[n]) throw Fwk::StorageException("snapshot truncated");
+
+	for (size_t i = 0; i < n; i++) {
+		if (first[i] > first[i + 1] || first[i + 1] > first[n]) {
+			throw Fwk::StorageException("snapshot route table corrupt");
+		}
+		Customer::Ptr src = dynamic_cast<Customer *>(loader->imageLocation(source[i]).ptr());
+		Customer::Ptr dest = dynamic_cast<Customer *>(loader->imageLocation(destination[i]).ptr());
+		if (!src || !dest) continue;
+		// the same steps the route searches take, so costs and hours come
+		// out as they did when the routes were found
+		Path::Ptr path = Path::PathNew(fleet);
+		bool complete = true;
+		for (U32 p = first[i]; complete && p < first[i + 1]; p++) {
+			if ((p - first[i]) % 2 == 0) {
+				Location::Ptr location = loader->imageLocation(parts[p]);
+				complete = location.ptr() != 0;
+				path->endLocationIs(location);
+			} else {
+				Segment::Ptr segment = loader->imageSegment(parts[p]);
+				complete = segment.ptr() != 0;
+				path->endSegmentIs(segment);
+			}
+		}
+		if (complete) routes[Connectivity::RouteKey(src->id(), dest->id())] = path;
+	}
+}
+
+// U32 routes; source and destination (U32 location index); where each
+// route's parts start (U32, one more than there are routes); the parts (U32
+// location, segment, location, ... indices)
+static void
+routesWrite(std::ostream &out, const Connectivity::RouteMap &routes,
+	map<const Location *, U32> &locationIndex, map<const Segment *, U32> &segmentIndex)
+{
+	vector<U32> source, destination, first, parts;
+	for (Connectivity::RouteMap::const_iterator r = routes.begin(); r != routes.end(); ++r) {
+		const Path *path = r->second.ptr();
+		source.push_back(locationIndex[path->start().ptr()]);
+		destination.push_back(locationIndex[path->end().ptr()]);
+		first.push_back(parts.size());
+		for (size_t i = 0; i < path->numParts(); i++) {
+			Path::Part part = path->part(i);
+			if (part.type == Path::location()) parts.push_back(locationIndex[part.loc.ptr()]);
+			else parts.push_back(segmentIndex[part.seg.ptr()]);
+		}
+	}
+	first.push_back(parts.size());
+	countWrite(out, source.size());
+	columnWrite(out, source);
+	columnWrite(out, destination);
+	columnWrite(out, first);
+	columnWrite(out, parts);
+}
+
+void
+Loader::snapshotIs(const string &path)
+{
+	Mapping mapping(path);
+	if (mapping.bytes() < sizeof(snapshotMagic) - 1
+		|| memcmp(mapping.image(), snapshotMagic, sizeof(snapshotMagic) - 1) != 0) {
+		throw Fwk::StorageException("not a snapshot file");
+	}
+	size_t bytes = 0;
+	const char *network = mapping.section(networkSection, bytes);
+	if (!network) throw Fwk::StorageException("snapshot has no network");
+	size_t errors = errors_;
+	imageIs(network, bytes);
+	size_t stateBytes = 0;
+	const char *state = mapping.section(stateSection, stateBytes);
+	if (state) state_.assign(state, stateBytes);
+	else state_.clear();
+
+	size_t dijkstraBytes = 0, bfsBytes = 0;
+	const char *dijkstraRoutes = mapping.section(dijkstraSection, dijkstraBytes);
+	const char *bfsRoutes = mapping.section(bfsSection, bfsBytes);
+	Connectivity::Ptr conn = network_->connectivity();
+	if (!conn || !dijkstraRoutes || !bfsRoutes) return;
+	if (errors_ != errors) {
+		errorIs("snapshot routes not installed; the network did not load cleanly");
+		return;
+	}
+	Fleet::PtrConst fleet = conn->fleet() ? conn->fleet() : network_->fleet();
+	Connectivity::RouteMap dijkstra, bfs;
+	routesRead(dijkstraRoutes, dijkstraBytes, this, fleet, dijkstra);
+	routesRead(bfsRoutes, bfsBytes, this, fleet, bfs);
+	conn->precomputedRoutesIs(dijkstra, bfs);
+}
+
+void
+Loader::snapshotWrite(const string &path, const string &state)
+{
+	Connectivity::Ptr conn = network_->connectivity();
+	if (conn && conn->routesVersion() != network_->topologyVersion()
+		&& conn->simulationStatus() == Connectivity::off()) {
+		conn->precomputedRoutesIs();
+	}
+
+	vector<string> sections;
+	vector<U32> kinds;
+	stringstream network;
+	binaryWrite(network);
+	sections.push_back(network.str());
+	kinds.push_back(networkSection);
+	// routes from before the last topology change would be wrong for the
+	// network being written, so they are left out and found again on start;
+	// a checkpoint keeps them, as they are the routes its shipments follow
+	bool checkpoint = !state.empty();
+	if (conn && conn->routesVersion()
+		&& (checkpoint || conn->routesVersion() == network_->topologyVersion())) {
+		vector<Location::PtrConst> locations = network_->locations();
+		map<const Location *, U32> locationIndex;
+		for (size_t i = 0; i < locations.size(); i++) locationIndex[locations[i].ptr()] = i;
+		vector<Segment::PtrConst> segments = network_->segments();
+		map<const Segment *, U32> segmentIndex;
+		for (size_t i = 0; i < segments.size(); i++) segmentIndex[segments[i].ptr()] = i;
+		for (U32 kind = dijkstraSection; kind <= bfsSection; kind++) {
+			stringstream routes;
+			routesWrite(routes, conn->precomputedRoutes(kind == bfsSection ? Connectivity::bfs() : Connectivity::dijkstra()),
+				locationIndex, segmentIndex);
+			sections.push_back(routes.str());
+			kinds.push_back(kind);
+		}
+	}
+	if (!state.empty()) {
+		sections.push_back(state);
+		kinds.push_back(stateSection);
+	}
+
+	vector<SectionEntry> table(sections.size());
+	U64 offset = sizeof(snapshotMagic) - 1 + 2 * sizeof(U32) + table.size() * sizeof(SectionEntry);
+	for (size_t i = 0; i < sections.size(); i++) {
+		offset = (offset + 7) & ~(U64) 7;
+		table[i].kind = kinds[i];
+		table[i].reserved = 0;
+		table[i].offset = offset;
+		table[i].bytes = sections[i].size();
+		offset += sections[i].size();
+	}
+
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out) throw Fwk::ErrnoException(errno, path);
+	out.write(snapshotMagic, sizeof(snapshotMagic) - 1);
+	countWrite(out, sections.size());
+	countWrite(out, 0);
+	columnWrite(out, table);
+	U64 written = sizeof(snapshotMagic) - 1 + 2 * sizeof(U32) + table.size() * sizeof(SectionEntry);
+	static const char padding[8] = { 0 };
+	for (size_t i = 0; i < sections.size(); i++) {
+		out.write(padding, table[i].offset - written);
+		out.write(sections[i].data(), sections[i].size());
+		written = table[i].offset + sections[i].size();
+	}
+	out.close();
+	if (!out) throw Fwk::ErrnoException(errno ? errno : EIO, path);
+}
+
+} /* end namespace */
@@ -0,0 +1,132 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "Engine.h"
+#include <istream>
+#include <ostream>
+
+namespace Shipping {
+
+// Builds a network in bulk from a file instead of one instanceNew and
+// attributeIs call per field. Entities are created on the engine directly,
+// with the network batching its notifications (Network::batchingIs), and
+// references between records (segment sources, return segments, customer
+// destinations) are resolved once everything has been created, so records
+// may come in any order. A record naming something that already exists or
+// referring to something that does not is reported on cerr, counted in
+// errors() and skipped.
+//
+// The CSV format has one record per line; blank lines and lines starting
+// with '#' are skipped, and trailing fields may be left out:
+//
+//   fleet,<mode>,<speed>,<cost per mile>,<capacity>,<departure timeout>
+//   customer,<name>
+//   port,<name>
+//   terminal,<name>,<mode>
+//   segment,<name>,<mode>,<source>,<length>,<return segment>,<capacity>,
+//       <difficulty>,<expedite support (yes|no)>
+//   demand,<customer>,<destination>,<shipment size>,<transfer rate>,
+//       <priority (standard|expedited|high value)>
+//
+// where <mode> is truck, boat or plane. The binary format holds the same
+// information column by column, so each column is read with a single read;
+// locations and segments refer to each other by index rather than name.
+// All values are in host byte order:
+//
+//   "SHNET001"
+//   fleet, for each mode: speed, cost per mile (float, day then night),
+//       capacity (U32, day then night), departure timeout (float)
+//   U32 locations; type (U8: customer, port, then truck, boat and plane
+//       terminal), name lengths (U32), the names' bytes back to back
+//   U32 segments; mode (U8), name lengths (U32), names' bytes, source
+//       (U32 location index, ~0 for none), length (float), return segment
+//       (U32 segment index, ~0 for none), capacity (U32), difficulty
+//       (float), expedite support (U8)
+//   U32 demands; customer and destination (U32 location index), shipment
+//       size, transfer rate (U32), priority (U8)
+//
+// A snapshot holds a network together with the routes between its customers
+// (Connectivity::precomputedRoutes), so that a later run can start without
+// the route search that dominates startup on large networks. Engine objects
+// hold pointers and so cannot be used where they lie in a file; instead the
+// file is mapped and everything is built straight from the mapped columns.
+// Every position in the file is an offset from its start:
+//
+//   "SHSNAP01"
+//   U32 sections; U32 reserved
+//   for each section: kind (U32: 1 network, 2 dijkstra routes, 3 BFS
+//       routes, 4 simulation state), U32 reserved, offset and size (U64)
+//   the sections, each starting at a multiple of 8; the network section is
+//       the binary format above, a route section is U32 routes; source and
+//       destination (U32 location index); where each route's parts start
+//       (U32 index into the parts, one more than there are routes); the
+//       parts (U32 location, segment, location, ... indices)
+//
+// Route sections are only written while the routes match the network's
+// topology, except in a checkpoint (Checkpoint.h), which holds the routes
+// the running simulation uses whatever changed since they were found.
+class Loader : public Fwk::PtrInterface<Loader> {
+public:
+	typedef Fwk::Ptr<Loader> Ptr;
+	typedef Fwk::Ptr<Loader const> PtrConst;
+
+	// totals over everything this loader has read
+	size_t locations() const { return locations_; }
+	size_t segments() const { return segments_; }
+	size_t demands() const { return demands_; }
+	size_t errors() const { return errors_; }
+
+	void csvIs(std::istream &in);
+	// throws Fwk::StorageException if in does not hold the binary format
+	void binaryIs(std::istream &in);
+	// reads the binary format in place from memory, such as a mapped file,
+	// and returns the number of bytes it took; throws like binaryIs
+	size_t imageIs(const char *image, size_t bytes);
+
+	// the locations and segments created by the last binary read, by their
+	// index in it; null where a record was skipped
+	Location::Ptr imageLocation(size_t index) const;
+	Segment::Ptr imageSegment(size_t index) const;
+
+	// writes the whole network in the format binaryIs reads
+	void binaryWrite(std::ostream &out) const;
+
+	// builds the network in a snapshot file, read in place from a mapping,
+	// and installs its routes on the network's connectivity so that starting
+	// the simulation does not search for them again. Throws
+	// Fwk::ErrnoException if the file cannot be mapped and
+	// Fwk::StorageException if it is not a snapshot.
+	void snapshotIs(const string &path);
+	// writes the network and its precomputed routes as a snapshot,
+	// precomputing the routes first if they are out of date, along with
+	// state, if given, for whoever reads the snapshot back (Checkpoint.h)
+	void snapshotWrite(const string &path, const string &state = string());
+	// the state section of the last snapshot read; empty if it had none
+	const string &snapshotState() const { return state_; }
+
+	static Loader::Ptr LoaderNew(Network *network);
+
+protected:
+	Loader(Network *network);
+
+	Location::Ptr locationNew(const string &name, U8 type);
+	Segment::Ptr segmentNew(const string &name, U8 mode);
+	void segmentIs(Segment::Ptr segment, const Location::Ptr &source, float length,
+		const Segment::Ptr &returnSegment, int capacity, float difficulty, bool expedited);
+	void demandIs(Customer::Ptr customer, const Customer::Ptr &destination,
+		int shipmentSize, int transferRate, U8 priority);
+	void errorIs(const string &message);
+
+	Network *network_;
+	size_t locations_;
+	size_t segments_;
+	size_t demands_;
+	size_t errors_;
+	vector<Location::Ptr> imageLocations_;
+	vector<Segment::Ptr> imageSegments_;
+	string state_;
+};
+
+} /* end namespace */
+
+#endif
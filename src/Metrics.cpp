@@ -0,0 +1,154 @@
+#include "Metrics.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace Shipping {
+
+MetricsExporter::Ptr
+MetricsExporter::MetricsExporterNew(Network *network, U16 port)
+{
+	Ptr m = new MetricsExporter(network, port);
+	m->referencesDec(1);
+	// decr. refer count to compensate for initial val of 1
+	return m;
+}
+
+MetricsExporter::MetricsExporter(Network *network, U16 port):
+	statistics_(network->statistics()),
+	manager_(dynamic_cast<ActivityImpl::ManagerImpl *>(activityManagerInstance(network).ptr())),
+	listener_(-1),
+	port_(port)
+	{
+		listener_ = socket(AF_INET, SOCK_STREAM, 0);
+		if (listener_ < 0) throw Fwk::ErrnoException(errno);
+		int on = 1;
+		setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(port);
+		socklen_t length = sizeof(address);
+		if (bind(listener_, (struct sockaddr *) &address, length) < 0
+			|| listen(listener_, 16) < 0
+			|| getsockname(listener_, (struct sockaddr *) &address, &length) < 0) {
+			int error = errno;
+			close(listener_);
+			throw Fwk::ErrnoException(error);
+		}
+		port_ = ntohs(address.sin_port);
+
+		int error = pthread_create(&thread_, 0, &MetricsExporter::serve, this);
+		if (error) {
+			close(listener_);
+			throw Fwk::ErrnoException(error);
+		}
+	}
+
+MetricsExporter::~MetricsExporter()
+{
+	stopping_.valueIs(true);
+	// wakes the serving thread out of accept()
+	shutdown(listener_, SHUT_RDWR);
+	pthread_join(thread_, 0);
+	close(listener_);
+}
+
+void *
+MetricsExporter::serve(void *exporter)
+{
+	MetricsExporter *me = static_cast<MetricsExporter *>(exporter);
+	while (!me->stopping_.value()) {
+		int connection = accept(me->listener_, 0, 0);
+		if (connection < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			break;
+		}
+		me->requestIs(connection);
+		close(connection);
+	}
+	return 0;
+}
+
+void
+MetricsExporter::requestIs(int connection)
+{
+	// a client that never finishes its request must not wedge the thread
+	struct timeval timeout = { 1, 0 };
+	setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	string request;
+	char buffer[1024];
+	while (request.find("\r\n\r\n") == string::npos && request.size() < 8192) {
+		ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+		if (n <= 0) break;
+		request.append(buffer, n);
+	}
+	requests_.valueInc();
+
+	string body = metricsText();
+	std::stringstream response;
+	response << "HTTP/1.0 200 OK\r\n"
+		<< "Content-Type: text/plain; version=0.0.4\r\n"
+		<< "Content-Length: " << body.size() << "\r\n"
+		<< "Connection: close\r\n\r\n"
+		<< body;
+	string text = response.str();
+	size_t sent = 0;
+	while (sent < text.size()) {
+		ssize_t n = send(connection, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0) break;
+		sent += n;
+	}
+}
+
+static void
+metricIs(std::ostream &out, const char *name, const char *type, const char *help, double value)
+{
+	out << "# HELP " << name << " " << help << "\n"
+		<< "# TYPE " << name << " " << type << "\n"
+		<< name << " " << value << "\n";
+}
+
+string
+MetricsExporter::metricsText() const
+{
+	std::stringstream out;
+	out.precision(15);
+	if (statistics_) {
+		metricIs(out, "shipping_shipments_enroute", "gauge",
+			"Shipments injected and not yet delivered or dropped.",
+			statistics_->numShipments(Statistics::enroute()));
+		metricIs(out, "shipping_shipments_delivered_total", "counter",
+			"Shipments delivered to their destination.",
+			statistics_->numShipments(Statistics::delivered()));
+		metricIs(out, "shipping_shipments_dropped_total", "counter",
+			"Shipments dropped after waiting too long or arriving at the wrong customer.",
+			statistics_->numShipments(Statistics::dropped()));
+		metricIs(out, "shipping_segment_shipments_received_total", "counter",
+			"Shipments taken on by segments, summed over all segments.",
+			statistics_->numSegmentShipmentsReceived());
+		metricIs(out, "shipping_segment_shipments_told_to_wait_total", "counter",
+			"Shipments segments had no room for, summed over all segments.",
+			statistics_->numSegmentShipmentsToldToWait());
+		metricIs(out, "shipping_segment_shipments_refused_total", "counter",
+			"Shipments dropped by segments after waiting too long, summed over all segments.",
+			statistics_->numSegmentShipmentsRefused());
+	}
+	if (manager_) {
+		metricIs(out, "shipping_simulation_time_hours", "gauge",
+			"Simulated time reached by the activity manager.", manager_->clock());
+		metricIs(out, "shipping_activities_executed_total", "counter",
+			"Activities run by the activity manager.", manager_->activitiesExecuted());
+	}
+	metricIs(out, "shipping_metrics_requests_total", "counter",
+		"Scrapes served by this exporter.", requests_.value());
+	return out.str();
+}
+
+} /* end namespace */
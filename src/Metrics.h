@@ -0,0 +1,47 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "Engine.h"
+#include <pthread.h>
+
+namespace Shipping {
+
+// Serves the engine's counters in the Prometheus text format over HTTP on
+// 127.0.0.1, from a thread of its own. That thread only ever reads
+// Fwk::Atomic counters (the statistics' shipment counts and the activity
+// manager's clock), so scraping never takes a lock or touches anything the
+// simulation thread is changing. Any request path gets the metrics.
+class MetricsExporter : public Fwk::PtrInterface<MetricsExporter> {
+public:
+	typedef Fwk::Ptr<MetricsExporter> Ptr;
+	typedef Fwk::Ptr<MetricsExporter const> PtrConst;
+
+	// the port actually bound, which differs from the one asked for if
+	// that was 0
+	U16 port() const { return port_; }
+	U64 requests() const { return requests_.value(); }
+
+	string metricsText() const;
+
+	// throws Fwk::ErrnoException if the port cannot be bound
+	static MetricsExporter::Ptr MetricsExporterNew(Network *network, U16 port);
+
+protected:
+	MetricsExporter(Network *network, U16 port);
+	~MetricsExporter();
+
+	static void *serve(void *exporter);
+	void requestIs(int connection);
+
+	Statistics::PtrConst statistics_;
+	ActivityImpl::ManagerImpl::Ptr manager_;
+	int listener_;
+	U16 port_;
+	pthread_t thread_;
+	Fwk::Atomic<bool> stopping_;
+	Fwk::Atomic<U64> requests_;
+};
+
+} /* end namespace */
+
+#endif
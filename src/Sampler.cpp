@@ -0,0 +1,146 @@
+#include "Sampler.h"
+
+namespace Shipping {
+
+Sampler::Ptr
+Sampler::SamplerNew(Network *network, double interval, size_t capacity)
+{
+	Ptr m = new Sampler(network, interval, capacity);
+	m->referencesDec(1);
+	// decr. refer count to compensate for initial val of 1
+	m->samplingIs(true);
+	return m;
+}
+
+Sampler::Sampler(Network *network, double interval, size_t capacity):
+	network_(network),
+	interval_(interval),
+	capacity_(capacity ? capacity : 1),
+	next_(0),
+	samples_(0),
+	sampling_(false),
+	segments_(network->segments())
+	{
+		time_.resize(capacity_);
+		enroute_.resize(capacity_);
+		load_.resize(capacity_ * segments_.size());
+		toldToWait_.resize(capacity_ * segments_.size());
+		queue_.resize(capacity_ * segments_.size());
+	}
+
+void
+Sampler::intervalIs(double interval)
+{
+	interval_ = interval;
+	if (interval_ > 0) samplingIs(true);
+}
+
+void
+Sampler::samplingIs(bool sampling)
+{
+	if (sampling == sampling_) return;
+	sampling_ = sampling;
+	if (!sampling) return;
+
+	Activity::Manager::Ptr manager = activityManagerInstance(network_);
+	Activity::Ptr activity = manager->activityNew("SamplerActivity");
+	activity->lastNotifieeIs( new SamplerActivityReactor(manager, activity.ptr(), this) );
+	activity->nextTimeIs(manager->now());
+	activity->statusIs(Activity::nextTimeScheduled);
+}
+
+void
+Sampler::sampleIs(double now)
+{
+	time_[next_] = now;
+	Statistics::PtrConst stats = network_->statistics();
+	enroute_[next_] = stats ? stats->numShipments(Statistics::enroute()) : 0;
+	for (size_t s = 0; s < segments_.size(); s++) {
+		size_t i = s * capacity_ + next_;
+		load_[i] = segments_[s]->segmentLoad().value();
+		toldToWait_[i] = segments_[s]->numShipmentsToldToWait().value();
+		queue_[i] = segments_[s]->waitingShipments();
+	}
+	next_ = (next_ + 1) % capacity_;
+	if (samples_ < capacity_) samples_++;
+}
+
+void
+Sampler::csvIs(std::ostream &out) const
+{
+	out << "time,enroute";
+	for (size_t s = 0; s < segments_.size(); s++) {
+		const string &name = segments_[s]->name();
+		out << "," << name << " load," << name << " told to wait," << name << " queue";
+	}
+	out << "\n";
+
+	for (size_t i = 0; i < samples_; i++) {
+		size_t row = slot(i);
+		out << time_[row] << "," << enroute_[row];
+		for (size_t s = 0; s < segments_.size(); s++) {
+			size_t j = s * capacity_ + row;
+			out << "," << load_[j] << "," << toldToWait_[j] << "," << queue_[j];
+		}
+		out << "\n";
+	}
+}
+
+void
+Sampler::columnIs(std::ostream &out, const vector<U32> &column, size_t offset) const
+{
+	for (size_t i = 0; i < samples_; i++) {
+		out.write((const char *) &column[offset + slot(i)], sizeof(U32));
+	}
+}
+
+void
+Sampler::binaryIs(std::ostream &out) const
+{
+	U32 samples = samples_, segments = segments_.size();
+	out.write("SHSAMPL1", 8);
+	out.write((const char *) &samples, sizeof(samples));
+	out.write((const char *) &segments, sizeof(segments));
+	for (size_t s = 0; s < segments_.size(); s++) {
+		const string &name = segments_[s]->name();
+		U32 length = name.size();
+		out.write((const char *) &length, sizeof(length));
+		out.write(name.data(), length);
+	}
+
+	for (size_t i = 0; i < samples_; i++) {
+		out.write((const char *) &time_[slot(i)], sizeof(double));
+	}
+	columnIs(out, enroute_, 0);
+	for (size_t s = 0; s < segments_.size(); s++) {
+		columnIs(out, load_, s * capacity_);
+		columnIs(out, toldToWait_, s * capacity_);
+		columnIs(out, queue_, s * capacity_);
+	}
+}
+
+void SamplerActivityReactor::onStatus() {
+    switch (activity_->status()) {
+	    case Activity::executing:
+	    	sampler_->sampleIs(manager_->now().value());
+			break;
+
+	    case Activity::free:
+	    	//keep sampling until the interval is set to 0
+	    	if (sampler_->interval() > 0) {
+				activity_->nextTimeIs(Time(activity_->nextTime().value() + sampler_->interval()));
+				activity_->statusIs(Activity::nextTimeScheduled);
+			}
+			else sampler_->samplingIs(false);
+			break;
+
+	    case Activity::nextTimeScheduled:
+			//add myself to be scheduled
+			manager_->lastActivityIs(activity_);
+			break;
+
+	    default: break;
+    }
+}
+
+} /* end namespace */
@@ -0,0 +1,86 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "Engine.h"
+#include <ostream>
+
+namespace Shipping {
+
+// Periodic snapshots of the network while the simulation runs: the number
+// of shipments enroute and, for each segment, its load, its told-to-wait
+// count and its wait queue length. Samples go into preallocated columnar
+// ring buffers, so memory and per-sample cost are fixed when the sampler
+// is created; once full, the oldest samples are overwritten. Segments
+// created after the sampler are not sampled.
+class Sampler : public Fwk::PtrInterface<Sampler> {
+public:
+	typedef Fwk::Ptr<Sampler> Ptr;
+	typedef Fwk::Ptr<Sampler const> PtrConst;
+
+	// sample every interval hours; 0 stops the sampler after its next
+	// sample, and a positive interval afterwards starts it again
+	double interval() const { return interval_; }
+	void intervalIs(double interval);
+
+	// whether a sampling activity is scheduled; true schedules one for now
+	// if there is none, false is how that activity reports it has stopped
+	bool sampling() const { return sampling_; }
+	void samplingIs(bool sampling);
+
+	size_t capacity() const { return capacity_; }
+	size_t samples() const { return samples_; }
+	size_t segments() const { return segments_.size(); }
+
+	void sampleIs(double now);
+
+	// header line, then one line per sample, oldest first
+	void csvIs(std::ostream &out) const;
+	// "SHSAMPL1", U32 samples, U32 segments, the segment names (U32 length
+	// then bytes), then each column oldest first: time (double), enroute,
+	// and load, told to wait and queue length (U32) for each segment in turn
+	void binaryIs(std::ostream &out) const;
+
+	static Sampler::Ptr SamplerNew(Network *network, double interval, size_t capacity);
+
+protected:
+	Sampler(Network *network, double interval, size_t capacity);
+
+	// position of the i'th oldest sample in the ring
+	size_t slot(size_t i) const { return (next_ + capacity_ - samples_ + i) % capacity_; }
+	void columnIs(std::ostream &out, const vector<U32> &column, size_t offset) const;
+
+	Network *network_;
+	double interval_;
+	size_t capacity_;
+	size_t next_;
+	size_t samples_;
+	bool sampling_;
+	vector<Segment::PtrConst> segments_;
+	vector<double> time_;
+	vector<U32> enroute_;
+	// segment s's values live at [s * capacity_, (s + 1) * capacity_)
+	vector<U32> load_;
+	vector<U32> toldToWait_;
+	vector<U32> queue_;
+};
+
+class SamplerActivityReactor : public Activity::Notifiee {
+public:
+	void onStatus();
+
+	SamplerActivityReactor(Fwk::Ptr<Activity::Manager> manager, Activity *activity, Sampler *sampler):
+		Notifiee(activity),
+		sampler_(sampler),
+		activity_(activity),
+		manager_(manager)
+		{}
+
+protected:
+	Sampler::Ptr sampler_;
+	Activity::Ptr activity_;
+	Fwk::Ptr<Activity::Manager> manager_;
+};
+
+} /* end namespace */
+
+#endif
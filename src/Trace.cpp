@@ -0,0 +1,198 @@
+#include "Trace.h"
+#include <stdio.h>
+
+namespace Shipping {
+
+static const size_t bufferSize = 1 << 20;
+static const int segmentsProcess = 1;
+static const int customersProcess = 2;
+
+// trace timestamps are microseconds
+static double microseconds(double hours) { return hours * 3600.0 * 1e6; }
+
+static string
+escaped(const string &s)
+{
+	string e;
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\') e += '\\';
+		if ((unsigned char) s[i] >= 0x20) e += s[i];
+	}
+	return e;
+}
+
+Tracer::Ptr
+Tracer::TracerNew(const string &path)
+{
+	Ptr m = new Tracer(path);
+	m->referencesDec(1);
+	// decr. refer count to compensate for initial val of 1
+	return m;
+}
+
+Tracer::Tracer(const string &path):
+	out_(path.c_str()),
+	events_(0),
+	closed_(false)
+	{
+		buffer_.reserve(bufferSize + 1024);
+		buffer_ = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		char line[256];
+		int n = snprintf(line, sizeof(line),
+			"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"segments\"}}", segmentsProcess);
+		eventIs(line, n);
+		n = snprintf(line, sizeof(line),
+			"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"customers\"}}", customersProcess);
+		eventIs(line, n);
+	}
+
+Tracer::~Tracer()
+{
+	closeIs();
+}
+
+void
+Tracer::closeIs()
+{
+	if (closed_) return;
+	buffer_ += "\n]}\n";
+	flushIs();
+	out_.close();
+	closed_ = true;
+}
+
+void
+Tracer::flushIs()
+{
+	out_.write(buffer_.data(), buffer_.size());
+	buffer_.clear();
+}
+
+void
+Tracer::eventIs(const char *text, size_t length)
+{
+	if (events_++) buffer_ += ",\n";
+	buffer_.append(text, length);
+	if (buffer_.size() >= bufferSize) flushIs();
+}
+
+U32
+Tracer::segmentTrack(const Segment *segment)
+{
+	map<const Segment *, U32>::iterator found = segmentTracks_.find(segment);
+	if (found != segmentTracks_.end()) return found->second;
+	U32 track = segmentTracks_.size() + 1;
+	segmentTracks_[segment] = track;
+	string line = "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+	char number[16];
+	snprintf(number, sizeof(number), "%u", track);
+	line += number;
+	line += ",\"args\":{\"name\":\"" + escaped(segment->name()) + "\"}}";
+	eventIs(line.data(), line.size());
+	return track;
+}
+
+U32
+Tracer::customerTrack(const Customer *customer)
+{
+	U32 track = customer->id() + 1;
+	if (track >= customerTracks_.size()) customerTracks_.resize(track + 1, false);
+	if (customerTracks_[track]) return track;
+	customerTracks_[track] = true;
+	string line = "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":";
+	char number[16];
+	snprintf(number, sizeof(number), "%u", track);
+	line += number;
+	line += ",\"args\":{\"name\":\"" + escaped(customer->name()) + "\"}}";
+	eventIs(line.data(), line.size());
+	return track;
+}
+
+void
+Tracer::transitIs(const Segment *segment, const Shipment *shipment, double start, double end)
+{
+	if (closed_) return;
+	U32 track = segmentTrack(segment);
+	char line[256];
+	int n = snprintf(line, sizeof(line),
+		"{\"name\":\"transit\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.0f,\"dur\":%.0f,"
+		"\"args\":{\"shipment\":%llu,\"packages\":%u,\"source\":%u,\"destination\":%u}}",
+		segmentsProcess, track, microseconds(start), microseconds(end - start),
+		(unsigned long long) shipment->id(), (unsigned) shipment->load().value(), shipment->source()->id(), shipment->dest()->id());
+	eventIs(line, n);
+}
+
+void
+Tracer::tripIs(const Segment *segment, size_t shipments, PackageCount load, double start, double end)
+{
+	if (closed_) return;
+	U32 track = segmentTrack(segment);
+	char line[256];
+	int n = snprintf(line, sizeof(line),
+		"{\"name\":\"trip\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.0f,\"dur\":%.0f,"
+		"\"args\":{\"shipments\":%u,\"packages\":%u}}",
+		segmentsProcess, track, microseconds(start), microseconds(end - start),
+		(unsigned) shipments, (unsigned) load.value());
+	eventIs(line, n);
+}
+
+void
+Tracer::waitIs(const Segment *segment, const Shipment *shipment, double now)
+{
+	if (closed_) return;
+	U32 track = segmentTrack(segment);
+	char line[256];
+	int n = snprintf(line, sizeof(line),
+		"{\"name\":\"told to wait\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%.0f,"
+		"\"args\":{\"shipment\":%llu,\"packages\":%u}}",
+		segmentsProcess, track, microseconds(now),
+		(unsigned long long) shipment->id(), (unsigned) shipment->load().value());
+	eventIs(line, n);
+}
+
+void
+Tracer::retryIs(const Segment *segment, const Shipment *shipment, double now, bool admitted)
+{
+	if (closed_) return;
+	U32 track = segmentTrack(segment);
+	char line[256];
+	int n = snprintf(line, sizeof(line),
+		"{\"name\":\"retry\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%.0f,"
+		"\"args\":{\"shipment\":%llu,\"packages\":%u,\"admitted\":%s}}",
+		segmentsProcess, track, microseconds(now),
+		(unsigned long long) shipment->id(), (unsigned) shipment->load().value(),
+		admitted ? "true" : "false");
+	eventIs(line, n);
+}
+
+void
+Tracer::deliveredIs(const Shipment *shipment, double now)
+{
+	if (closed_) return;
+	U32 track = customerTrack(shipment->dest().ptr());
+	char line[256];
+	int n = snprintf(line, sizeof(line),
+		"{\"name\":\"delivered\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%.0f,"
+		"\"args\":{\"shipment\":%llu,\"source\":%u,\"latency\":%.2f,\"wait\":%.2f}}",
+		customersProcess, track, microseconds(now),
+		(unsigned long long) shipment->id(), shipment->source()->id(),
+		shipment->latency().value(), shipment->wait().value());
+	eventIs(line, n);
+}
+
+void
+Tracer::droppedIs(const Shipment *shipment, double now)
+{
+	if (closed_) return;
+	U32 track = customerTrack(shipment->source().ptr());
+	char line[256];
+	int n = snprintf(line, sizeof(line),
+		"{\"name\":\"dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%.0f,"
+		"\"args\":{\"shipment\":%llu,\"destination\":%u,\"packages\":%u}}",
+		customersProcess, track, microseconds(now),
+		(unsigned long long) shipment->id(), shipment->dest()->id(),
+		(unsigned) shipment->load().value());
+	eventIs(line, n);
+}
+
+} /* end namespace */
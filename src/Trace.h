@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "Engine.h"
+#include <fstream>
+
+namespace Shipping {
+
+// Writes simulation events in the Chrome trace_event JSON format, for
+// chrome://tracing or ui.perfetto.dev. Timestamps are simulated time (an
+// hour is 3600s on the timeline). Each segment gets a track in the
+// "segments" process, holding a span per shipment transit or trip and
+// instant events for shipments told to wait and retries. Each customer
+// gets a track in the "customers" process, holding deliveries (on the
+// destination) and drops (on the source). Shipment events carry the
+// shipment's id, so one shipment can be followed across tracks. Events
+// are formatted into a buffer that is written out whenever it fills, so
+// tracing costs one formatted line per event and an occasional large
+// write.
+class Tracer : public Fwk::PtrInterface<Tracer> {
+public:
+	typedef Fwk::Ptr<Tracer> Ptr;
+	typedef Fwk::Ptr<Tracer const> PtrConst;
+
+	bool ok() const { return out_.good(); }
+	size_t events() const { return events_; }
+
+	void transitIs(const Segment *segment, const Shipment *shipment, double start, double end);
+	void tripIs(const Segment *segment, size_t shipments, PackageCount load, double start, double end);
+	void waitIs(const Segment *segment, const Shipment *shipment, double now);
+	void retryIs(const Segment *segment, const Shipment *shipment, double now, bool admitted);
+	void deliveredIs(const Shipment *shipment, double now);
+	void droppedIs(const Shipment *shipment, double now);
+
+	// writes out what is buffered and closes the JSON; later events are
+	// ignored. The destructor does the same.
+	void closeIs();
+
+	static Tracer::Ptr TracerNew(const string &path);
+
+protected:
+	Tracer(const string &path);
+	~Tracer();
+
+	U32 segmentTrack(const Segment *segment);
+	U32 customerTrack(const Customer *customer);
+	void eventIs(const char *text, size_t length);
+	void flushIs();
+
+	std::ofstream out_;
+	string buffer_;
+	size_t events_;
+	bool closed_;
+	map<const Segment *, U32> segmentTracks_;
+	vector<bool> customerTracks_;
+};
+
+} /* end namespace */
+
+#endif
@@ -0,0 +1,194 @@
+//Timing harness for the engine's hot paths. Builds the experiment network
+//(100 sources feeding one destination through 10 terminals and a hub, with
+//random shipment sizes), times the route precomputation and the simulation
+//(72 hours unless given) in all and per hop, and then times the statistics
+//bookkeeping of a shipment's lifecycle and an arrival's dispatch on the
+//same network, rep layer attribute calls by name against the same calls
+//through attribute ids, a reconfiguration of every customer with and
+//without a transaction, and the end of run statistics report. Shipment
+//arena use is reported after the simulation; an INSTRUMENT=1 build also
+//reports how many heap allocations each simulated shipment cost.
+//
+//usage: benchmark [lifecycles] [simulated hours] [trace file]
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+#include <sys/time.h>
+#include "Instance.h"
+#include "ExperimentNetwork.h"
+#include "ActivityImpl.h"
+#include "Engine.h"
+#include "Instrument.h"
+
+using namespace std;
+using namespace Shipping;
+
+static double seconds() {
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+	size_t lifecycles = argc > 1 ? atoi(argv[1]) : 200000;
+	double hours = argc > 2 ? atof(argv[2]) : 72.0;
+	srand(1);
+
+	Ptr<Instance::Manager> manager = shippingInstanceManager();
+	SetUpExperimentNetwork(manager, true);
+	Network *network = manager->network();
+	Activity::Manager::Ptr activityManager = activityManagerInstance(network);
+	if (argc > 3) manager->instance("stats")->attributeIs("trace file", argv[3]);
+
+	// the first nowIs precomputes the routes
+	double start = seconds();
+	activityManager->nowIs(0.0);
+	double precompute = seconds() - start;
+	cout << "route precompute        : " << precompute << " s" << endl;
+
+	U64 allocations = Instrument::allocations();
+	U64 arenaObjects = Shipment::arena().objects();
+	start = seconds();
+	activityManager->nowIs(hours);
+	if (argc > 3) manager->instance("stats")->attributeIs("trace file", "");
+	double simulation = seconds() - start;
+	allocations = Instrument::allocations() - allocations;
+	arenaObjects = Shipment::arena().objects() - arenaObjects;
+	size_t simulated = network->statistics()->numShipments(Statistics::enroute())
+		+ network->statistics()->numShipments(Statistics::delivered())
+		+ network->statistics()->numShipments(Statistics::dropped());
+	cout << "simulation (" << hours << "h)        : " << simulation << " s, "
+		<< simulated << " shipments" << endl;
+	// every segment a shipment enters is one hop: a segment arrival and
+	// then a location arrival
+	U64 hops = 0;
+	for (Network::SegmentIterator i = network->segmentIter(); i.ptr(); ++i) {
+		hops += (U64) i->numShipmentsReceived().value();
+	}
+	if (hops) cout << "per hop                 : " << simulation / hops * 1e9 << " ns, " << hops << " hops" << endl;
+	cout << "shipment arena          : " << arenaObjects << " objects from "
+		<< Shipment::arena().slabs() << " slabs, " << Shipment::arena().live() << " live" << endl;
+	if (Instrument::enabled() && simulated) {
+		cout << "heap allocations        : " << (double) allocations / simulated
+			<< " per shipment" << endl;
+	} else {
+		cout << "heap allocations        : build with INSTRUMENT=1 to count" << endl;
+	}
+
+	// statistics bookkeeping per shipment lifecycle, round robin over the
+	// 100 source customers
+	vector<Customer::Ptr> sources;
+	vector<Location::PtrConst> locations = network->locations();
+	for (size_t i = 0; i < locations.size(); i++) {
+		if (locations[i]->locationType() != Location::customer()) continue;
+		if (locations[i]->name() == "destcustomer") continue;
+		sources.push_back(const_cast<Customer *>(dynamic_cast<Customer const *>(locations[i].ptr())));
+	}
+	Customer::Ptr dest = dynamic_cast<Customer *>(network->location("destcustomer").ptr());
+	Statistics::Ptr stats = const_cast<Statistics *>(network->statistics().ptr());
+
+	vector<Shipment::Ptr> shipments;
+	shipments.reserve(lifecycles);
+	start = seconds();
+	for (size_t i = 0; i < lifecycles; i++) {
+		shipments.push_back(network->shipmentNew(sources[i % sources.size()], dest, PackageCount(100)));
+	}
+	double created = seconds() - start;
+
+	start = seconds();
+	for (size_t i = 0; i < lifecycles; i += 2) stats->deliveredShipmentIs(shipments[i]);
+	for (size_t i = 1; i < lifecycles; i += 2) stats->droppedShipmentIs(shipments[i]);
+	double finished = seconds() - start;
+
+	cout << "shipmentNew             : " << created / lifecycles * 1e9 << " ns/shipment" << endl;
+	cout << "delivered/dropped stats : " << finished / lifecycles * 1e9 << " ns/shipment" << endl;
+
+	// arrivals at a customer that is neither end of the shipment: the
+	// dispatch to the location's reactor plus a drop
+	Location::Ptr bystander = sources[1].ptr();
+	size_t arrivals = 0;
+	start = seconds();
+	for (size_t i = 0; i < lifecycles; i++) {
+		if (i % sources.size() == 1) continue;
+		bystander->arrivingShipmentIs(shipments[i]);
+		arrivals++;
+	}
+	double dispatched = seconds() - start;
+	if (arrivals) cout << "arrival dispatch + drop : " << dispatched / arrivals * 1e9 << " ns/arrival" << endl;
+
+	// a driver polling counters and adjusting capacities, by name and by id
+	Ptr<Instance> segment = manager->instance("seg1");
+	Ptr<Instance> customer = manager->instance("destcustomer");
+	Ptr<Instance> fleet = manager->instance("fleet");
+	string polled;
+	start = seconds();
+	for (size_t i = 0; i < lifecycles; i++) {
+		polled = segment->attribute("Shipments Received");
+		polled = customer->attribute("Average Latency");
+		segment->attributeIs("Capacity", "30");
+		fleet->attributeIs("Truck, speed night", "20");
+	}
+	double byName = seconds() - start;
+
+	Instance::AttributeId received = segment->attributeId("Shipments Received");
+	Instance::AttributeId latency = customer->attributeId("Average Latency");
+	Instance::AttributeId capacity = segment->attributeId("Capacity");
+	Instance::AttributeId nightSpeed = fleet->attributeId("Truck, speed night");
+	double value = 0;
+	start = seconds();
+	for (size_t i = 0; i < lifecycles; i++) {
+		value += segment->attributeValue(received);
+		value += customer->attributeValue(latency);
+		segment->attributeValueIs(capacity, 30);
+		fleet->attributeValueIs(nightSpeed, 20);
+	}
+	double byId = seconds() - start;
+
+	cout << "attributes by name      : " << byName / lifecycles / 4 * 1e9 << " ns/call" << endl;
+	cout << "attributes by id        : " << byId / lifecycles / 4 * 1e9 << " ns/call" << endl;
+
+	// every source customer's demand set ten times over, the way a driver
+	// sweeping a parameter would, directly and then in a transaction
+	vector<Ptr<Instance> > customers;
+	for (size_t i = 0; i < sources.size(); i++) customers.push_back(manager->instance(sources[i]->name()));
+	const size_t sweeps = 10;
+	size_t rounds = lifecycles / (customers.size() * sweeps) + 1;
+	start = seconds();
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t sweep = 0; sweep < sweeps; sweep++) {
+			for (size_t i = 0; i < customers.size(); i++) {
+				customers[i]->attributeIs("Transfer Rate", "10");
+				customers[i]->attributeIs("Shipment Size", "100");
+				customers[i]->attributeIs("Destination", "destcustomer");
+			}
+		}
+	}
+	double direct = seconds() - start;
+	start = seconds();
+	for (size_t r = 0; r < rounds; r++) {
+		manager->transactionIs(true);
+		for (size_t sweep = 0; sweep < sweeps; sweep++) {
+			for (size_t i = 0; i < customers.size(); i++) {
+				customers[i]->attributeIs("Transfer Rate", "10");
+				customers[i]->attributeIs("Shipment Size", "100");
+				customers[i]->attributeIs("Destination", "destcustomer");
+			}
+		}
+		manager->transactionIs(false);
+	}
+	double transaction = seconds() - start;
+	double changes = (double) rounds * sweeps * customers.size() * 3;
+	cout << "reconfiguration         : " << direct / changes * 1e9 << " ns/change" << endl;
+	cout << "in a transaction        : " << transaction / changes * 1e9 << " ns/change" << endl;
+
+	// the end of run report, which walks every customer and segment
+	const size_t reports = 1000;
+	size_t reported = 0;
+	start = seconds();
+	for (size_t i = 0; i < reports; i++) reported += network->statistics()->simulationStatisticsOutput().size();
+	double report = seconds() - start;
+	cout << "statistics output       : " << report / reports * 1e6 << " us/report" << endl;
+	return 0;
+}
@@ -0,0 +1,94 @@
+// Arena.h
+
+#ifndef FWK_ARENA_H
+#define FWK_ARENA_H
+
+#include "Types.h"
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+namespace Fwk {
+
+// Slab allocator for small objects that are created and destroyed at a
+// high rate. Sizes are rounded up to a multiple of granularity; each such
+// size class carves its objects out of slabBytes slabs and keeps the ones
+// handed back on a free list, so steady-state churn never reaches malloc.
+// Larger objects go to the global operator new. Slabs are only returned
+// in bulk, by slabsDel() or the destructor. Not thread-safe.
+class Arena {
+public:
+    static const size_t granularity = 16;
+    static const size_t classes = 16;
+    static const size_t largestObject = granularity * classes;
+    static const size_t slabBytes = 64 * 1024;
+
+    Arena() : live_(0), objects_(0) {
+        for( size_t i = 0; i < classes; i++ ) free_[i] = 0;
+    }
+    ~Arena() { slabsRelease(); }
+
+    void * objectNew( size_t size ) {
+        if( size > largestObject ) return ::operator new( size );
+        size_t c = sizeClass( size );
+        if( !free_[c] ) slabNew( c );
+        FreeObject * object = free_[c];
+        free_[c] = object->next;
+        ++live_;
+        ++objects_;
+        return object;
+    }
+    void objectDel( void * p, size_t size ) {
+        if( !p ) return;
+        if( size > largestObject ) { ::operator delete( p ); return; }
+        size_t c = sizeClass( size );
+        FreeObject * object = static_cast<FreeObject *>( p );
+        object->next = free_[c];
+        free_[c] = object;
+        --live_;
+    }
+
+    // objects currently handed out, objects ever handed out, and slabs held
+    size_t live() const { return live_; }
+    U64 objects() const { return objects_; }
+    size_t slabs() const { return slabs_.size(); }
+
+    // returns every slab at once; does nothing while any object is live
+    void slabsDel() { if( !live_ ) slabsRelease(); }
+
+private:
+    struct FreeObject { FreeObject * next; };
+
+    static size_t sizeClass( size_t size ) {
+        return size ? ( size - 1 ) / granularity : 0;
+    }
+    void slabNew( size_t c ) {
+        size_t objectBytes = ( c + 1 ) * granularity;
+        char * slab = static_cast<char *>( malloc( slabBytes ) );
+        if( !slab ) throw std::bad_alloc();
+        slabs_.push_back( slab );
+        // pushed last to first so the slab is handed out in address order
+        for( size_t i = slabBytes / objectBytes; i-- > 0; ) {
+            FreeObject * object = reinterpret_cast<FreeObject *>( slab + i * objectBytes );
+            object->next = free_[c];
+            free_[c] = object;
+        }
+    }
+    void slabsRelease() {
+        for( size_t i = 0; i < slabs_.size(); i++ ) free( slabs_[i] );
+        slabs_.clear();
+        for( size_t i = 0; i < classes; i++ ) free_[i] = 0;
+    }
+
+    Arena( const Arena & );
+    Arena & operator=( const Arena & );
+
+    FreeObject * free_[classes];
+    std::vector<char *> slabs_;
+    size_t live_;
+    U64 objects_;
+};
+
+}
+
+#endif
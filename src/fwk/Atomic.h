@@ -0,0 +1,40 @@
+// Atomic.h
+
+#ifndef FWK_ATOMIC_H
+#define FWK_ATOMIC_H
+
+#include "Types.h"
+
+namespace Fwk {
+
+// A value that one thread may update while others read it, without locks.
+// Accesses are relaxed: each value is always read whole, but reads of two
+// different Atomics need not be consistent with each other. T must be a
+// type the compiler can load and store atomically (integers, pointers,
+// double on 64 bit targets); valueInc only makes sense for integers.
+template <class T>
+class Atomic {
+public:
+    Atomic() : value_(T()) {}
+    Atomic(T v) : value_(v) {}
+
+    T value() const {
+        T v;
+        __atomic_load(&value_, &v, __ATOMIC_RELAXED);
+        return v;
+    }
+    void valueIs(T v) { __atomic_store(&value_, &v, __ATOMIC_RELAXED); }
+    T valueInc(T n = 1) { return __atomic_add_fetch(&value_, n, __ATOMIC_RELAXED); }
+
+    operator T() const { return value(); }
+    Atomic & operator=(T v) { valueIs(v); return *this; }
+
+private:
+    Atomic(const Atomic &);
+    Atomic & operator=(const Atomic &);
+    T value_;
+};
+
+}
+
+#endif
@@ -6,13 +6,16 @@
 
 #include "PtrInterface.h"
 #include "BaseNotifiee.h"
+#include "Symbol.h"
 
 namespace Fwk {
 
 class NamedInterface : public PtrInterface<NamedInterface>
 {
 public:
-	String name() const { return name_; }
+	String const & name() const { return name_.value(); }
+	// the name interned, for comparing and hashing names as pointers
+	Symbol symbol() const { return name_; }
 
 	class NotifieeConst : virtual public RootNotifiee {
 	public:
@@ -28,9 +31,10 @@ public:
 
 protected:
 	NamedInterface(const String& name) : name_(name) { }
+	NamedInterface(const Symbol& name) : name_(name) { }
 
 private:
-	String name_;
+	Symbol name_;
 };
 
 }
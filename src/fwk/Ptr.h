@@ -17,6 +17,19 @@ class Ptr {
     ~Ptr();
     void operator=( const Ptr<T>& mp );
     void operator=( Ptr<T>& mp );
+#if __cplusplus >= 201103L
+    // moves hand the reference over instead of taking a new one
+    Ptr( Ptr<T>&& mp ) : value_(mp.value_) { mp.value_ = 0; }
+    void operator=( Ptr<T>&& mp ) {
+        if( &mp == this ) return;
+        T * save = value_;
+        value_ = mp.value_;
+        mp.value_ = 0;
+        if( save ) save->deleteRef();
+    }
+#endif
+    // exchanges referents without touching either reference count
+    void swap( Ptr<T>& mp ) { T * save = value_; value_ = mp.value_; mp.value_ = save; }
     bool operator==( const Ptr<T>& mp ) const { return mp.value_ == value_; }
     bool operator!=( const Ptr<T>& mp ) const { return mp.value_ != value_; }
     const T * operator->() const { return value_; }
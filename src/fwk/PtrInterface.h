@@ -8,13 +8,35 @@
 
 namespace Fwk {
 
-template <class T>
+// Reference count policies for PtrInterface. The default is a plain
+// counter, which is all a single simulation thread needs; an object whose
+// Ptrs are copied and dropped on several threads at once must use
+// AtomicRefCount instead.
+struct NonAtomicRefCount {
+    static void inc( unsigned long &ref ) { ++ref; }
+    static unsigned long dec( unsigned long &ref, U32 n = 1 ) { return ref -= n; }
+    static unsigned long value( const unsigned long &ref ) { return ref; }
+};
+
+struct AtomicRefCount {
+    static void inc( unsigned long &ref ) { __atomic_add_fetch(&ref, 1, __ATOMIC_RELAXED); }
+    // the thread that drops the last reference must see every other
+    // thread's writes to the object before deleting it
+    static unsigned long dec( unsigned long &ref, U32 n = 1 ) {
+        return __atomic_sub_fetch(&ref, (unsigned long) n, __ATOMIC_ACQ_REL);
+    }
+    static unsigned long value( const unsigned long &ref ) {
+        return __atomic_load_n(&ref, __ATOMIC_RELAXED);
+    }
+};
+
+template <class T, class RefCount = NonAtomicRefCount>
 class PtrInterface {
 private:
     long unsigned ref_;
 public:
     PtrInterface() : ref_(1) {}
-    unsigned long references() const { return ref_; }
+    unsigned long references() const { return RefCount::value(ref_); }
     enum Attribute {
       nextAttributeNumber__ = 1
     };
@@ -28,23 +50,23 @@ protected:
     virtual void onZeroReferences() { delete this; }
 };
 
-template<class T> const PtrInterface<T> * 
-PtrInterface<T>::newRef() const { 
+template<class T, class RefCount> const PtrInterface<T, RefCount> * 
+PtrInterface<T, RefCount>::newRef() const { 
     PtrInterface *me = const_cast<PtrInterface *>( this );
-    ++me->ref_;
+    RefCount::inc(me->ref_);
     return this;
 }
 
-template<class T> void 
-PtrInterface<T>::deleteRef() const {
+template<class T, class RefCount> void 
+PtrInterface<T, RefCount>::deleteRef() const {
     PtrInterface *me = const_cast<PtrInterface *>( this );
-    if( --me->ref_ == 0 ) me->onZeroReferences();
+    if( RefCount::dec(me->ref_) == 0 ) me->onZeroReferences();
 }
 
-template<class T> void 
-PtrInterface<T>::referencesDec( U32 dec ) const {
+template<class T, class RefCount> void 
+PtrInterface<T, RefCount>::referencesDec( U32 dec ) const {
     PtrInterface *me = const_cast<PtrInterface *>( this );
-    if((me->ref_-=dec) == 0 ) me->onZeroReferences();
+    if( RefCount::dec(me->ref_, dec) == 0 ) me->onZeroReferences();
 }
 
 }
@@ -0,0 +1,183 @@
+// Registry.h
+
+#ifndef FWK_REGISTRY_H
+#define FWK_REGISTRY_H
+
+#include "Types.h"
+#include "String.h"
+#include <vector>
+#include <algorithm>
+
+namespace Fwk {
+
+// Members of type T (a Ptr, or anything default constructible) by name.
+// Members sit in a dense array of slots; a member's handle is its slot,
+// which stays the same for as long as the member stays registered and is
+// reused after it leaves. Names are found through an open-addressed table
+// of slot numbers with linear probing, kept at most half full, so a lookup
+// hashes the name once and usually compares a single string. The handles
+// are also kept in name order: members added since the last ordered
+// listing wait at the end of that list and are sorted and merged in when
+// the next listing is asked for. Not thread-safe.
+template<typename T>
+class Registry {
+public:
+    typedef U32 Handle;
+    static Handle none() { return ~(Handle) 0; }
+
+    Registry() : shift_( 32 ), members_( 0 ), tombstones_( 0 ), free_( none() ), ordered_( 0 ) {}
+
+    U32 members() const { return members_; }
+    // one more than the largest handle in use, for iterating over them all
+    Handle handles() const { return slot_.size(); }
+
+    // none() if there is no member by that name
+    Handle handle( String const & name ) const {
+        if( index_.empty() ) return none();
+        U32 mask = index_.size() - 1;
+        U32 h = hash( name );
+        for( U32 i = position( h ); ; i = ( i + 1 ) & mask ) {
+            U32 s = index_[i];
+            if( s == emptyIndex ) return none();
+            if( s != tombstoneIndex && slot_[s].hash == h && slot_[s].name == name ) return s;
+        }
+    }
+
+    // the member with the handle, empty if there is none
+    T const & member( Handle h ) const { return slot_[h].member; }
+    T member( String const & name ) const {
+        Handle h = handle( name );
+        return h == none() ? T() : slot_[h].member;
+    }
+    String const & name( Handle h ) const { return slot_[h].name; }
+
+    // the handles in use, ordered by name; valid until the next change
+    std::vector<Handle> const & handlesByName() const {
+        if( ordered_ < byName_.size() ) {
+            typename std::vector<Handle>::iterator middle = byName_.begin() + ordered_;
+            std::sort( middle, byName_.end(), NameOrder( slot_ ) );
+            std::inplace_merge( byName_.begin(), middle, byName_.end(), NameOrder( slot_ ) );
+            ordered_ = byName_.size();
+        }
+        return byName_;
+    }
+
+    // adds name, or replaces the member registered under it
+    Handle memberIs( String const & name, T const & member ) {
+        Handle h = handle( name );
+        if( h != none() ) {
+            slot_[h].member = member;
+            return h;
+        }
+        if( ( members_ + tombstones_ + 1 ) * 2 > index_.size() ) indexNew();
+        if( free_ != none() ) {
+            h = free_;
+            free_ = slot_[h].nextFree;
+        } else {
+            h = slot_.size();
+            slot_.push_back( Slot() );
+        }
+        Slot & slot = slot_[h];
+        slot.used = true;
+        slot.name = name;
+        slot.hash = hash( name );
+        slot.member = member;
+        indexIs( slot.hash, h );
+        byName_.push_back( h );
+        ++members_;
+        return h;
+    }
+
+    // false if there is no member by that name
+    bool memberDel( String const & name ) {
+        if( index_.empty() ) return false;
+        U32 mask = index_.size() - 1;
+        U32 h = hash( name );
+        for( U32 i = position( h ); ; i = ( i + 1 ) & mask ) {
+            U32 s = index_[i];
+            if( s == emptyIndex ) return false;
+            if( s == tombstoneIndex || slot_[s].hash != h || slot_[s].name != name ) continue;
+            index_[i] = tombstoneIndex;
+            ++tombstones_;
+            byNameDel( s );
+            Slot & slot = slot_[s];
+            slot.used = false;
+            slot.name = String();
+            slot.member = T();
+            slot.nextFree = free_;
+            free_ = s;
+            --members_;
+            return true;
+        }
+    }
+
+private:
+    static const U32 emptyIndex = ~(U32) 0;
+    static const U32 tombstoneIndex = ~(U32) 0 - 1;
+
+    struct Slot {
+        Slot() : used( false ), hash( 0 ), nextFree( ~(Handle) 0 ) {}
+        bool used;
+        String name;
+        U32 hash;
+        Handle nextFree;
+        T member;
+    };
+
+    struct NameOrder {
+        NameOrder( std::vector<Slot> const & slot ) : slot_( slot ) {}
+        bool operator()( Handle a, Handle b ) const { return slot_[a].name < slot_[b].name; }
+        std::vector<Slot> const & slot_;
+    };
+
+    // before the slot's name is cleared: a binary search in the ordered
+    // part of byName_, or a scan of the members added since
+    void byNameDel( Handle s ) {
+        typename std::vector<Handle>::iterator middle = byName_.begin() + ordered_;
+        typename std::vector<Handle>::iterator i = std::lower_bound( byName_.begin(), middle, s, NameOrder( slot_ ) );
+        if( i != middle && *i == s ) --ordered_;
+        else i = std::find( middle, byName_.end(), s );
+        byName_.erase( i );
+    }
+
+    // Fibonacci hashing spreads the framework's string hash over the table
+    U32 position( U32 h ) const {
+        return (U32) ( h * 2654435769u ) >> shift_;
+    }
+
+    void indexIs( U32 h, Handle s ) {
+        U32 mask = index_.size() - 1;
+        U32 i = position( h );
+        while( index_[i] != emptyIndex && index_[i] != tombstoneIndex ) i = ( i + 1 ) & mask;
+        if( index_[i] == tombstoneIndex ) --tombstones_;
+        index_[i] = s;
+    }
+
+    // rebuilds the index big enough to stay at most half full, dropping
+    // tombstones
+    void indexNew() {
+        U32 size = 16;
+        while( size < ( members_ + 1 ) * 4 ) size *= 2;
+        index_.assign( size, (U32) emptyIndex );
+        tombstones_ = 0;
+        shift_ = 32;
+        for( U32 s = size; s > 1; s /= 2 ) --shift_;
+        for( Handle h = 0; h < slot_.size(); h++ ) {
+            if( slot_[h].used ) indexIs( slot_[h].hash, h );
+        }
+    }
+
+    std::vector<Slot> slot_;
+    std::vector<U32> index_;
+    U32 shift_;
+    U32 members_;
+    U32 tombstones_;
+    Handle free_;
+    mutable std::vector<Handle> byName_;
+    // how many of byName_'s leading handles are in order
+    mutable U32 ordered_;
+};
+
+} // namespace Fwk
+
+#endif
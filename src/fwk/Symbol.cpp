@@ -0,0 +1,47 @@
+// Symbol.cpp
+
+#include "Symbol.h"
+#include "Registry.h"
+#include <pthread.h>
+
+namespace {
+
+// the entries are allocated one by one so that they do not move as the
+// registry grows
+Fwk::Registry<Fwk::String const *> & table() {
+    static Fwk::Registry<Fwk::String const *> * t = new Fwk::Registry<Fwk::String const *>;
+    return *t;
+}
+
+pthread_mutex_t tableLock = PTHREAD_MUTEX_INITIALIZER;
+
+}
+
+Fwk::String const *
+Fwk::Symbol::intern( String const & name ) {
+    pthread_mutex_lock( &tableLock );
+    Registry<String const *>::Handle h = table().handle( name );
+    String const * entry;
+    if( h != table().none() ) {
+        entry = table().member( h );
+    } else {
+        entry = new String( name );
+        table().memberIs( name, entry );
+    }
+    pthread_mutex_unlock( &tableLock );
+    return entry;
+}
+
+Fwk::String const *
+Fwk::Symbol::empty() {
+    static String const * entry = intern( String() );
+    return entry;
+}
+
+U32
+Fwk::Symbol::symbols() {
+    pthread_mutex_lock( &tableLock );
+    U32 n = table().members();
+    pthread_mutex_unlock( &tableLock );
+    return n;
+}
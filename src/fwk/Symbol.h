@@ -0,0 +1,41 @@
+// Symbol.h
+
+#ifndef FWK_SYMBOL_H
+#define FWK_SYMBOL_H
+
+#include "Types.h"
+
+namespace Fwk {
+
+// An interned name. Every Symbol made from the same string refers to the
+// same entry of a process-wide table, so Symbols compare and hash as
+// pointers and copy without allocating. Entries are never freed; the table
+// only grows with the distinct names a process has used. Making a Symbol
+// from a string takes a lock, everything else is lock-free.
+class Symbol {
+public:
+    Symbol() : entry_( empty() ) {}
+    Symbol( String const & name ) : entry_( intern( name ) ) {}
+    Symbol( char const * name ) : entry_( intern( String( name ) ) ) {}
+
+    String const & value() const { return *entry_; }
+    U32 hash() const { return (U32) ( (size_t) entry_ >> 3 ); }
+
+    bool operator==( Symbol const & other ) const { return entry_ == other.entry_; }
+    bool operator!=( Symbol const & other ) const { return entry_ != other.entry_; }
+    // an arbitrary order, fixed for the life of the process, for sets and
+    // maps of symbols; not the order of the names
+    bool operator<( Symbol const & other ) const { return entry_ < other.entry_; }
+
+    // the distinct names interned so far
+    static U32 symbols();
+
+private:
+    static String const * intern( String const & name );
+    static String const * empty();
+    String const * entry_;
+};
+
+}
+
+#endif
@@ -0,0 +1,198 @@
+//Timing harness for building networks. Builds a ring of customers joined
+//by truck segment pairs (100,000 segments unless given) three ways: with
+//instanceNew and attributeIs calls, with a Loader reading the same network
+//as CSV, and with a Loader reading it in the binary format. Then times
+//startup, loading plus the route precompute at simulation start, for a
+//smaller ring (400 segments unless given) built from CSV against one
+//mapped from a snapshot. Last, times name lookups in a std::map against a
+//Fwk::Registry at 10,000 and 1,000,000 names, and, on the first network,
+//Network::segment, the reads of a segment admission check, and a pass over
+//every segment's load through the segments and through the SegmentTable.
+//
+//usage: loadbench [segments] [startup segments]
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <map>
+#include <iomanip>
+#include <sys/time.h>
+#include "Instance.h"
+#include "Engine.h"
+#include "Loader.h"
+
+using namespace std;
+using namespace Shipping;
+
+static double seconds() {
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static string name(const char *prefix, size_t i) {
+	stringstream s;
+	s << prefix << i;
+	return s.str();
+}
+
+static string ring(size_t customers) {
+	stringstream csv;
+	csv << "fleet,truck,20,1,50\n";
+	for (size_t i = 0; i < customers; i++) csv << "customer," << name("c", i) << "\n";
+	for (size_t i = 0; i < customers; i++) {
+		size_t next = (i + 1) % customers;
+		csv << "segment," << name("s", 2 * i) << ",truck," << name("c", i) << ",100,"
+			<< name("s", 2 * i + 1) << ",10\n";
+		csv << "segment," << name("s", 2 * i + 1) << ",truck," << name("c", next) << ",100,,10\n";
+	}
+	return csv.str();
+}
+
+// keeps the lookups from being optimized away
+static volatile size_t lookupSink;
+
+// random lookups of n names, in a std::map and in a Fwk::Registry
+static void lookups(size_t n) {
+	vector<string> names(n);
+	for (size_t i = 0; i < n; i++) names[i] = name("s", i);
+	map<string, size_t> byMap;
+	Fwk::Registry<size_t> byRegistry;
+	for (size_t i = 0; i < n; i++) {
+		byMap[names[i]] = i;
+		byRegistry.memberIs(names[i], i);
+	}
+	const size_t probes = 1000000;
+	vector<size_t> order(probes);
+	U32 x = 1;
+	for (size_t i = 0; i < probes; i++) {
+		x = x * 1664525 + 1013904223;
+		order[i] = x % n;
+	}
+	size_t found = 0;
+	double start = seconds();
+	for (size_t i = 0; i < probes; i++) found += byMap.find(names[order[i]])->second;
+	double mapTime = seconds() - start;
+	start = seconds();
+	for (size_t i = 0; i < probes; i++) found += byRegistry.member(names[order[i]]);
+	double registryTime = seconds() - start;
+	lookupSink += found;
+	cout << "lookups among " << setw(7) << left << n << "   : std::map "
+		<< mapTime / probes * 1e9 << " ns, Registry " << registryTime / probes * 1e9 << " ns" << endl;
+}
+
+static void report(const char *how, double elapsed, Ptr<Instance::Manager> manager) {
+	Ptr<Instance> stats = manager->instance("stats");
+	cout << how << elapsed << " s, " << stats->attribute("Customer") << " customers, "
+		<< stats->attribute("Truck segment") << " segments" << endl;
+}
+
+int main(int argc, char *argv[]) {
+	size_t segments = argc > 1 ? atoi(argv[1]) : 100000;
+	size_t customers = segments / 2;
+
+	size_t startupSegments = argc > 2 ? atoi(argv[2]) : 400;
+	string text = ring(customers);
+
+	Ptr<Instance::Manager> byAttribute = shippingInstanceManager();
+	double start = seconds();
+	byAttribute->instanceNew("c0", "Customer");
+	byAttribute->instance("fleet")->attributeIs("Truck, speed", "20");
+	for (size_t i = 1; i < customers; i++) byAttribute->instanceNew(name("c", i), "Customer");
+	for (size_t i = 0; i < customers; i++) {
+		size_t next = (i + 1) % customers;
+		Ptr<Instance> there = byAttribute->instanceNew(name("s", 2 * i), "Truck segment");
+		Ptr<Instance> back = byAttribute->instanceNew(name("s", 2 * i + 1), "Truck segment");
+		there->attributeIs("source", name("c", i));
+		back->attributeIs("source", name("c", next));
+		there->attributeIs("length", "100");
+		back->attributeIs("length", "100");
+		there->attributeIs("return segment", back->name());
+		there->attributeIs("Capacity", "10");
+		back->attributeIs("Capacity", "10");
+	}
+	report("instanceNew/attributeIs : ", seconds() - start, byAttribute);
+
+	Ptr<Instance::Manager> fromCsv = shippingInstanceManager();
+	// creates the stats, conn and fleet instances as a client would
+	fromCsv->instanceNew("loader", "Loader");
+	istringstream in(text);
+	start = seconds();
+	Loader::LoaderNew(fromCsv->network())->csvIs(in);
+	report("Loader CSV              : ", seconds() - start, fromCsv);
+
+	stringstream binary;
+	start = seconds();
+	Loader::LoaderNew(fromCsv->network())->binaryWrite(binary);
+	cout << "binary write            : " << seconds() - start << " s, "
+		<< binary.str().size() << " bytes (CSV " << text.size() << ")" << endl;
+
+	Ptr<Instance::Manager> fromBinary = shippingInstanceManager();
+	fromBinary->instanceNew("loader", "Loader");
+	start = seconds();
+	Loader::LoaderNew(fromBinary->network())->binaryIs(binary);
+	report("Loader binary           : ", seconds() - start, fromBinary);
+
+	const char *snapshot = "/tmp/loadbench.snap";
+	Ptr<Instance::Manager> cold = shippingInstanceManager();
+	istringstream small(ring(startupSegments / 2));
+	start = seconds();
+	cold->instanceNew("loader", "Loader");
+	Loader::LoaderNew(cold->network())->csvIs(small);
+	cold->network()->connectivity()->simulationStatusIs(Connectivity::running());
+	double coldStart = seconds() - start;
+	cold->network()->connectivity()->simulationStatusIs(Connectivity::off());
+	Loader::LoaderNew(cold->network())->snapshotWrite(snapshot);
+
+	Ptr<Instance::Manager> warm = shippingInstanceManager();
+	start = seconds();
+	warm->instanceNew("loader", "Loader")->attributeIs("snapshot file", snapshot);
+	warm->network()->connectivity()->simulationStatusIs(Connectivity::running());
+	double warmStart = seconds() - start;
+	cout << "startup from CSV        : " << coldStart << " s, "
+		<< cold->network()->connectivity()->precomputedRoutes(Connectivity::dijkstra()).size() << " routes" << endl;
+	cout << "startup from snapshot   : " << warmStart << " s, "
+		<< warm->network()->connectivity()->precomputedRoutes(Connectivity::dijkstra()).size() << " routes" << endl;
+	remove(snapshot);
+
+	lookups(10000);
+	lookups(1000000);
+	vector<string> segmentNames(customers);
+	for (size_t i = 0; i < customers; i++) segmentNames[i] = name("s", (i * 7919) % segments);
+	Network *network = fromCsv->network();
+	size_t found = 0;
+	start = seconds();
+	for (size_t round = 0; round < 10; round++) {
+		for (size_t i = 0; i < customers; i++) found += network->segment(segmentNames[i]) ? 1 : 0;
+	}
+	cout << "Network::segment        : " << (seconds() - start) / (10 * customers) * 1e9
+		<< " ns among " << network->segmentCount() << " segments, " << found << " found" << endl;
+
+	// the admission check's reads, in a scattered order, and a pass over
+	// every segment's load through the segments and through the packed table
+	vector<Segment::Ptr> scattered;
+	for (size_t i = 0; i < segmentNames.size(); i++) scattered.push_back(network->segment(segmentNames[i]));
+	size_t room = 0;
+	start = seconds();
+	for (size_t round = 0; round < 10; round++) {
+		for (size_t i = 0; i < scattered.size(); i++) {
+			room += scattered[i]->capacity().value() - scattered[i]->segmentLoad().value();
+		}
+	}
+	cout << "capacity check          : " << (seconds() - start) / (10 * scattered.size()) * 1e9
+		<< " ns, " << room << " packages of room" << endl;
+	size_t load = 0;
+	start = seconds();
+	for (size_t round = 0; round < 10; round++) {
+		for (Network::SegmentIterator i = network->segmentIter(); i.ptr(); ++i) load += i->segmentLoad().value();
+	}
+	cout << "load scan, segments     : " << (seconds() - start) / 10 * 1e3 << " ms" << endl;
+	SegmentTable::PtrConst table = network->segmentTable();
+	start = seconds();
+	for (size_t round = 0; round < 10; round++) {
+		for (SegmentTable::Row r = 0; r < table->rows(); r++) load += table->load(r);
+	}
+	cout << "load scan, table        : " << (seconds() - start) / 10 * 1e3 << " ms, " << load << endl;
+	return 0;
+}
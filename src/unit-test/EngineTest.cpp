@@ -1,6 +1,17 @@
 #include "gtest/gtest.h"
 #include "Engine.h"
+#include "Sampler.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Instrument.h"
+#include <fstream>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstdlib>
 #include <iostream>
+#include <algorithm>
 
 using namespace Shipping;
 
@@ -246,6 +257,20 @@ TEST_F(SegmentTest, NetworkSourceDel) {
 	EXPECT_EQ(nil.ptr(), seg3->source().ptr());
 }
 
+TEST_F(SegmentTest, WaitStateIsAllocatedOnFirstWait) {
+	// no inline wait queues or histogram
+	EXPECT_LT(sizeof(Segment), 256u);
+	EXPECT_EQ(0u, seg1->waitingShipments());
+	EXPECT_TRUE(seg1->waiting(Priority::standard()).empty());
+	EXPECT_EQ(0u, seg1->waitHistogram().count());
+
+	seg1->shipmentWaitIs(Hours(2));
+	EXPECT_EQ(1u, seg1->waitHistogram().count());
+	EXPECT_EQ(0u, seg2->waitHistogram().count());
+	seg2->waitHistogramIs(seg1->waitHistogram());
+	EXPECT_EQ(1u, seg2->waitHistogram().count());
+}
+
 
 class LocationTest : public ::testing::Test {
 protected:
@@ -345,65 +370,604 @@ TEST_F(LocationTest, SegmentIteratorConstEnd) {
 
 }
 
+// two customers joined through a near and a far terminal; the fixtures
+// below each test one engine feature on it
+class ShippingNetworkTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		network = Network::NetworkNew("network");
+		fleet = network->fleetNew("fleet");
+		conn = network->connectivityNew("conn");
+		conn->fleetIs(fleet);
+
+		src = network->customerNew("src");
+		dst = network->customerNew("dst");
+		near = network->terminalNew("near", Segment::truck());
+		far = network->terminalNew("far", Segment::truck());
+
+		srcNear = link(src, near, 10.f);
+		link(near, dst, 10.f);
+		// far is a loop-free alternate: closer to dst than src is
+		srcFar = link(src, far, 25.f);
+		link(far, dst, 15.f);
+	}
 
+	Segment::Ptr link(const Location::Ptr &a, const Location::Ptr &b, float miles) {
+		Segment::Ptr there = network->segmentNew(a->name() + "-" + b->name(), Segment::truck());
+		Segment::Ptr back = network->segmentNew(b->name() + "-" + a->name(), Segment::truck());
+		there->sourceIs(a);
+		back->sourceIs(b);
+		there->returnSegmentIs(back);
+		there->lengthIs(Mile(miles));
+		back->lengthIs(Mile(miles));
+		return there;
+	}
 
+	Network::Ptr network;
+	Fleet::Ptr fleet;
+	Connectivity::Ptr conn;
+	Customer::Ptr src, dst;
+	Location::Ptr near, far;
+	Segment::Ptr srcNear, srcFar;
+};
 
+// the same network with its simulation running, statistics attached and a
+// single truck on src-near, so that two full shipments are enough to make
+// one wait
+class SimulationTest : public ShippingNetworkTest {
+protected:
+	virtual void SetUp() {
+		ShippingNetworkTest::SetUp();
+		stats = network->statisticsNew("stats");
+		stats->notifierIs(network);
+		srcNear->numVehiclesIs(VehicleCount(1));
+		conn->simulationStatusIs(Connectivity::running());
+	}
 
+	Statistics::Ptr stats;
+};
 
+TEST_F(SimulationTest, CongestionNextHopAvoidsSaturatedSegment) {
+	conn->routingMethodIs(Connectivity::congestion());
+	Shipment::Ptr shipment = network->shipmentNew(src, dst, PackageCount(100));
+
+	EXPECT_EQ(srcNear.ptr(), conn->nextHop(src, shipment).ptr());
+
+	srcNear->segmentLoadIs(srcNear->capacity());
+	EXPECT_EQ(srcFar.ptr(), conn->nextHop(src, shipment).ptr());
+
+	srcFar->segmentLoadIs(srcFar->capacity());
+	EXPECT_EQ(srcNear.ptr(), conn->nextHop(src, shipment).ptr());
+}
+
+TEST_F(SimulationTest, CongestionRetryLeavesOnWhicheverHopFreesUp) {
+	conn->routingMethodIs(Connectivity::congestion());
+	Activity::Manager::Ptr manager = activityManagerInstance(network.ptr());
+	Shipment::Ptr shipment = network->shipmentNew(src, dst, PackageCount(100));
+	srcNear->segmentLoadIs(srcNear->capacity());
+	srcFar->segmentLoadIs(srcFar->capacity());
+
+	// refused by both, so told to retry on the cheapest
+	Activity::Ptr activity = manager->activityNew("RetryActivity");
+	RetryActivityReactor *retry = new RetryActivityReactor(manager, activity.ptr(), shipment.ptr(), srcNear.ptr(), network.ptr());
+	retry->locationIs(src);
+	activity->lastNotifieeIs(retry);
+
+	srcFar->segmentLoadIs(PackageCount(0));
+	activity->statusIs(Activity::executing);
+	EXPECT_TRUE(retry->successfullyForwardedShipment());
+	EXPECT_EQ(srcFar.ptr(), retry->segment().ptr());
+	EXPECT_EQ(100u, srcFar->segmentLoad().value());
+	EXPECT_EQ(srcNear->capacity(), srcNear->segmentLoad());
+}
+
+TEST_F(SimulationTest, CongestionQueueLeavesOnWhicheverHopFreesUp) {
+	conn->routingMethodIs(Connectivity::congestion());
+	conn->waitPolicyIs(Connectivity::waitQueue());
+	Shipment::Ptr shipment = network->shipmentNew(src, dst, PackageCount(100));
+	srcNear->segmentLoadIs(srcNear->capacity());
+	srcFar->segmentLoadIs(srcFar->capacity());
+	ASSERT_EQ(srcNear.ptr(), conn->nextHop(src, shipment).ptr());
+	srcNear->segmentReactor()->onWaitingShipment(shipment);
+
+	srcFar->segmentLoadIs(PackageCount(0));
+	srcFar->segmentReactor()->onCapacityFreed();
+	EXPECT_EQ(0u, srcNear->waitingShipments());
+	EXPECT_EQ(100u, srcFar->segmentLoad().value());
+}
+
+TEST_F(ShippingNetworkTest, ExpeditedShipmentsPayTheSurchargePerSegment) {
+	fleet->costPerMileIs(Segment::truck(), Dollars(2), fleet->timeOfDay());
+	network->expediteSupportIs("src-near", Segment::expediteSupported());
+	network->expediteSupportIs("near-dst", Segment::expediteSupported());
+	conn->simulationStatusIs(Connectivity::running());
+	Shipment::Ptr shipment = network->shipmentNew(src, dst, PackageCount(10));
+	ASSERT_EQ(Segment::expediteSupported(), shipment->path()->expedited());
+
+	srcNear->arrivingShipmentIs(shipment);
+	EXPECT_FLOAT_EQ(1.5f * 2 * 10, shipment->cost().value());
+
+	// off the path under congestion routing, plain segments cost the base rate
+	srcFar->arrivingShipmentIs(shipment);
+	EXPECT_FLOAT_EQ(1.5f * 2 * 10 + 2 * 25, shipment->cost().value());
+}
+
+TEST_F(SimulationTest, SplitShipmentReassemblesAtParent) {
+	Shipment::Ptr shipment = network->shipmentNew(src, dst, PackageCount(100));
+	shipment->latencyInc(Hours(1));
+
+	Shipment::Ptr first = network->shipmentBatchNew(shipment, PackageCount(60));
+	Shipment::Ptr second = network->shipmentBatchNew(shipment, PackageCount(40));
+	// a batch split again still belongs to the original shipment
+	second->costInc(Dollars(5));
+	Shipment::Ptr third = network->shipmentBatchNew(second, PackageCount(40));
+	EXPECT_EQ(shipment.ptr(), third->parent().ptr());
+	EXPECT_EQ(5.f, shipment->cost().value());
+
+	first->latencyInc(Hours(3));
+	first->costInc(Dollars(10));
+	shipment->batchArrivalIs(first);
+	EXPECT_EQ(40u, shipment->packagesOutstanding().value());
+
+	third->latencyInc(Hours(2));
+	third->costInc(Dollars(10));
+	shipment->batchArrivalIs(third);
+	EXPECT_EQ(0u, shipment->packagesOutstanding().value());
+	EXPECT_EQ(4.f, shipment->latency().value());
+	EXPECT_EQ(25.f, shipment->cost().value());
+}
+
+TEST_F(SimulationTest, VehicleModelConsolidatesShipmentsIntoTrips) {
+	fleet->capacityIs(Segment::truck(), PackageCount(250), Fleet::day());
+	fleet->capacityIs(Segment::truck(), PackageCount(250), Fleet::night());
+	fleet->departureTimeoutIs(Segment::truck(), Hours(2));
+	ASSERT_TRUE(srcNear->vehicleModel());
+
+	Shipment::Ptr first = network->shipmentNew(src, dst, PackageCount(100));
+	Shipment::Ptr second = network->shipmentNew(src, dst, PackageCount(100));
+	Shipment::Ptr third = network->shipmentNew(src, dst, PackageCount(100));
+
+	srcNear->arrivingShipmentIs(first);
+	U32 trip = srcNear->trip();
+	srcNear->arrivingShipmentIs(second);
+	EXPECT_EQ(trip, srcNear->trip());
+	EXPECT_EQ(200u, srcNear->tripLoad().value());
+	EXPECT_EQ(1u, srcNear->vehiclesBusy().value());
+
+	// no room on the loading truck and no idle truck for another trip
+	EXPECT_FALSE(srcNear->admits(third));
+	EXPECT_THROW(srcNear->arrivingShipmentIs(third), Fwk::RangeException);
+}
+
+TEST_F(SimulationTest, WaitQueueServesShipmentsInArrivalOrder) {
+	EXPECT_EQ(Connectivity::waitRetry(), conn->waitPolicy());
+	conn->waitPolicyIs(Connectivity::waitQueue());
+
+	Shipment::Ptr first = network->shipmentNew(src, dst, PackageCount(100));
+	Shipment::Ptr second = network->shipmentNew(src, dst, PackageCount(100));
+	Shipment::Ptr third = network->shipmentNew(src, dst, PackageCount(50));
+
+	srcNear->arrivingShipmentIs(first);
+	EXPECT_THROW(srcNear->arrivingShipmentIs(second), Fwk::RangeException);
+	srcNear->segmentReactor()->onWaitingShipment(second);
+	srcNear->segmentReactor()->onWaitingShipment(third);
+	EXPECT_EQ(2u, srcNear->waitingShipments());
+
+	// a newcomer that would fit may not jump the queue
+	srcNear->segmentLoadIs(PackageCount(0));
+	Shipment::Ptr late = network->shipmentNew(src, dst, PackageCount(10));
+	EXPECT_THROW(srcNear->arrivingShipmentIs(late), Fwk::RangeException);
+
+	srcNear->segmentReactor()->onCapacityFreed();
+	EXPECT_EQ(100u, srcNear->segmentLoad().value());
+	ASSERT_EQ(1u, srcNear->waitingShipments());
+	EXPECT_EQ(third.ptr(), srcNear->waiting(Priority::standard()).front().shipment.ptr());
+}
+
+TEST_F(SimulationTest, RetriedShipmentsCountTheirWaitInLatency) {
+	Activity::Manager::Ptr manager = activityManagerInstance(network.ptr());
+	Shipment::Ptr shipment = network->shipmentNew(src, dst, PackageCount(10));
+	Activity::Ptr activity = manager->activityNew("RetryActivity");
+	RetryActivityReactor *retry = new RetryActivityReactor(manager, activity.ptr(), shipment.ptr(), srcNear.ptr(), network.ptr());
+	activity->lastNotifieeIs(retry);
+	// as if the shipment had been refused three hours ago
+	retry->retriesIs(false, 0.0, manager->now().value() - 3.0, retry->wait());
+	activity->statusIs(Activity::executing);
+
+	// latency is transit plus waiting under every wait policy
+	float transit = srcNear->length().value() / fleet->speed(Segment::truck()).value();
+	EXPECT_FLOAT_EQ(3.f, shipment->wait().value());
+	EXPECT_FLOAT_EQ(3.f + transit, shipment->latency().value());
+}
+
+TEST_F(SimulationTest, WaitQueueAdmissionByPriority) {
+	conn->waitPolicyIs(Connectivity::waitQueue());
+	Shipment::Ptr blocker = network->shipmentNew(src, dst, PackageCount(100));
+	srcNear->arrivingShipmentIs(blocker);
+
+	vector<Shipment::Ptr> standard, high;
+	for (int i = 0; i < 3; i++) {
+		standard.push_back(network->shipmentNew(src, dst, PackageCount(100)));
+		srcNear->segmentReactor()->onWaitingShipment(standard.back());
+	}
+	src->shipmentPriorityIs(Priority::highValue());
+	for (int i = 0; i < 3; i++) {
+		high.push_back(network->shipmentNew(src, dst, PackageCount(100)));
+		srcNear->segmentReactor()->onWaitingShipment(high.back());
+	}
 
+	// weighted fair: high value gets 4 turns to standard's 1, but standard
+	// is not starved while high value freight is waiting
+	for (int i = 0; i < 3; i++) {
+		srcNear->segmentLoadIs(PackageCount(0));
+		srcNear->segmentReactor()->onCapacityFreed();
+	}
+	EXPECT_EQ(3u, srcNear->waitingShipments());
+	EXPECT_EQ(1u, srcNear->waiting(Priority::highValue()).size());
+	EXPECT_EQ(2u, srcNear->waiting(Priority::standard()).size());
+
+	// strict: everything high value first
+	srcNear->admissionPolicyIs(Segment::strictPriority());
+	srcNear->segmentLoadIs(PackageCount(0));
+	srcNear->segmentReactor()->onCapacityFreed();
+	EXPECT_EQ(0u, srcNear->waiting(Priority::highValue()).size());
+	EXPECT_EQ(2u, srcNear->waiting(Priority::standard()).size());
+
+	// a higher class newcomer does not queue behind standard freight
+	srcNear->segmentLoadIs(PackageCount(0));
+	Shipment::Ptr urgent = network->shipmentNew(src, dst, PackageCount(100));
+	srcNear->arrivingShipmentIs(urgent);
+	EXPECT_EQ(100u, srcNear->segmentLoad().value());
+}
+
+TEST(HistogramTest, PercentilesStayWithinBucketError) {
+	Histogram h;
+	EXPECT_EQ(0.0, h.percentile(50));
+	for (int i = 1; i <= 1000; i++) h.valueIs(i / 10.0);
+
+	EXPECT_EQ(1000u, h.count());
+	EXPECT_NEAR(50.05, h.mean(), 1e-6);
+	EXPECT_EQ(100.0, h.max());
+	// log-linear buckets: within 1/16 of the true value
+	EXPECT_NEAR(50.0, h.percentile(50), 50.0 / 16);
+	EXPECT_NEAR(95.0, h.percentile(95), 95.0 / 16);
+	EXPECT_NEAR(99.0, h.percentile(99), 99.0 / 16);
+	EXPECT_EQ(100.0, h.percentile(100));
+
+	// small values are exact to a hundredth of an hour
+	Histogram small;
+	small.valueIs(0.05);
+	small.valueIs(0.10);
+	EXPECT_NEAR(0.06, small.percentile(50), 1e-9);
+}
+
+TEST_F(SimulationTest, StatisticsKeepsRecordsPerCustomerPair) {
+	EXPECT_EQ(0u, src->id());
+	EXPECT_EQ(1u, dst->id());
+	EXPECT_EQ(2u, network->customerIds());
+
+	Shipment::Ptr delivered = network->shipmentNew(src, dst, PackageCount(10));
+	Shipment::Ptr dropped = network->shipmentNew(src, dst, PackageCount(10));
+	Shipment::Ptr enroute = network->shipmentNew(src, dst, PackageCount(10));
+	stats->deliveredShipmentIs(delivered);
+	stats->droppedShipmentIs(dropped);
+
+	Statistics::ShippingRecord record = stats->shippingRecord(src, dst);
+	EXPECT_EQ(1u, record.numEnRoute());
+	EXPECT_EQ(1u, record.numDelivered());
+	EXPECT_EQ(1u, record.numDropped());
+	EXPECT_EQ(0u, stats->shippingRecord(dst, src).numEnRoute());
+	EXPECT_EQ(1u, stats->numShipments(Statistics::enroute()));
+}
+
+TEST_F(ShippingNetworkTest, SamplerRingKeepsNewestSamples) {
+	Sampler::Ptr sampler = Sampler::SamplerNew(network.ptr(), 0, 2);
+	EXPECT_EQ(8u, sampler->segments());
+
+	srcNear->segmentLoadIs(PackageCount(10));
+	sampler->sampleIs(1.0);
+	srcNear->segmentLoadIs(PackageCount(20));
+	sampler->sampleIs(2.0);
+	srcNear->segmentLoadIs(PackageCount(30));
+	sampler->sampleIs(3.0);
+	EXPECT_EQ(2u, sampler->samples());
+
+	stringstream csv;
+	sampler->csvIs(csv);
+	vector<vector<string> > rows;
+	string line;
+	while (getline(csv, line)) {
+		stringstream fields(line);
+		string field;
+		rows.push_back(vector<string>());
+		while (getline(fields, field, ',')) rows.back().push_back(field);
+	}
+	ASSERT_EQ(3u, rows.size());
+	size_t column = find(rows[0].begin(), rows[0].end(), "src-near load") - rows[0].begin();
+	ASSERT_LT(column, rows[0].size());
+	// oldest surviving sample first
+	EXPECT_EQ("2", rows[1][0]);
+	EXPECT_EQ("20", rows[1][column]);
+	EXPECT_EQ("3", rows[2][0]);
+	EXPECT_EQ("30", rows[2][column]);
+}
+
+TEST_F(SimulationTest, MetricsExporterServesPrometheusText) {
+	Shipment::Ptr delivered = network->shipmentNew(src, dst, PackageCount(10));
+	network->shipmentNew(src, dst, PackageCount(10));
+	stats->deliveredShipmentIs(delivered);
+
+	MetricsExporter::Ptr exporter = MetricsExporter::MetricsExporterNew(network.ptr(), 0);
+	ASSERT_NE(0, exporter->port());
+
+	int client = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(exporter->port());
+	ASSERT_EQ(0, connect(client, (struct sockaddr *) &address, sizeof(address)));
+	string request = "GET /metrics HTTP/1.0\r\n\r\n";
+	send(client, request.data(), request.size(), 0);
+	string response;
+	char buffer[1024];
+	ssize_t n;
+	while ((n = recv(client, buffer, sizeof(buffer), 0)) > 0) response.append(buffer, n);
+	close(client);
+
+	EXPECT_EQ(0u, response.find("HTTP/1.0 200 OK"));
+	EXPECT_NE(string::npos, response.find("# TYPE shipping_shipments_delivered_total counter"));
+	EXPECT_NE(string::npos, response.find("\nshipping_shipments_enroute 1\n"));
+	EXPECT_NE(string::npos, response.find("\nshipping_shipments_delivered_total 1\n"));
+	EXPECT_EQ(1u, exporter->requests());
+}
+
+TEST_F(ShippingNetworkTest, StatisticsTotalsFollowSegmentCounters) {
+	// counts from before the statistics existed are picked up once
+	srcNear->numShipmentsReceivedIs(ShipmentCount(4));
+	Statistics::Ptr stats = network->statisticsNew("stats");
+	EXPECT_EQ(4u, stats->numSegmentShipmentsReceived());
+
+	srcFar->numShipmentsReceivedIs(ShipmentCount(2));
+	srcFar->numShipmentsToldToWaitIs(ShipmentCount(3));
+	srcFar->numShipmentsRefusedIs(ShipmentCount(1));
+	srcNear->numShipmentsReceivedIs(ShipmentCount(6));
+	EXPECT_EQ(8u, stats->numSegmentShipmentsReceived());
+	EXPECT_EQ(3u, stats->numSegmentShipmentsToldToWait());
+	EXPECT_EQ(1u, stats->numSegmentShipmentsRefused());
+	EXPECT_FLOAT_EQ(1.0f, stats->avgShipmentsReceived());
+
+	network->segmentDel(srcFar->name());
+	EXPECT_EQ(6u, stats->numSegmentShipmentsReceived());
+	EXPECT_EQ(0u, stats->numSegmentShipmentsToldToWait());
+	EXPECT_EQ(0u, stats->numSegmentShipmentsRefused());
+	EXPECT_FLOAT_EQ(6.0f / 7.0f, stats->avgShipmentsReceived());
+}
+
+TEST_F(SimulationTest, TracerWritesChromeTraceEvents) {
+	char name[] = "/tmp/EngineTestTraceXXXXXX";
+	int fd = mkstemp(name);
+	ASSERT_NE(-1, fd);
+	close(fd);
+	string path = name;
+	Tracer::Ptr tracer = Tracer::TracerNew(path);
+	if (!tracer->ok()) remove(path.c_str());
+	ASSERT_TRUE(tracer->ok());
+	network->tracerIs(tracer.ptr());
+
+	Shipment::Ptr first = network->shipmentNew(src, dst, PackageCount(100));
+	Shipment::Ptr second = network->shipmentNew(src, dst, PackageCount(100));
+	srcNear->arrivingShipmentIs(first);
+	srcNear->segmentReactor()->onWaitingShipment(second);
+	stats->deliveredShipmentIs(first);
+	stats->droppedShipmentIs(second);
+	network->tracerIs(0);
+	tracer->closeIs();
+
+	ifstream in(path.c_str());
+	stringstream text;
+	text << in.rdbuf();
+	in.close();
+	remove(path.c_str());
+	string trace = text.str();
+	EXPECT_EQ(0u, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+	EXPECT_EQ(trace.size() - 4, trace.rfind("\n]}\n"));
+	EXPECT_NE(string::npos, trace.find("\"args\":{\"name\":\"src-near\"}"));
+	EXPECT_NE(string::npos, trace.find("{\"name\":\"told to wait\",\"ph\":\"i\""));
+	EXPECT_NE(string::npos, trace.find("{\"name\":\"delivered\",\"ph\":\"i\""));
+	EXPECT_NE(string::npos, trace.find("{\"name\":\"dropped\",\"ph\":\"i\""));
+	stringstream waited;
+	waited << "\"args\":{\"shipment\":" << second->id() << ",\"packages\":100}";
+	EXPECT_NE(string::npos, trace.find(waited.str()));
+}
+
+TEST_F(SimulationTest, ShipmentsGetUniqueIds) {
+	ShipmentId next = network->shipmentIds();
+	Shipment::Ptr first = network->shipmentNew(src, dst, PackageCount(100));
+	Shipment::Ptr second = network->shipmentNew(src, dst, PackageCount(100));
+	Shipment::Ptr batch = network->shipmentBatchNew(second, PackageCount(30));
+	EXPECT_EQ(next, first->id());
+	EXPECT_EQ(next + 1, second->id());
+	EXPECT_EQ(next + 2, batch->id());
+	EXPECT_EQ(next + 3, network->shipmentIds());
+	// the name only describes the route, which both share
+	EXPECT_EQ("src:dst", first->name());
+	EXPECT_EQ(first->name(), batch->name());
+	EXPECT_EQ(first->path().ptr(), second->path().ptr());
+}
+
+TEST(EntitySymbolTest, EntitiesWithTheSameNameShareASymbol) {
+	Fwk::Symbol a("symbol");
+	Network::Ptr network = Network::NetworkNew("network");
+	Location::Ptr loc = network->customerNew("symbol");
+	EXPECT_TRUE(loc->symbol() == a);
+	EXPECT_EQ(&a.value(), &loc->name());
+}
+
+TEST(SegmentTableTest, SegmentsKeepTheirStateInTheNetworksTable) {
+	Network::Ptr network = Network::NetworkNew("network");
+	Segment::Ptr a = network->segmentNew("a", Segment::truck());
+	Segment::Ptr b = network->segmentNew("b", Segment::plane());
+	SegmentTable::Ptr table = network->segmentTable();
+	ASSERT_EQ(2u, table->rowsUsed());
+	EXPECT_NE(a->tableRow(), b->tableRow());
+
+	b->numVehiclesIs(VehicleCount(3));
+	b->segmentLoadIs(PackageCount(7));
+	b->numShipmentsReceivedIs(ShipmentCount(2));
+	EXPECT_EQ(Segment::plane(), table->mode(b->tableRow()));
+	EXPECT_EQ(3u, table->vehicles(b->tableRow()));
+	EXPECT_EQ(7u, table->load(b->tableRow()));
+	EXPECT_EQ(2u, table->received(b->tableRow()));
+	EXPECT_EQ(VehicleCount().value(), a->numVehicles().value());
+	EXPECT_EQ(0u, a->segmentLoad().value());
+
+	// a row given back is cleared and handed out again
+	SegmentTable::Ptr spare = SegmentTable::SegmentTableNew();
+	SegmentTable::Row row = spare->rowNew();
+	spare->rowNew();
+	spare->loadIs(row, 5);
+	spare->rowDel(row);
+	EXPECT_EQ(0u, spare->load(row));
+	EXPECT_EQ(row, spare->rowNew());
+	EXPECT_EQ(2u, spare->rows());
+}
+
+TEST(NetworkTest, IteratorsWalkTheEntitiesInPlace) {
+	Network::Ptr network = Network::NetworkNew("network");
+	network->customerNew("c1");
+	network->portNew("p");
+	network->customerNew("c2");
+	network->customerNew("c3");
+	network->segmentNew("s1", Segment::truck());
+	network->segmentNew("s2", Segment::boat());
+	network->customerDel("c2");
+
+	size_t locations = 0;
+	for (Network::LocationIterator i = network->locationIter(); i.ptr(); ++i) {
+		EXPECT_EQ(network->locationAt(i.handle()).ptr(), i.ptr());
+		locations++;
+	}
+	EXPECT_EQ(3u, locations);
+	EXPECT_EQ(network->locationCount(), locations);
+
+	size_t segments = 0;
+	for (Network::SegmentIterator i = network->segmentIter(); i.ptr(); ++i) segments++;
+	EXPECT_EQ(2u, segments);
+
+	// customers only, in id order, skipping the deleted one
+	vector<string> customers;
+	for (Network::CustomerIterator i = network->customerIter(); i.ptr(); ++i) {
+		EXPECT_EQ(i.ptr(), network->customer(i->id()));
+		customers.push_back(i->name());
+	}
+	ASSERT_EQ(2u, customers.size());
+	EXPECT_EQ("c1", customers[0]);
+	EXPECT_EQ("c3", customers[1]);
+}
+
+#ifdef SHIPPING_INSTRUMENT
+TEST_F(ShippingNetworkTest, ScopesCountEventsTimeAndAllocations) {
+	ASSERT_TRUE(Instrument::enabled());
+	Instrument::resetIs();
+	EXPECT_EQ(0u, Instrument::events(Instrument::routePrecompute()));
+
+	// one precomputation each for dijkstra and bfs
+	conn->simulationStatusIs(Connectivity::running());
+	EXPECT_EQ(2u, Instrument::events(Instrument::routePrecompute()));
+	EXPECT_GT(Instrument::seconds(Instrument::routePrecompute()), 0.0);
+	EXPECT_GT(Instrument::allocations(), 0u);
+
+	{
+		INSTRUMENT_SCOPE(nextHopTable);
+		usleep(20000);
+	}
+	EXPECT_EQ(1u, Instrument::events(Instrument::nextHopTable()));
+	EXPECT_GT(Instrument::seconds(Instrument::nextHopTable()), 0.015);
+	EXPECT_LT(Instrument::seconds(Instrument::nextHopTable()), 1.0);
+
+	U64 allocations = Instrument::allocations();
+	U64 bytes = Instrument::allocatedBytes();
+	delete new char[1000];
+	EXPECT_EQ(allocations + 1, Instrument::allocations());
+	EXPECT_EQ(bytes + 1000, Instrument::allocatedBytes());
+
+	string report = Instrument::report();
+	EXPECT_NE(string::npos, report.find("Connectivity::routes : events=2"));
+	EXPECT_NE(string::npos, report.find("Connectivity::nextHopTableIs : events=1"));
+	EXPECT_EQ(string::npos, report.find("ForwardActivityReactor"));
+
+	Instrument::resetIs();
+	EXPECT_EQ(0u, Instrument::events(Instrument::routePrecompute()));
+	EXPECT_EQ(0.0, Instrument::seconds(Instrument::routePrecompute()));
+}
+#else
+TEST_F(ShippingNetworkTest, DisabledBuildRecordsNothing) {
+	EXPECT_FALSE(Instrument::enabled());
+	conn->simulationStatusIs(Connectivity::running());
+	EXPECT_EQ(0u, Instrument::events(Instrument::routePrecompute()));
+	EXPECT_EQ(0.0, Instrument::seconds(Instrument::routePrecompute()));
+	EXPECT_EQ(0u, Instrument::allocations());
+	EXPECT_NE(string::npos, Instrument::report().find("instrumentation disabled"));
+}
+#endif
+
+class ArrivalCounter : public Segment::Notifiee {
+public:
+	ArrivalCounter(const Segment::Ptr &segment): arrivals(0) { notifierIs(segment); }
+	void onShipmentArrival(Fwk::Ptr<Shipment> &shipment) { arrivals++; }
+	int arrivals;
+};
 
+TEST_F(ShippingNetworkTest, OwnReactorIsCalledBesideObservers) {
+	// the segment's own reactor is not on the notifiee list
+	ASSERT_TRUE(srcNear->segmentReactor());
+	EXPECT_EQ(0u, srcNear->notifiees());
 
+	Fwk::Ptr<ArrivalCounter> observer = new ArrivalCounter(srcNear);
+	observer->referencesDec(1);
+	EXPECT_EQ(1u, srcNear->notifiees());
 
+	conn->simulationStatusIs(Connectivity::running());
+	Shipment::Ptr shipment = network->shipmentNew(src, dst, PackageCount(100));
+	srcNear->arrivingShipmentIs(shipment);
+	EXPECT_EQ(1, observer->arrivals);
+	EXPECT_EQ(1, srcNear->numShipmentsReceived().value());
+}
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+TEST_F(SimulationTest, ShipmentsComeFromTheArena) {
+	size_t live = Shipment::arena().live();
+	U64 objects = Shipment::arena().objects();
+	{
+		Shipment::Ptr shipment = network->shipmentNew(src, dst, PackageCount(100));
+		EXPECT_EQ(live + 1, Shipment::arena().live());
+	}
+	EXPECT_EQ(live, Shipment::arena().live());
+	EXPECT_EQ(objects + 1, Shipment::arena().objects());
+}
+
+TEST(ShipmentArenaTest, SlabsGoBackWithTheLastNetwork) {
+	size_t networks = Shipment::networks();
+	Shipment::Ptr shipment;
+	{
+		Network::Ptr network = Network::NetworkNew("arena");
+		EXPECT_EQ(networks + 1, Shipment::networks());
+		Connectivity::Ptr conn = network->connectivityNew("conn");
+		conn->fleetIs(network->fleetNew("fleet"));
+		Customer::Ptr a = network->customerNew("a");
+		Customer::Ptr b = network->customerNew("b");
+		Segment::Ptr ab = network->segmentNew("a-b", Segment::truck());
+		Segment::Ptr ba = network->segmentNew("b-a", Segment::truck());
+		ab->sourceIs(a);
+		ba->sourceIs(b);
+		ab->returnSegmentIs(ba);
+		conn->simulationStatusIs(Connectivity::running());
+		shipment = network->shipmentNew(a, b, PackageCount(1));
+		EXPECT_LT(0u, Shipment::arena().slabs());
+	}
+	EXPECT_EQ(networks, Shipment::networks());
+	// a shipment outliving its network keeps the slabs until it goes
+	EXPECT_LT(0u, Shipment::arena().slabs());
+	shipment = 0;
+	if (!networks) EXPECT_EQ(0u, Shipment::arena().slabs());
+}
@@ -0,0 +1,133 @@
+#include "gtest/gtest.h"
+#include "fwk/Ptr.h"
+#include "fwk/PtrInterface.h"
+#include "fwk/Arena.h"
+#include "fwk/Registry.h"
+#include "fwk/Symbol.h"
+#include <sstream>
+#include <vector>
+#include <pthread.h>
+
+class Counted : public Fwk::PtrInterface<Counted, Fwk::AtomicRefCount> {
+public:
+	static bool deleted;
+	~Counted() { deleted = true; }
+};
+bool Counted::deleted = false;
+
+static void *copyPtrs(void *shared) {
+	Fwk::Ptr<Counted> &ptr = *static_cast<Fwk::Ptr<Counted> *>(shared);
+	for (int i = 0; i < 100000; i++) {
+		Fwk::Ptr<Counted> copy = ptr;
+	}
+	return 0;
+}
+
+TEST(PtrTest, MoveHandsOverTheReference) {
+	Fwk::Ptr<Counted> a = new Counted();
+	a->referencesDec(1);
+	EXPECT_EQ(1u, a->references());
+	Fwk::Ptr<Counted> b = std::move(a);
+	EXPECT_FALSE(a);
+	EXPECT_EQ(1u, b->references());
+	a = std::move(b);
+	EXPECT_FALSE(b);
+	EXPECT_EQ(1u, a->references());
+	b.swap(a);
+	EXPECT_EQ(1u, b->references());
+	Counted::deleted = false;
+	b = Fwk::Ptr<Counted>();
+	EXPECT_TRUE(Counted::deleted);
+}
+
+TEST(PtrTest, AtomicRefCountSurvivesConcurrentCopies) {
+	Fwk::Ptr<Counted> shared = new Counted();
+	shared->referencesDec(1);
+	pthread_t threads[4];
+	for (int i = 0; i < 4; i++) pthread_create(&threads[i], 0, copyPtrs, &shared);
+	for (int i = 0; i < 4; i++) pthread_join(threads[i], 0);
+	EXPECT_EQ(1u, shared->references());
+}
+
+TEST(ArenaTest, FreedObjectsAreReusedAndSlabsReleasedInBulk) {
+	Fwk::Arena arena;
+	void *a = arena.objectNew(100);
+	void *b = arena.objectNew(112);
+	EXPECT_EQ(1u, arena.slabs());
+	EXPECT_EQ(2u, arena.live());
+	arena.objectDel(a, 100);
+	// same size class, so the freed object comes straight back
+	EXPECT_EQ(a, arena.objectNew(105));
+	void *large = arena.objectNew(Fwk::Arena::largestObject + 1);
+	EXPECT_EQ(2u, arena.live());
+	arena.objectDel(large, Fwk::Arena::largestObject + 1);
+	arena.slabsDel();
+	EXPECT_EQ(1u, arena.slabs());
+	arena.objectDel(a, 105);
+	arena.objectDel(b, 112);
+	arena.slabsDel();
+	EXPECT_EQ(0u, arena.slabs());
+	EXPECT_EQ(3u, arena.objects());
+}
+
+TEST(RegistryTest, HandlesStayPutAndAreReused) {
+	Fwk::Registry<int> registry;
+	typedef Fwk::Registry<int>::Handle Handle;
+	Handle b = registry.memberIs("b", 2);
+	Handle a = registry.memberIs("a", 1);
+	for (int i = 0; i < 1000; i++) {
+		std::stringstream name;
+		name << "n" << i;
+		registry.memberIs(name.str(), i);
+	}
+	// growing the index leaves the handles alone
+	EXPECT_EQ(b, registry.handle("b"));
+	EXPECT_EQ(a, registry.handle("a"));
+	EXPECT_EQ(1, registry.member(a));
+	EXPECT_EQ(500, registry.member("n500"));
+	EXPECT_EQ(1002u, registry.members());
+	EXPECT_EQ(registry.none(), registry.handle("c"));
+
+	EXPECT_EQ(b, registry.memberIs("b", 20));
+	EXPECT_EQ(20, registry.member(b));
+	EXPECT_TRUE(registry.memberDel("b"));
+	EXPECT_FALSE(registry.memberDel("b"));
+	EXPECT_EQ(registry.none(), registry.handle("b"));
+	EXPECT_EQ(b, registry.memberIs("c", 3));
+	EXPECT_EQ(1002u, registry.members());
+
+	std::vector<Handle> byName = registry.handlesByName();
+	ASSERT_EQ(1002u, byName.size());
+	EXPECT_EQ("a", registry.name(byName[0]));
+	EXPECT_EQ("c", registry.name(byName[1]));
+	EXPECT_EQ("n0", registry.name(byName[2]));
+
+	// the order is kept up as members come and go between listings
+	registry.memberIs("b", 4);
+	EXPECT_TRUE(registry.memberDel("n0"));
+	EXPECT_TRUE(registry.memberDel("a"));
+	registry.memberIs("aa", 5);
+	const std::vector<Handle> &again = registry.handlesByName();
+	ASSERT_EQ(1002u, again.size());
+	EXPECT_EQ("aa", registry.name(again[0]));
+	EXPECT_EQ("b", registry.name(again[1]));
+	EXPECT_EQ("c", registry.name(again[2]));
+	EXPECT_EQ("n1", registry.name(again[3]));
+	for (size_t i = 1; i < again.size(); i++) {
+		EXPECT_LT(registry.name(again[i - 1]), registry.name(again[i]));
+	}
+}
+
+TEST(SymbolTest, EqualNamesShareOneEntry) {
+	Fwk::String name("symbol");
+	Fwk::Symbol a(name), b("symbol"), c("other");
+	EXPECT_TRUE(a == b);
+	EXPECT_EQ(&a.value(), &b.value());
+	EXPECT_EQ(a.hash(), b.hash());
+	EXPECT_TRUE(a != c);
+	EXPECT_EQ("other", c.value());
+	U32 symbols = Fwk::Symbol::symbols();
+	Fwk::Symbol d("symbol");
+	EXPECT_EQ(symbols, Fwk::Symbol::symbols());
+	EXPECT_TRUE(Fwk::Symbol() == Fwk::Symbol(""));
+}
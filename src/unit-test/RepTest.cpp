@@ -1,7 +1,13 @@
 #include "gtest/gtest.h"
 #include "Engine.h"
 #include "Instance.h"
+#include "Checkpoint.h"
 #include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#include <stdlib.h>
+#include <unistd.h>
 
 using namespace Shipping;
 
@@ -70,4 +76,369 @@ class ConnRepTest : public ::testing::Test {
 
 
 
-};
\ No newline at end of file
+};
+// a new empty file under /tmp, so that concurrent runs never share one
+static string temporaryPath(const char *prefix) {
+	string name = string("/tmp/") + prefix + "XXXXXX";
+	vector<char> path(name.begin(), name.end());
+	path.push_back('\0');
+	int fd = mkstemp(&path[0]);
+	EXPECT_NE(-1, fd);
+	if (fd >= 0) close(fd);
+	return &path[0];
+}
+
+TEST(LoaderRepTest, LoadsCsvAndBinaryNetworks) {
+	string csvPath = temporaryPath("RepTestNetworkCsv");
+	string binaryPath = temporaryPath("RepTestNetworkBin");
+	{
+		ofstream csv(csvPath.c_str());
+		csv << "# records may refer to ones further down\n"
+			<< "fleet,truck,20,1.5,40\n"
+			<< "segment,a-t,truck,a,100,t-a,2\n"
+			<< "segment,t-a,truck,t,100,,2,3,yes\n"
+			<< "demand,a,b,50,10,expedited\n"
+			<< "customer,a\n"
+			<< "customer,b\n"
+			<< "terminal,t,truck\n"
+			<< "port,p\n"
+			<< "segment,bad,submarine\n";
+	}
+	Ptr<Instance::Manager> manager = shippingInstanceManager();
+	Ptr<Instance> loader = manager->instanceNew("loader", "Loader");
+	loader->attributeIs("csv file", csvPath);
+	EXPECT_EQ("4", loader->attribute("locations"));
+	EXPECT_EQ("2", loader->attribute("segments"));
+	EXPECT_EQ("1", loader->attribute("demands"));
+	EXPECT_EQ("1", loader->attribute("errors"));
+
+	// the statistics heard about the whole batch
+	Ptr<Instance> stats = manager->instance("stats");
+	EXPECT_EQ("2", stats->attribute("Customer"));
+	EXPECT_EQ("1", stats->attribute("Truck terminal"));
+	EXPECT_EQ("2", stats->attribute("Truck segment"));
+
+	// reps for loaded entities come into being on first use
+	Ptr<Instance> segment = manager->instance("a-t");
+	ASSERT_TRUE(segment);
+	EXPECT_EQ(segment, manager->instance("a-t"));
+	EXPECT_EQ("a", segment->attribute("source"));
+	EXPECT_EQ("t-a", segment->attribute("return segment"));
+	EXPECT_EQ("2", segment->attribute("Capacity"));
+	EXPECT_EQ("yes", manager->instance("t-a")->attribute("expedite support"));
+	EXPECT_EQ("expedited", manager->instance("a")->attribute("Shipment Priority"));
+	EXPECT_EQ("b", manager->instance("a")->attribute("Destination"));
+	EXPECT_FALSE(manager->instanceNew("a", "Customer"));
+
+	loader->attributeIs("binary output file", binaryPath);
+	Ptr<Instance::Manager> copy = shippingInstanceManager();
+	copy->instanceNew("loader", "Loader")->attributeIs("binary file", binaryPath);
+	EXPECT_EQ("2", copy->instance("stats")->attribute("Truck segment"));
+	EXPECT_EQ("1", copy->instance("stats")->attribute("Port"));
+	EXPECT_EQ("t-a", copy->instance("a-t")->attribute("return segment"));
+	EXPECT_EQ("t", copy->instance("t-a")->attribute("source"));
+	EXPECT_EQ("3.00", copy->instance("t-a")->attribute("difficulty"));
+	EXPECT_EQ("50", copy->instance("a")->attribute("Shipment Size"));
+	EXPECT_EQ("40", copy->instance("fleet")->attribute("Truck, capacity"));
+	remove(csvPath.c_str());
+	remove(binaryPath.c_str());
+}
+
+TEST(LoaderRepTest, SnapshotsCarryPrecomputedRoutes) {
+	string csvPath = temporaryPath("RepTestSnapshotCsv");
+	string snapshotPath = temporaryPath("RepTestSnapshot");
+	{
+		ofstream csv(csvPath.c_str());
+		csv << "customer,a\n" << "customer,b\n" << "terminal,t,truck\n"
+			<< "segment,a-t,truck,a,100,t-a\n" << "segment,t-a,truck,t,100\n"
+			<< "segment,t-b,truck,t,50,b-t\n" << "segment,b-t,truck,b,50\n";
+	}
+	Ptr<Instance::Manager> manager = shippingInstanceManager();
+	Ptr<Instance> loader = manager->instanceNew("loader", "Loader");
+	loader->attributeIs("csv file", csvPath);
+	testing::internal::CaptureStdout();
+	loader->attributeIs("snapshot output file", snapshotPath);
+	// the routes are computed for the snapshot without starting a run
+	EXPECT_EQ("", testing::internal::GetCapturedStdout());
+	Connectivity::PtrConst original = manager->network()->connectivity();
+	EXPECT_EQ(Connectivity::off(), original->simulationStatus());
+	EXPECT_EQ(manager->network()->topologyVersion(), original->routesVersion());
+	ASSERT_EQ(2u, original->precomputedRoutes(Connectivity::dijkstra()).size());
+
+	Ptr<Instance::Manager> copy = shippingInstanceManager();
+	Ptr<Instance> copyLoader = copy->instanceNew("loader", "Loader");
+	copyLoader->attributeIs("snapshot file", snapshotPath);
+	EXPECT_EQ("3", copyLoader->attribute("locations"));
+	EXPECT_EQ("0", copyLoader->attribute("errors"));
+	EXPECT_EQ("50.00", copy->instance("t-b")->attribute("length"));
+
+	Network *network = copy->network();
+	Connectivity::Ptr conn = network->connectivity();
+	EXPECT_EQ(network->topologyVersion(), conn->routesVersion());
+	const Connectivity::RouteMap &routes = conn->precomputedRoutes(Connectivity::dijkstra());
+	ASSERT_EQ(2u, routes.size());
+	Path::PtrConst route = conn->shipmentPath(dynamic_cast<Customer *>(network->location("a").ptr()),
+		dynamic_cast<Customer *>(network->location("b").ptr()));
+	ASSERT_TRUE(route);
+	EXPECT_EQ(2u, route->numSegments());
+	EXPECT_EQ("t", route->part(2).loc->name());
+	EXPECT_EQ(150, route->distance().value());
+	Path::PtrConst before = original->precomputedRoutes(Connectivity::dijkstra()).begin()->second;
+	EXPECT_EQ(before->cost(), routes.begin()->second->cost());
+	EXPECT_EQ(2u, conn->precomputedRoutes(Connectivity::bfs()).size());
+
+	// starting the simulation keeps the installed routes
+	conn->simulationStatusIs(Connectivity::running());
+	EXPECT_EQ(route, conn->precomputedRoutes(Connectivity::dijkstra()).begin()->second);
+	conn->simulationStatusIs(Connectivity::off());
+
+	copyLoader->attributeIs("snapshot file", csvPath);
+	EXPECT_EQ("3", copyLoader->attribute("locations"));
+	remove(csvPath.c_str());
+	remove(snapshotPath.c_str());
+}
+
+// the counters a run leaves behind, to compare a resumed run against
+static string outcome(Network *network) {
+	stringstream s;
+	Statistics::PtrConst stats = network->statistics();
+	s << stats->numShipments(Statistics::enroute()) << " " << stats->numShipments(Statistics::delivered())
+		<< " " << stats->numShipments(Statistics::dropped());
+	vector<Segment::PtrConst> segments = network->segments();
+	for (size_t i = 0; i < segments.size(); i++) {
+		s << " " << segments[i]->name() << ":" << segments[i]->numShipmentsReceived().value()
+			<< "/" << segments[i]->numShipmentsToldToWait().value() << "/" << segments[i]->segmentLoad().value();
+	}
+	Customer::PtrConst b = dynamic_cast<const Customer *>(network->location("b").ptr());
+	s << " " << b->shipmentsReceived().value() << " " << b->totalCost().value() << " " << b->latencyHistogram().count();
+	return s.str();
+}
+
+TEST(LoaderRepTest, CheckpointsResumeARunExactly) {
+	string csvPath = temporaryPath("RepTestCheckpointCsv");
+	string startPath = temporaryPath("RepTestCheckpointStart");
+	string midPath = temporaryPath("RepTestCheckpointMid");
+	{
+		ofstream csv(csvPath.c_str());
+		csv << "fleet,truck,20,1,10\n" << "customer,a\n" << "customer,b\n" << "terminal,t,truck\n"
+			<< "segment,a-t,truck,a,100,t-a,2\n" << "segment,t-a,truck,t,100,,2\n"
+			<< "segment,t-b,truck,t,50,b-t,1\n" << "segment,b-t,truck,b,50,,1\n"
+			<< "demand,a,b,10,24\n";
+	}
+	Ptr<Instance::Manager> original = shippingInstanceManager();
+	Ptr<Instance> loader = original->instanceNew("loader", "Loader");
+	loader->attributeIs("csv file", csvPath);
+	original->instance("conn")->attributeIs("random seed", "7");
+	original->network()->connectivity()->simulationStatusIs(Connectivity::running());
+	Activity::Manager::Ptr activities = activityManagerInstance(original->network());
+	Time start = activities->now();
+	Checkpoint::CheckpointNew(original->network())->checkpointWrite(startPath);
+
+	Ptr<Instance::Manager> first = shippingInstanceManager();
+	Ptr<Instance> firstLoader = first->instanceNew("loader", "Loader");
+	firstLoader->attributeIs("checkpoint file", startPath);
+	EXPECT_EQ("none", firstLoader->attribute("checkpoint"));
+	EXPECT_EQ("7", first->instance("conn")->attribute("random seed"));
+	activities->nowIs(start.value() + 10);
+	firstLoader->attributeIs("checkpoint output file", midPath);
+	// the run carries on while the checkpoint is written
+	activities->nowIs(start.value() + 30);
+	EXPECT_NE("failed", firstLoader->attribute("checkpoint"));
+	string straight = outcome(first->network());
+	EXPECT_NE(string::npos, straight.find("t-b:"));
+
+	ASSERT_EQ("written", firstLoader->attribute("checkpoint wait"));
+	EXPECT_EQ("written", firstLoader->attribute("checkpoint"));
+	Ptr<Instance::Manager> resumed = shippingInstanceManager();
+	Ptr<Instance> resumedLoader = resumed->instanceNew("loader", "Loader");
+	resumedLoader->attributeIs("checkpoint file", midPath);
+	EXPECT_EQ(start.value() + 10, activities->now().value());
+	activities->nowIs(start.value() + 30);
+	EXPECT_EQ(straight, outcome(resumed->network()));
+
+	// only into an empty network
+	EXPECT_THROW(Checkpoint::CheckpointNew(resumed->network())->restoreIs(midPath), Fwk::Exception);
+	remove(csvPath.c_str());
+	remove(startPath.c_str());
+	remove(midPath.c_str());
+}
+
+TEST(LoaderRepTest, CheckpointsKeepRoutesAcrossTopologyChanges) {
+	string csvPath = temporaryPath("RepTestTopologyCsv");
+	string midPath = temporaryPath("RepTestTopologyMid");
+	{
+		ofstream csv(csvPath.c_str());
+		csv << "fleet,truck,20,1,10\n" << "customer,a\n" << "customer,b\n" << "terminal,t,truck\n"
+			<< "segment,a-t,truck,a,100,t-a,2\n" << "segment,t-a,truck,t,100,,2\n"
+			<< "segment,t-b,truck,t,50,b-t,1\n" << "segment,b-t,truck,b,50,,1\n"
+			<< "demand,a,b,10,24\n";
+	}
+	Ptr<Instance::Manager> first = shippingInstanceManager();
+	Ptr<Instance> firstLoader = first->instanceNew("loader", "Loader");
+	firstLoader->attributeIs("csv file", csvPath);
+	first->network()->connectivity()->simulationStatusIs(Connectivity::running());
+	Activity::Manager::Ptr activities = activityManagerInstance(first->network());
+	Time start = activities->now();
+	activities->nowIs(start.value() + 10);
+	// the running simulation keeps the routes it started with
+	first->instance("t-b")->attributeIs("length", "60");
+	firstLoader->attributeIs("checkpoint output file", midPath);
+	ASSERT_EQ("written", firstLoader->attribute("checkpoint wait"));
+	activities->nowIs(start.value() + 30);
+	string straight = outcome(first->network());
+
+	Ptr<Instance::Manager> resumed = shippingInstanceManager();
+	Ptr<Instance> resumedLoader = resumed->instanceNew("loader", "Loader");
+	resumedLoader->attributeIs("checkpoint file", midPath);
+	EXPECT_EQ("60.00", resumed->instance("t-b")->attribute("length"));
+	EXPECT_EQ(start.value() + 10, activities->now().value());
+	activities->nowIs(start.value() + 30);
+	EXPECT_EQ(straight, outcome(resumed->network()));
+	remove(csvPath.c_str());
+	remove(midPath.c_str());
+}
+
+static size_t sampleRows(const string &csv) {
+	return count(csv.begin(), csv.end(), '\n') - 1;
+}
+
+TEST(SamplerRepTest, AZeroIntervalStopsSamplingUntilItIsRaised) {
+	Ptr<Instance::Manager> manager = shippingInstanceManager();
+	Ptr<Instance> stats = manager->instanceNew("stats", "Stats");
+	Activity::Manager::Ptr activities = activityManagerInstance(manager->network());
+	double start = activities->now().value();
+
+	stats->attributeIs("sample interval", "1");
+	activities->nowIs(start + 2.5);
+	EXPECT_EQ(3u, sampleRows(stats->attribute("sample csv")));
+
+	// the sample already scheduled is taken, then sampling stops
+	stats->attributeIs("sample interval", "0");
+	activities->nowIs(start + 6.5);
+	EXPECT_EQ(4u, sampleRows(stats->attribute("sample csv")));
+
+	stats->attributeIs("sample interval", "1");
+	activities->nowIs(start + 8.5);
+	EXPECT_EQ(7u, sampleRows(stats->attribute("sample csv")));
+}
+
+TEST(MetricsRepTest, InvalidPortsLeaveTheExporterAlone) {
+	Ptr<Instance::Manager> manager = shippingInstanceManager();
+	Ptr<Instance> stats = manager->instanceNew("stats", "Stats");
+
+	stats->attributeIs("metrics port", "port");
+	EXPECT_EQ("", stats->attribute("metrics port"));
+	stats->attributeIs("metrics port", "0");
+	string port = stats->attribute("metrics port");
+	EXPECT_NE("", port);
+
+	stats->attributeIs("metrics port", "80x");
+	stats->attributeIs("metrics port", "");
+	stats->attributeIs("metrics port", "65536");
+	stats->attributeIs("metrics port", "99999999999999999999");
+	EXPECT_EQ(port, stats->attribute("metrics port"));
+
+	stats->attributeIs("metrics port", "-1");
+	EXPECT_EQ("", stats->attribute("metrics port"));
+}
+
+TEST(AttributeIdTest, TypedCallsMatchTheStringOnes) {
+	Ptr<Instance::Manager> manager = shippingInstanceManager();
+	Ptr<Instance> a = manager->instanceNew("ida", "Customer");
+	Ptr<Instance> b = manager->instanceNew("idb", "Customer");
+	Ptr<Instance> s = manager->instanceNew("ids", "Truck segment");
+	Ptr<Instance> fleet = manager->instance("fleet");
+
+	Instance::AttributeId length = s->attributeId("length");
+	Instance::AttributeId capacity = s->attributeId("Capacity");
+	ASSERT_NE(0u, length);
+	EXPECT_EQ(0u, s->attributeId("no such attribute"));
+	s->attributeValueIs(length, 12.5);
+	EXPECT_EQ("12.50", s->attribute("length"));
+	s->attributeIs(capacity, "7");
+	EXPECT_EQ(7, s->attributeValue(capacity));
+	// invalid values are ignored as with strings
+	s->attributeValueIs(length, -1);
+	EXPECT_EQ(12.5, s->attributeValue(length));
+	s->attributeIs(s->attributeId("source"), "ida");
+	EXPECT_EQ("ida", s->attribute("source"));
+	EXPECT_THROW(s->attributeIs("Shipments Received", "3"), Fwk::Exception);
+	EXPECT_THROW(s->attributeValueIs(s->attributeId("source"), 1), Fwk::Exception);
+
+	Instance::AttributeId nightSpeed = fleet->attributeId("Boat, speed night");
+	ASSERT_NE(0u, nightSpeed);
+	EXPECT_NE(nightSpeed, fleet->attributeId("Plane, speed night"));
+	EXPECT_EQ(0u, fleet->attributeId("Boat,speed"));
+	fleet->attributeValueIs(nightSpeed, 30);
+	EXPECT_EQ("30.00", fleet->attribute("Boat, speed night"));
+	fleet->attributeIs("Boat, capacity", "40");
+	EXPECT_EQ(40, fleet->attributeValue(fleet->attributeId("Boat, capacity day")));
+	EXPECT_THROW(fleet->attributeIs("Ship, speed", "1"), Fwk::Exception);
+
+	a->attributeValueIs(a->attributeId("Shipment Size"), 25);
+	EXPECT_EQ("25", a->attribute("Shipment Size"));
+	a->attributeIs(a->attributeId("Destination"), "idb");
+	EXPECT_EQ("idb", a->attribute(a->attributeId("Destination")));
+	EXPECT_EQ(0, b->attributeValue(b->attributeId("Shipments Received")));
+	EXPECT_EQ("ids", a->attribute("segment1"));
+}
+
+namespace {
+
+class CustomerChanges : public Customer::Notifiee {
+public:
+	CustomerChanges(): transferRates(0), shipmentSizes(0), destinations(0) {}
+	void onTransferRate(ShipmentCount) { ++transferRates; }
+	void onShipmentSize(PackageCount) { ++shipmentSizes; }
+	void onDestination(Customer::Ptr) { ++destinations; }
+	int transferRates, shipmentSizes, destinations;
+};
+
+}
+
+TEST(TransactionTest, ChangesApplyAtCloseWithOneNotificationEach) {
+	Ptr<Instance::Manager> manager = shippingInstanceManager();
+	Ptr<Instance> a = manager->instanceNew("ta", "Customer");
+	Ptr<Instance> b = manager->instanceNew("tb", "Customer");
+	Ptr<Instance> stats = manager->instance("stats");
+	Fwk::Ptr<CustomerChanges> changes = new CustomerChanges();
+	changes->referencesDec(1);
+	changes->notifierIs(dynamic_cast<Customer *>(manager->network()->location("ta").ptr()));
+
+	manager->transactionIs(true);
+	EXPECT_TRUE(manager->transaction());
+	Ptr<Instance> s = manager->instanceNew("ts", "Truck segment");
+	manager->instanceNew("tc", "Customer");
+	for (int i = 1; i <= 5; i++) {
+		stringstream rate;
+		rate << i;
+		a->attributeIs("Transfer Rate", rate.str());
+		a->attributeValueIs(a->attributeId("Shipment Size"), i * 10);
+	}
+	a->attributeIs("Destination", "tb");
+	s->attributeIs("length", "40");
+	s->attributeIs("source", "ta");
+	EXPECT_THROW(s->attributeIs("Shipments Refused", "1"), Fwk::Exception);
+	// nothing has happened yet
+	EXPECT_EQ("0", a->attribute("Transfer Rate"));
+	EXPECT_EQ("0.00", s->attribute("length"));
+	EXPECT_EQ("2", stats->attribute("Customer"));
+	EXPECT_EQ(0, changes->transferRates + changes->shipmentSizes + changes->destinations);
+
+	manager->transactionIs(false);
+	EXPECT_FALSE(manager->transaction());
+	EXPECT_EQ("5", a->attribute("Transfer Rate"));
+	EXPECT_EQ("50", a->attribute("Shipment Size"));
+	EXPECT_EQ("tb", a->attribute("Destination"));
+	EXPECT_EQ("40.00", s->attribute("length"));
+	EXPECT_EQ("ts", a->attribute("segment1"));
+	EXPECT_EQ("3", stats->attribute("Customer"));
+	EXPECT_EQ(1, changes->transferRates);
+	EXPECT_EQ(1, changes->shipmentSizes);
+	EXPECT_EQ(1, changes->destinations);
+
+	// outside a transaction changes apply at once
+	a->attributeIs("Transfer Rate", "2");
+	EXPECT_EQ("2", a->attribute("Transfer Rate"));
+	EXPECT_EQ(2, changes->transferRates);
+}